@@ -15,7 +15,7 @@ if [ "$NOIDEMCOMP" -eq 1 ]; then
   IDEMOP=""
   PREFIX="/opt/arm-newlib/noidem"
 else
-  IDEMOP="-Xclang -mllvm -Xclang -no-stack-slot-sharing -Xclang -mllvm -Xclang -idempotence-construction=speed"
+  IDEMOP="-Xclang -mllvm -Xclang -idempotence-construction=speed"
   PREFIX="/opt/arm-newlib/idem"
 fi
 
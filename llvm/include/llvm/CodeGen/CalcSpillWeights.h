@@ -12,6 +12,7 @@
 #define LLVM_CODEGEN_CALCSPILLWEIGHTS_H
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/SlotIndexes.h"
 
 namespace llvm {
@@ -19,6 +20,7 @@ namespace llvm {
   class LiveInterval;
   class LiveIntervals;
   class MachineBlockFrequencyInfo;
+  class MachineInstr;
   class MachineLoopInfo;
 
   /// \brief Normalize the spill weight of a live interval
@@ -42,6 +44,17 @@ namespace llvm {
     return UseDefFreq / (Size + 25*SlotIndex::InstrDist);
   }
 
+  /// \brief Collect the defs of Reg that would need a checkpoint if Reg were
+  /// spilled with idempotence construction enabled.
+  ///
+  /// A def needs one if a use of Reg may come before it in the same region.
+  /// The use reloads the stack slot and the spill store after the def writes
+  /// it, so MachineIdempotentRegions::fixStackSpills cuts the region before
+  /// the store.  Nothing is collected when the spill cost is disabled.
+  void findIdempotenceSpillCuts(unsigned Reg, const MachineFunction &MF,
+                                const MachineLoopInfo &MLI,
+                                SmallVectorImpl<MachineInstr *> &Defs);
+
   /// \brief Calculate auxiliary information for a virtual register such as its
   /// spill weight and allocation hint.
   class VirtRegAuxInfo {
@@ -0,0 +1,56 @@
+//===-------- IdempotenceLiveness.h -----------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the interface for the physical register liveness used
+// when lowering cuts to checkpoints after register allocation.  The live-in
+// registers of every block are computed once per function by iterating a
+// backward LivePhysRegs scan over the CFG to a fixed point, so every query
+// is exact.  MachineBasicBlock::computeRegisterLiveness only looks a bounded
+// distance ahead and reports registers it cannot decide as live, which makes
+// checkpoints save registers that are dead.
+//
+// Registers live at a point are found by starting from addLiveOuts and
+// stepping LivePhysRegs backward over the rest of the block.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_IDEMPOTENCELIVENESS_H
+#define LLVM_CODEGEN_IDEMPOTENCELIVENESS_H
+
+#include "llvm/ADT/BitVector.h"
+#include <vector>
+
+namespace llvm {
+
+class LivePhysRegs;
+class MachineBasicBlock;
+class MachineFunction;
+class TargetRegisterInfo;
+
+class IdempotenceLiveness {
+ public:
+  IdempotenceLiveness() : TRI_(nullptr) {}
+
+  // Computes the registers live into every block of MF.  Blocks without
+  // successors have nothing live out but the uses of their return.
+  void compute(const MachineFunction &MF);
+
+  // Adds the registers live out of MBB to Live.
+  void addLiveOuts(const MachineBasicBlock &MBB, LivePhysRegs &Live) const;
+
+ private:
+  const TargetRegisterInfo *TRI_;
+
+  // The live-in registers by block number.
+  std::vector<BitVector> LiveIns_;
+};
+
+} // End llvm namespace
+
+#endif
@@ -61,6 +61,12 @@ namespace llvm {
     IdempotenceConstructionMode;
   extern cl::opt<IdempotenceOptions::PreservationMode>
     IdempotencePreservationMode;
+  extern cl::opt<bool> IdempotenceVersioning;
+  extern cl::opt<bool> IdempotenceStripMining;
+  extern cl::opt<bool> IdempotenceDifferentialCheckpoints;
+  extern cl::opt<bool> IdempotenceInlineCheckpoints;
+  extern cl::opt<bool> IdempotenceExactCheckpoints;
+  extern cl::opt<unsigned> IdempotenceSpillCheckpointCost;
 
 } // namespace llvm
 
@@ -0,0 +1,110 @@
+//===-------- IdempotenceReport.h -------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the interface for the checkpoint report requested with
+// -idempotence-report=<file>.  Every cut gets a YAML record with its source
+// location, why it was placed, its loop depth, the number of registers its
+// checkpoint saves, and whether it was removed again as redundant.
+//
+// Cuts are recorded as they are placed: by ConstructIdempotentRegions in the
+// IR, and by MachineIdempotentRegions and the Thumb1 epilogue afterwards.  A
+// machine boundary is matched to the IR cut it came from by position among
+// the cuts of its IR block.  The report is written when the module is done.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_IDEMPOTENCEREPORT_H
+#define LLVM_CODEGEN_IDEMPOTENCEREPORT_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DebugLoc.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class BasicBlock;
+class Function;
+class Instruction;
+class LLVMContext;
+class MachineFunction;
+class MachineInstr;
+class MachineLoopInfo;
+class TargetInstrInfo;
+
+class IdempotenceReport {
+ public:
+  enum CauseTy {
+    Antidependence,   // A memory antidependence in the IR.
+    Forced,           // A volatile access, fence or atomic before the cut.
+    Spill,            // A spill slot reloaded and then spilled to again.
+    Return,           // The checkpoint in a function epilogue, or after
+                      // a call in its place.
+    Unknown           // A machine boundary with no matching IR cut.
+  };
+
+  struct Cut {
+    std::string Function;
+    std::string Location;
+    CauseTy Cause;
+    std::string Load, Store;
+    unsigned LoopDepth;
+    unsigned LiveRegisters;
+    bool Removed;
+
+    Cut() : Cause(Unknown), LoopDepth(0), LiveRegisters(0), Removed(false) {}
+  };
+
+  // Returns the report of this compilation, or null if none was requested.
+  static IdempotenceReport *get();
+
+  // Formats DL as file:line:column.
+  static std::string getLocation(const DebugLoc &DL, LLVMContext &Ctx);
+
+  // Records a cut placed before I by ConstructIdempotentRegions.  Load and
+  // Store are the antidependence it breaks, if any.
+  void addCut(const Instruction *I, CauseTy Cause, const Instruction *Load,
+              const Instruction *Store, unsigned LoopDepth);
+
+  // Matches the boundaries of MF to the cuts recorded for their IR blocks.
+  void mapBoundaries(const MachineFunction &MF, const TargetInstrInfo *TII,
+                     const MachineLoopInfo *MLI);
+
+  // Records a boundary added at the machine level.
+  void addBoundary(const MachineInstr *MI, CauseTy Cause, unsigned LoopDepth);
+
+  // Marks the cut of a boundary that was deleted as redundant.
+  void removeBoundary(const MachineInstr *MI);
+
+  // Records the registers the checkpoint lowered from a boundary saves.
+  void setLiveRegisters(const MachineInstr *MI, unsigned Registers);
+
+  // Records the checkpoint in an epilogue of MF.
+  void addReturn(const MachineFunction &MF, const DebugLoc &DL,
+                 unsigned Registers);
+
+  // Writes the report and forgets the module.
+  void write();
+
+ private:
+  std::vector<Cut> Cuts_;
+
+  // The cuts of the functions not yet matched to machine code, by IR block
+  // in program order, and those of the function being compiled by the
+  // machine boundary they were matched to.  The IR passes may run over
+  // several functions before the first one reaches the machine passes.
+  typedef DenseMap<const BasicBlock *, SmallVector<unsigned, 2> > BlockCutMap;
+  DenseMap<const Function *, BlockCutMap> BlockCuts_;
+  DenseMap<const MachineInstr *, unsigned> BoundaryCuts_;
+};
+
+} // End llvm namespace
+
+#endif
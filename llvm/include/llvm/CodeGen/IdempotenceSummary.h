@@ -0,0 +1,97 @@
+//===-------- IdempotenceSummary.h ------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the interface for the per-function memory summaries used
+// by MemoryIdempotenceAnalysis to look through calls.  A summary records the
+// memory a function may read before writing it and the memory it may write,
+// in terms of the globals and arguments it accesses, and whether the function
+// needs any cut of its own.
+//
+// Summaries are computed on demand, callees first, and cached for the rest of
+// the module so that a function and all of its callers agree on whether calls
+// to it end a region, and on which side of the return the checkpoint goes.
+// Under llvm-lto the module is the whole program and most functions are
+// internal, which is what makes calls transparent.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_IDEMPOTENCESUMMARY_H
+#define LLVM_CODEGEN_IDEMPOTENCESUMMARY_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CallSite.h"
+
+namespace llvm {
+
+class AliasAnalysis;
+class Function;
+class MachineInstr;
+class Value;
+
+class IdempotenceSummaries {
+ public:
+  struct Summary {
+    // Globals and arguments of the function whose memory it may read before
+    // writing it, and whose memory it may write.
+    SmallPtrSet<Value *, 4> ReadsFirst;
+    SmallPtrSet<Value *, 4> Writes;
+
+    // Nothing the function reads is overwritten before it returns, so it
+    // needs no cut of its own.
+    bool WARFree;
+
+    // A call to the function does not end the caller's region.  The function
+    // is WAR-free, calls nothing, and is only called directly from this
+    // module, where every caller accounts for its effects.  Its return
+    // checkpoint can then be left out.
+    bool Transparent;
+
+    // The function is not transparent, but is only called directly from
+    // this module, and calls and writes nothing, so nothing in it starts a
+    // region.  Every caller checkpoints right after each call to it, saving
+    // only the registers it has live, and its return checkpoint is left out
+    // instead.  The frame it pops is pushed again when the caller's region
+    // is re-executed, so an exception stacked over it does no harm.
+    bool CallerCheckpoint;
+
+    Summary() : WARFree(false), Transparent(false), CallerCheckpoint(false) {}
+  };
+
+  explicit IdempotenceSummaries(AliasAnalysis *AA) : AA_(AA) {}
+
+  // Returns the summary of F, computing it and those of its callees first if
+  // needed.
+  const Summary &get(Function &F);
+
+  // Returns the summary of the function CS calls if the call need not end
+  // the caller's region, or null.
+  const Summary *getTransparentCallee(CallSite CS);
+
+  // Maps a location of the summary of the function CS calls to the value it
+  // stands for in the caller.
+  static Value *mapToCaller(CallSite CS, Value *Location);
+
+ private:
+  AliasAnalysis *AA_;
+  DenseMap<const Function *, Summary> Summaries_;
+
+  void compute(Function &F, Summary &S);
+};
+
+// Returns true if the call MI ends its caller's region.  A call to a function
+// marked "idempotence-transparent" does not: the region runs on through the
+// callee, which usually returns without a checkpoint (and is merely counted
+// as one region too many when it does not).  Passes that look for a
+// boundary between a reload and a spill must not stop at such a call.
+bool callIsRegionBoundary(const MachineInstr *MI);
+
+} // End llvm namespace
+
+#endif
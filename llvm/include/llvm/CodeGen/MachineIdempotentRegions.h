@@ -57,6 +57,8 @@ template <> struct MITraits<const MachineInstr> {
   typedef const MachineBasicBlock ParentTy;
 };
 
+class IdempotenceReport;
+class MachineBlockFrequencyInfo;
 class IdempotentRegion;
 raw_ostream &operator<<(raw_ostream &OS, const IdempotentRegion &R);
 
@@ -382,6 +384,7 @@ class MachineIdempotentRegions : public MachineFunctionPass {
   virtual void print(raw_ostream &O, const Module* = 0) const;
   virtual void releaseMemory();
   virtual bool runOnMachineFunction(MachineFunction &MF);
+  virtual bool doFinalization(Module &M);
 
   // Region iterators.  The region returned by begin() is always the region that
   // starts at the entry point of the function.
@@ -437,6 +440,11 @@ private:
   const TargetInstrInfo    *TII_;
   const TargetRegisterInfo *TRI_;
   MachineDominatorTree *DT_; 
+  MachineLoopInfo *MLI_;
+  MachineBlockFrequencyInfo *MBFI_;
+
+  // The checkpoint report, if one was requested.
+  IdempotenceReport *Report_;
 
   // Region allocation and storage.
   BumpPtrAllocator RegionAllocator_;
@@ -451,6 +459,7 @@ private:
 
 
   void killDummyCalls(MachineFunction &MF);
+  void checkpointAfterCalls(MachineFunction &MF);
   void wrapCalls(MachineFunction &MF);
   void fixStackSpills(MachineFunction &MF);
   bool searchForPriorBoundaries(MachineBasicBlock::iterator I);
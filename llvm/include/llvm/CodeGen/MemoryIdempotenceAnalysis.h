@@ -53,6 +53,18 @@ class MemoryIdempotenceAnalysis : public FunctionPass {
   const_iterator end()    const { return CutSet_->end(); }
   bool           empty()  const { return CutSet_->empty(); }
 
+  // Returns true if calls to F do not end their callers' regions, so F needs
+  // no return checkpoint.  See IdempotenceSummaries.
+  bool isTransparent(Function &F) const;
+
+  // Returns true if every caller of F checkpoints right after calling it, so
+  // F needs no return checkpoint either.  See IdempotenceSummaries.
+  bool hasCallerCheckpoint(Function &F) const;
+
+  // Returns the load and the store of an antidependence the cut at I was
+  // placed for, or nulls if the instruction before I forced it.
+  std::pair<Instruction *, Instruction *> getCause(const Instruction *I) const;
+
   AntidependenceCutMapTy *CutMap_;
 
  private:
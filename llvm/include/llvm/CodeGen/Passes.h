@@ -439,6 +439,15 @@ namespace llvm {
   /// ConstructIdempotentRegions pass.
   FunctionPass *createConstructIdempotentRegionsPass();
 
+  /// ExpandIdempotentMemIntrinsics pass.
+  FunctionPass *createExpandIdempotentMemIntrinsicsPass();
+
+  /// VersionIdempotentRegions pass.
+  FunctionPass *createVersionIdempotentRegionsPass();
+
+  /// StripMineIdempotentLoops pass.
+  FunctionPass *createStripMineIdempotentLoopsPass();
+
   /// MachineIdempotentRegions pass.
   FunctionPass *createMachineIdempotentRegionsPass();
 
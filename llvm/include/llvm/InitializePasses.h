@@ -99,6 +99,9 @@ void initializeCodeGenPreparePass(PassRegistry&);
 void initializeConstantMergePass(PassRegistry&);
 void initializeConstantPropagationPass(PassRegistry&);
 void initializeConstructIdempotentRegionsPass(PassRegistry&);
+void initializeExpandIdempotentMemIntrinsicsPass(PassRegistry&);
+void initializeVersionIdempotentRegionsPass(PassRegistry&);
+void initializeStripMineIdempotentLoopsPass(PassRegistry&);
 void initializeMachineCopyPropagationPass(PassRegistry&);
 void initializeCostModelAnalysisPass(PassRegistry&);
 void initializeMachineIdempotentRegionsPass(PassRegistry&);
@@ -24,6 +24,7 @@
 namespace llvm {
 
 class InstrItineraryData;
+class LivePhysRegs;
 class LiveVariables;
 class MCAsmInfo;
 class MachineMemOperand;
@@ -626,10 +627,23 @@ public:
     assert(0 && "Target didn't implement TargetInstrInfo::emitIdemBoundary!");
   }
 
-  /// emitCheckpoint - Emit an checkpoint.
-  virtual void emitCheckpoint(MachineBasicBlock &MBB,
-                                MachineBasicBlock::iterator MI) const {
+  /// emitCheckpoint - Emit an checkpoint.  Returns the number of registers
+  /// it saves.  Live holds the registers live at MI; the target updates it
+  /// if it moves MI.  If InlineBudget is not null, the checkpoint may be
+  /// expanded inline, and the bytes this adds are taken from the budget.
+  virtual unsigned emitCheckpoint(MachineBasicBlock &MBB,
+                                  MachineBasicBlock::iterator MI,
+                                  LivePhysRegs &Live,
+                                  unsigned *InlineBudget = nullptr) const {
     assert(0 && "Target didn't implement TargetInstrInfo::emitCheckpoint!");
+    return 0;
+  }
+
+  /// selectDifferentialCheckpoints - Replace the checkpoints of MF with
+  /// variants that skip registers the checkpoint buffer already holds.
+  /// Returns the number of register stores saved.
+  virtual unsigned selectDifferentialCheckpoints(MachineFunction &MF) const {
+    return 0;
   }
 
   /// replaceWithIdemPop - Replace a POP with an idempotent POP.
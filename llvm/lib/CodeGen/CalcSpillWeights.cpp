@@ -8,6 +8,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/CodeGen/CalcSpillWeights.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/IdempotenceSummary.h"
 #include "llvm/CodeGen/LiveIntervalAnalysis.h"
 #include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -40,6 +43,67 @@ void llvm::calculateSpillWeightsAndHints(LiveIntervals &LIS,
   }
 }
 
+// Return true if a use of Reg may come before the def MI in its region.  The
+// region ends going backwards at an idempotence boundary or a call that ends
+// it (see callIsRegionBoundary).
+static bool isUsedEarlierInRegion(unsigned Reg, MachineInstr *MI,
+                                  const TargetInstrInfo &TII) {
+  if (MI->readsVirtualRegister(Reg))
+    return true;
+
+  typedef std::pair<const MachineBasicBlock *,
+                    MachineBasicBlock::const_iterator> WorkItem;
+  SmallVector<WorkItem, 8> Worklist;
+  SmallPtrSet<const MachineBasicBlock *, 16> Visited;
+  Worklist.push_back(WorkItem(MI->getParent(), MI));
+  do {
+    const MachineBasicBlock *MBB;
+    MachineBasicBlock::const_iterator I;
+    std::tie(MBB, I) = Worklist.pop_back_val();
+    bool Cut = false;
+    while (!Cut && I != MBB->begin()) {
+      --I;
+      if (TII.isIdemBoundary(I) || (I->isCall() && callIsRegionBoundary(I)))
+        Cut = true;
+      else if (!I->isDebugValue() && I->readsVirtualRegister(Reg))
+        return true;
+    }
+    if (Cut)
+      continue;
+    for (MachineBasicBlock::const_pred_iterator P = MBB->pred_begin(),
+         PE = MBB->pred_end(); P != PE; ++P)
+      if (Visited.insert(*P).second)
+        Worklist.push_back(WorkItem(*P, (*P)->end()));
+  } while (!Worklist.empty());
+  return false;
+}
+
+void llvm::findIdempotenceSpillCuts(unsigned Reg, const MachineFunction &MF,
+                                    const MachineLoopInfo &MLI,
+                                    SmallVectorImpl<MachineInstr *> &Defs) {
+  if (IdempotenceConstructionMode == IdempotenceOptions::NoConstruction ||
+      IdempotenceConstructionMode == IdempotenceOptions::OptimizeForIdeal ||
+      IdempotenceSpillCheckpointCost == 0)
+    return;
+
+  // A single def dominates its uses, so a use can only come before it around
+  // a loop.
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  bool OneDef = MRI.hasOneDef(Reg);
+  SmallPtrSet<MachineInstr *, 8> Visited;
+  for (MachineRegisterInfo::def_instr_iterator I = MRI.def_instr_begin(Reg),
+       E = MRI.def_instr_end(); I != E; ++I) {
+    MachineInstr *MI = &*I;
+    if (MI->isImplicitDef() || !Visited.insert(MI).second)
+      continue;
+    if (OneDef && !MLI.getLoopFor(MI->getParent()))
+      continue;
+    if (isUsedEarlierInRegion(Reg, MI, TII))
+      Defs.push_back(MI);
+  }
+}
+
 // Return the preferred allocation register for reg, given a COPY instruction.
 static unsigned copyHint(const MachineInstr *mi, unsigned reg,
                          const TargetRegisterInfo &tri,
@@ -190,6 +254,14 @@ VirtRegAuxInfo::calculateSpillWeightAndHint(LiveInterval &li) {
   // re-materialization.
   if (isRematerializable(li, LIS, *MF.getSubtarget().getInstrInfo()))
     totalWeight *= 0.5F;
+  else {
+    // Spilling would also add a checkpoint before each of these defs.
+    SmallVector<MachineInstr *, 4> Cuts;
+    findIdempotenceSpillCuts(li.reg, MF, Loops, Cuts);
+    for (unsigned i = 0, e = Cuts.size(); i != e; ++i)
+      totalWeight += IdempotenceSpillCheckpointCost *
+        LiveIntervals::getSpillWeight(true, false, &MBFI, Cuts[i]);
+  }
 
   li.weight = normalize(totalWeight, li.getSize(), numInstr);
 }
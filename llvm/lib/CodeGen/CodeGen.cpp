@@ -24,6 +24,9 @@ void llvm::initializeCodeGen(PassRegistry &Registry) {
   initializeBranchFolderPassPass(Registry);
   initializeCodeGenPreparePass(Registry);
   initializeConstructIdempotentRegionsPass(Registry);
+  initializeExpandIdempotentMemIntrinsicsPass(Registry);
+  initializeVersionIdempotentRegionsPass(Registry);
+  initializeStripMineIdempotentLoopsPass(Registry);
   initializeMachineIdempotentRegionsPass(Registry);
   initializePatchMachineIdempotentRegionsPass(Registry);
   initializeDeadMachineInstructionElimPass(Registry);
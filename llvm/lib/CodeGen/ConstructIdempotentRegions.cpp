@@ -14,12 +14,16 @@
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "construct-idempotent-regions"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/IdempotenceReport.h"
 #include "llvm/CodeGen/MemoryIdempotenceAnalysis.h"
 #include "llvm/CodeGen/Passes.h"
 #include "llvm/Support/CommandLine.h"
@@ -28,6 +32,9 @@
 #include <vector>
 using namespace llvm;
 
+STATISTIC(NumAntidependenceCuts, "Number of cuts for memory antidependences");
+STATISTIC(NumForcedCuts,         "Number of cuts forced by an instruction");
+
 class ConstructIdempotentRegions : public FunctionPass {
 public:
   static char ID;  // Pass identification, replacement for typeid
@@ -38,6 +45,7 @@ public:
   virtual bool runOnFunction(Function &F);
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequired<MemoryIdempotenceAnalysis>();
+    AU.addRequired<LoopInfoWrapperPass>();
     AU.addPreserved<MemoryIdempotenceAnalysis>();
     //AU.setPreservesAll();
   }
@@ -48,6 +56,7 @@ INITIALIZE_PASS_BEGIN(ConstructIdempotentRegions,
     "construct-idempotent-regions",
     "Idempotent Region Construction", "true", "false")
 INITIALIZE_PASS_DEPENDENCY(MemoryIdempotenceAnalysis)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
 INITIALIZE_PASS_END(ConstructIdempotentRegions,
     "construct-idempotent-regions",
     "Idempotent Region Construction", "true", "false")
@@ -56,6 +65,14 @@ FunctionPass *llvm::createConstructIdempotentRegionsPass() {
   return new ConstructIdempotentRegions();
 }
 
+// Marks F if its callers checkpoint right after calling it instead of F
+// checkpointing on return (see Thumb1FrameLowering::emitEpilogue and
+// MachineIdempotentRegions::checkpointAfterCalls).
+static void markCallerCheckpoint(Function &F, MemoryIdempotenceAnalysis *MIA) {
+  if (MIA->hasCallerCheckpoint(F))
+    F.addFnAttr("idempotence-caller-checkpoint");
+}
+
 bool ConstructIdempotentRegions::runOnFunction(Function &F) {
   assert(IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
          "pass should not be run");
@@ -73,25 +90,68 @@ bool ConstructIdempotentRegions::runOnFunction(Function &F) {
     {
       CallInst::Create(CP, "", F.begin()->begin());
     }
+    else if(MIA->isTransparent(F))
+    {
+      // Every caller analyzes calls to F as part of its own region, so F
+      // needs no return checkpoint (see Thumb1FrameLowering::emitEpilogue).
+      F.addFnAttr("idempotence-transparent");
+    }
 
-    for (MemoryIdempotenceAnalysis::const_iterator I = MIA->begin(),
-          E = MIA->end(); I != E; ++I) {
-      SmallPtrSet<Instruction *, 4> Stores = MIA->CutMap_->lookup(*I);
-      DEBUG(dbgs() << "JVDW: CutLocation:\t" << **I << '\n');
-      DEBUG(dbgs() << "JVDW: Number Stores Cut:\t" << Stores.size() << '\n');
+    // F may be compiled before or after its callers, so both mark where its
+    // return checkpoint goes.  Their summaries agree on it.
+    markCallerCheckpoint(F, MIA);
+    for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+      for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+        if (CallInst *CI = dyn_cast<CallInst>(I))
+          if (Function *Callee = CI->getCalledFunction())
+            markCallerCheckpoint(*Callee, MIA);
 
-      IRBuilder<> Builder(*I); 
+    // Visit the cuts in program order so that remarks and the report come
+    // out the same on every run.
+    LoopInfo *LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    IdempotenceReport *Report = IdempotenceReport::get();
+    LLVMContext &Ctx = F.getContext();
+    SmallPtrSet<Instruction *, 16> Cuts(MIA->begin(), MIA->end());
+    for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+      for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+        if (!Cuts.count(I))
+          continue;
+        SmallPtrSet<Instruction *, 4> Stores = MIA->CutMap_->lookup(I);
+        DEBUG(dbgs() << "JVDW: CutLocation:\t" << *I << '\n');
+        DEBUG(dbgs() << "JVDW: Number Stores Cut:\t" << Stores.size() << '\n');
 
-      if(IdempotenceConstructionMode == IdempotenceOptions::OptimizeForSpeed)
-      {
-        CallInst *CP = Builder.CreateCall(Idem, "");
-      }else if(IdempotenceConstructionMode == IdempotenceOptions::OptimizeForIdeal)
-      {
+        Instruction *Load, *Store;
+        std::tie(Load, Store) = MIA->getCause(I);
+        IdempotenceReport::CauseTy Cause;
+        if (Store) {
+          Cause = IdempotenceReport::Antidependence;
+          ++NumAntidependenceCuts;
+          emitOptimizationRemarkAnalysis(
+              Ctx, DEBUG_TYPE, F, I->getDebugLoc(),
+              "idempotence cut: store at " +
+              IdempotenceReport::getLocation(Store->getDebugLoc(), Ctx) +
+              " may overwrite what the load at " +
+              IdempotenceReport::getLocation(Load->getDebugLoc(), Ctx) +
+              " read (" + Twine(Stores.size()) + " store(s) cut)");
+        } else {
+          Cause = IdempotenceReport::Forced;
+          ++NumForcedCuts;
+          emitOptimizationRemarkAnalysis(
+              Ctx, DEBUG_TYPE, F, I->getDebugLoc(),
+              "idempotence cut after a volatile access, fence or atomic");
+        }
 
-      }else{
-        CallInst *CP = Builder.CreateCall(Idem, "");
+        // The size and speed modes differ in where the analysis places cuts
+        // (see getCandidateLevel()), not in the cut itself.  The ideal mode
+        // inserts no IR cuts.
+        if(IdempotenceConstructionMode != IdempotenceOptions::OptimizeForIdeal)
+        {
+          IRBuilder<> Builder(I);
+          Builder.CreateCall(Idem, "");
+          if (Report)
+            Report->addCut(I, Cause, Load, Store, LI->getLoopDepth(BB));
+        }
       }
-    }
   }
   return true;
 }
@@ -0,0 +1,142 @@
+//===-------- ExpandIdempotentMemIntrinsics.cpp -----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transformation pass expands small fixed-size memcpy, memmove and
+// memset calls into loads and stores before MemoryIdempotenceAnalysis runs.
+// Struct copies are common, and a call to the library routine ends the
+// region and pays for the checkpoint on its return.  Expanded, the copy is
+// just memory accesses: a cut is only needed if the source may overlap the
+// destination, and then only one.
+//
+// Every load is issued before the first store, which keeps memmove correct
+// and puts all the antidependences of a copy across the same point.  The
+// expansion is limited to as many loads as instruction selection would
+// expand inline itself, so the loaded values stay in registers.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "expand-idempotent-mem-intrinsics"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+using namespace llvm;
+
+STATISTIC(NumExpanded, "Number of memory intrinsics expanded inline");
+
+static cl::opt<unsigned> MaxExpandedAccesses(
+    "idempotence-expand-mem-ops", cl::Hidden,
+    cl::desc("Largest number of stores a memcpy, memmove or memset is "
+             "expanded into (0 disables the expansion)"),
+    cl::init(4));
+
+class ExpandIdempotentMemIntrinsics : public FunctionPass {
+public:
+  static char ID;  // Pass identification, replacement for typeid
+  ExpandIdempotentMemIntrinsics() : FunctionPass(ID) {
+    initializeExpandIdempotentMemIntrinsicsPass(
+      *PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnFunction(Function &F);
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.setPreservesCFG();
+  }
+
+private:
+  bool expand(MemIntrinsic *MI);
+};
+
+char ExpandIdempotentMemIntrinsics::ID = 0;
+INITIALIZE_PASS(ExpandIdempotentMemIntrinsics,
+    "expand-idempotent-mem-intrinsics",
+    "Idempotent Memory Intrinsic Expansion", false, false)
+
+FunctionPass *llvm::createExpandIdempotentMemIntrinsicsPass() {
+  return new ExpandIdempotentMemIntrinsics();
+}
+
+bool ExpandIdempotentMemIntrinsics::runOnFunction(Function &F) {
+  if (MaxExpandedAccesses == 0)
+    return false;
+
+  SmallVector<MemIntrinsic *, 8> Intrinsics;
+  for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+      if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I))
+        Intrinsics.push_back(MI);
+
+  bool Changed = false;
+  for (unsigned i = 0, e = Intrinsics.size(); i != e; ++i)
+    Changed |= expand(Intrinsics[i]);
+  return Changed;
+}
+
+// Replaces MI with loads and stores if its length is a small constant.
+bool ExpandIdempotentMemIntrinsics::expand(MemIntrinsic *MI) {
+  ConstantInt *Length = dyn_cast<ConstantInt>(MI->getLength());
+  if (!Length || MI->isVolatile())
+    return false;
+
+  // Use the widest access up to a word that the alignment and the length
+  // allow.
+  uint64_t Size = Length->getZExtValue();
+  unsigned Align = std::max(MI->getAlignment(), 1u);
+  unsigned Width = 4;
+  while (Width > Align || Size % Width)
+    Width /= 2;
+  uint64_t Count = Size / Width;
+  if (Count > MaxExpandedAccesses)
+    return false;
+
+  DEBUG(dbgs() << "Expanding " << *MI << " into " << Count << " store(s)\n");
+  IRBuilder<> Builder(MI);
+  IntegerType *IntTy = Builder.getIntNTy(Width * 8);
+  unsigned DestAS = MI->getDestAddressSpace();
+  Value *Dest = Builder.CreateBitCast(MI->getRawDest(),
+                                      IntTy->getPointerTo(DestAS));
+
+  SmallVector<Value *, 4> Values;
+  if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(MI)) {
+    unsigned SourceAS = MTI->getSourceAddressSpace();
+    Value *Source = Builder.CreateBitCast(MTI->getRawSource(),
+                                          IntTy->getPointerTo(SourceAS));
+    for (uint64_t i = 0; i != Count; ++i)
+      Values.push_back(Builder.CreateAlignedLoad(
+          Builder.CreateConstGEP1_32(Source, i), MinAlign(Align, i * Width)));
+  } else {
+    // Splat the byte of a memset across the access width.
+    Value *Byte = cast<MemSetInst>(MI)->getValue();
+    Value *Splat;
+    if (ConstantInt *C = dyn_cast<ConstantInt>(Byte))
+      Splat = ConstantInt::get(IntTy, APInt::getSplat(Width * 8,
+                                                      C->getValue()));
+    else if (Width == 1)
+      Splat = Byte;
+    else
+      Splat = Builder.CreateMul(Builder.CreateZExt(Byte, IntTy),
+                                ConstantInt::get(IntTy, APInt::getSplat(
+                                    Width * 8, APInt(8, 1))));
+    Values.append(Count, Splat);
+  }
+
+  for (uint64_t i = 0; i != Count; ++i)
+    Builder.CreateAlignedStore(Values[i],
+                               Builder.CreateConstGEP1_32(Dest, i),
+                               MinAlign(Align, i * Width));
+
+  MI->eraseFromParent();
+  ++NumExpanded;
+  return true;
+}
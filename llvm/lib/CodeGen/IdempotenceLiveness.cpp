@@ -0,0 +1,60 @@
+//===-------- IdempotenceLiveness.cpp ---------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the implementation of the post-RA liveness used when
+// lowering cuts to checkpoints.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/IdempotenceLiveness.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+void IdempotenceLiveness::compute(const MachineFunction &MF) {
+  TRI_ = MF.getSubtarget().getRegisterInfo();
+  LiveIns_.assign(MF.getNumBlockIDs(), BitVector(TRI_->getNumRegs()));
+
+  // The live-in sets only grow, so iterating to a fixed point terminates.
+  // Visiting the blocks bottom-up makes most loops converge in two passes.
+  LivePhysRegs Live(TRI_);
+  bool Changed;
+  do {
+    Changed = false;
+    for (MachineFunction::const_reverse_iterator B = MF.rbegin(),
+         BE = MF.rend(); B != BE; ++B) {
+      Live.clear();
+      addLiveOuts(*B, Live);
+      for (MachineBasicBlock::const_reverse_iterator I = B->rbegin(),
+           E = B->rend(); I != E; ++I)
+        if (!I->isDebugValue())
+          Live.stepBackward(*I);
+
+      BitVector &LiveIn = LiveIns_[B->getNumber()];
+      for (LivePhysRegs::const_iterator R = Live.begin(), RE = Live.end();
+           R != RE; ++R)
+        if (!LiveIn.test(*R)) {
+          LiveIn.set(*R);
+          Changed = true;
+        }
+    }
+  } while (Changed);
+}
+
+void IdempotenceLiveness::addLiveOuts(const MachineBasicBlock &MBB,
+                                      LivePhysRegs &Live) const {
+  for (MachineBasicBlock::const_succ_iterator S = MBB.succ_begin(),
+       SE = MBB.succ_end(); S != SE; ++S) {
+    const BitVector &LiveIn = LiveIns_[(*S)->getNumber()];
+    for (int R = LiveIn.find_first(); R != -1; R = LiveIn.find_next(R))
+      Live.addReg(R);
+  }
+}
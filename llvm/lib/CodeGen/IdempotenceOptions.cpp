@@ -50,5 +50,40 @@ cl::opt<IdempotenceOptions::PreservationMode> IdempotencePreservationMode(
                clEnumValEnd),
     cl::init(IdempotenceOptions::NoPreservation));
 
+cl::opt<bool> IdempotenceVersioning(
+    "idempotence-versioning", cl::Hidden,
+    cl::desc("Copy small objects in loops instead of cutting antidependences"),
+    cl::init(false));
+
+cl::opt<bool> IdempotenceStripMining(
+    "idempotence-strip-mining", cl::Hidden,
+    cl::desc("Unroll loops so that one cut covers several iterations"),
+    cl::init(false));
+
+cl::opt<bool> IdempotenceDifferentialCheckpoints(
+    "idempotence-differential-checkpoints", cl::Hidden,
+    cl::desc("Skip registers unchanged since the checkpoint before the "
+             "previous one"),
+    cl::init(false));
+
+cl::opt<bool> IdempotenceInlineCheckpoints(
+    "idempotence-inline-checkpoints", cl::Hidden,
+    cl::desc("Expand checkpoints in hot blocks inline instead of calling "
+             "the checkpoint routines"),
+    cl::init(false));
+
+cl::opt<bool> IdempotenceExactCheckpoints(
+    "idempotence-exact-checkpoints", cl::Hidden,
+    cl::desc("Call checkpoint routines generated for the exact live "
+             "registers instead of moving them down first"),
+    cl::init(false));
+
+cl::opt<unsigned> IdempotenceSpillCheckpointCost(
+    "idempotence-spill-checkpoint-cost", cl::Hidden,
+    cl::desc("Spill weight of the checkpoint a spill store needs after a "
+             "reload from its slot in the same region, in spill "
+             "instructions (0 disables it)"),
+    cl::init(8));
+
 } // namespace llvm
 
@@ -0,0 +1,179 @@
+//===-------- IdempotenceReport.cpp -----------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the implementation of the checkpoint report.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/IdempotenceReport.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetInstrInfo.h"
+using namespace llvm;
+
+static cl::opt<std::string> ReportFilename(
+    "idempotence-report", cl::Hidden, cl::value_desc("filename"),
+    cl::desc("Write a YAML record of every idempotence cut to this file"));
+
+static ManagedStatic<IdempotenceReport> TheReport;
+
+namespace llvm {
+namespace yaml {
+
+template <> struct ScalarEnumerationTraits<IdempotenceReport::CauseTy> {
+  static void enumeration(IO &io, IdempotenceReport::CauseTy &Cause) {
+    io.enumCase(Cause, "antidependence", IdempotenceReport::Antidependence);
+    io.enumCase(Cause, "forced", IdempotenceReport::Forced);
+    io.enumCase(Cause, "spill", IdempotenceReport::Spill);
+    io.enumCase(Cause, "return", IdempotenceReport::Return);
+    io.enumCase(Cause, "unknown", IdempotenceReport::Unknown);
+  }
+};
+
+template <> struct MappingTraits<IdempotenceReport::Cut> {
+  static void mapping(IO &io, IdempotenceReport::Cut &Cut) {
+    io.mapRequired("Function", Cut.Function);
+    io.mapRequired("Location", Cut.Location);
+    io.mapRequired("Cause", Cut.Cause);
+    io.mapOptional("Load", Cut.Load, std::string());
+    io.mapOptional("Store", Cut.Store, std::string());
+    io.mapRequired("LoopDepth", Cut.LoopDepth);
+    io.mapRequired("LiveRegisters", Cut.LiveRegisters);
+    io.mapRequired("Removed", Cut.Removed);
+  }
+};
+
+} // End yaml namespace
+} // End llvm namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(IdempotenceReport::Cut)
+
+IdempotenceReport *IdempotenceReport::get() {
+  if (ReportFilename.empty())
+    return NULL;
+  return &*TheReport;
+}
+
+std::string IdempotenceReport::getLocation(const DebugLoc &DL,
+                                           LLVMContext &Ctx) {
+  if (DL.isUnknown())
+    return "<unknown>:0:0";
+  DILocation DIL(DL.getAsMDNode(Ctx));
+  return (DIL.getFilename() + ":" + Twine(DIL.getLineNumber()) + ":" +
+          Twine(DIL.getColumnNumber())).str();
+}
+
+void IdempotenceReport::addCut(const Instruction *I, CauseTy Cause,
+                               const Instruction *Load,
+                               const Instruction *Store, unsigned LoopDepth) {
+  const Function *F = I->getParent()->getParent();
+  Cut C;
+  C.Function = F->getName();
+  C.Location = getLocation(I->getDebugLoc(), F->getContext());
+  C.Cause = Cause;
+  if (Load)
+    C.Load = getLocation(Load->getDebugLoc(), F->getContext());
+  if (Store)
+    C.Store = getLocation(Store->getDebugLoc(), F->getContext());
+  C.LoopDepth = LoopDepth;
+  BlockCuts_[F][I->getParent()].push_back(Cuts_.size());
+  Cuts_.push_back(C);
+}
+
+void IdempotenceReport::mapBoundaries(const MachineFunction &MF,
+                                      const TargetInstrInfo *TII,
+                                      const MachineLoopInfo *MLI) {
+  // Instruction selection keeps the cuts of a block in order, possibly spread
+  // over several machine blocks.  Boundaries past the cuts of their block,
+  // such as those in blocks duplicated since, are recorded as unknown.
+  BoundaryCuts_.clear();
+  BlockCutMap &BlockCuts = BlockCuts_[MF.getFunction()];
+  DenseMap<const BasicBlock *, unsigned> NextInBlock;
+  for (MachineFunction::const_iterator B = MF.begin(), BE = MF.end();
+       B != BE; ++B)
+    for (MachineBasicBlock::const_iterator I = B->begin(), E = B->end();
+         I != E; ++I) {
+      if (!TII->isIdemBoundary(I))
+        continue;
+      const BasicBlock *BB = B->getBasicBlock();
+      if (BB) {
+        const SmallVectorImpl<unsigned> &Cuts = BlockCuts[BB];
+        unsigned &N = NextInBlock[BB];
+        if (N < Cuts.size()) {
+          BoundaryCuts_[I] = Cuts[N++];
+          continue;
+        }
+      }
+      addBoundary(I, Unknown, MLI ? MLI->getLoopDepth(B) : 0);
+    }
+  BlockCuts_.erase(MF.getFunction());
+}
+
+void IdempotenceReport::addBoundary(const MachineInstr *MI, CauseTy Cause,
+                                    unsigned LoopDepth) {
+  const MachineFunction *MF = MI->getParent()->getParent();
+  Cut C;
+  C.Function = MF->getName();
+  C.Location = getLocation(MI->getDebugLoc(),
+                           MF->getFunction()->getContext());
+  C.Cause = Cause;
+  C.LoopDepth = LoopDepth;
+  BoundaryCuts_[MI] = Cuts_.size();
+  Cuts_.push_back(C);
+}
+
+void IdempotenceReport::removeBoundary(const MachineInstr *MI) {
+  DenseMap<const MachineInstr *, unsigned>::iterator It =
+    BoundaryCuts_.find(MI);
+  if (It == BoundaryCuts_.end())
+    return;
+  Cuts_[It->second].Removed = true;
+  BoundaryCuts_.erase(It);
+}
+
+void IdempotenceReport::setLiveRegisters(const MachineInstr *MI,
+                                         unsigned Registers) {
+  DenseMap<const MachineInstr *, unsigned>::iterator It =
+    BoundaryCuts_.find(MI);
+  if (It != BoundaryCuts_.end())
+    Cuts_[It->second].LiveRegisters = Registers;
+}
+
+void IdempotenceReport::addReturn(const MachineFunction &MF,
+                                  const DebugLoc &DL, unsigned Registers) {
+  Cut C;
+  C.Function = MF.getName();
+  C.Location = getLocation(DL, MF.getFunction()->getContext());
+  C.Cause = Return;
+  C.LiveRegisters = Registers;
+  Cuts_.push_back(C);
+}
+
+void IdempotenceReport::write() {
+  std::error_code EC;
+  raw_fd_ostream OS(ReportFilename, EC, sys::fs::F_Text);
+  if (EC)
+    report_fatal_error("cannot open idempotence report '" + ReportFilename +
+                       "': " + EC.message());
+  yaml::Output Out(OS);
+  Out << Cuts_;
+
+  Cuts_.clear();
+  BlockCuts_.clear();
+  BoundaryCuts_.clear();
+}
@@ -0,0 +1,217 @@
+//===-------- IdempotenceSummary.cpp ----------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the implementation of the per-function memory summaries
+// used by MemoryIdempotenceAnalysis to look through calls.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "idempotence-summary"
+#include "llvm/CodeGen/IdempotenceSummary.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/MachineInstr.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+// Returns true if the memory Load reads was written earlier in its block.
+// Such a load never reads a value from before the function was called.
+static bool isWrittenFirst(LoadInst *Load, AliasAnalysis *AA) {
+  AliasAnalysis::Location LoadLoc = AA->getLocation(Load);
+  BasicBlock::iterator I = Load, E = Load->getParent()->begin();
+  while (I != E) {
+    StoreInst *Store = dyn_cast<StoreInst>(--I);
+    if (!Store)
+      continue;
+    AliasAnalysis::Location StoreLoc = AA->getLocation(Store);
+    if (StoreLoc.Size >= LoadLoc.Size && AA->isMustAlias(StoreLoc, LoadLoc))
+      return true;
+  }
+  return false;
+}
+
+// Adds the memory Ptr points into to Locations.  Returns false if it is not
+// a global, an argument or a local of the function, which the summary cannot
+// describe.
+static bool addLocation(SmallPtrSetImpl<Value *> &Locations, Value *Ptr,
+                        AliasAnalysis *AA) {
+  Value *Object = GetUnderlyingObject(Ptr, AA->getDataLayout());
+  if (!isa<GlobalValue>(Object) && !isa<Argument>(Object) &&
+      !isa<AllocaInst>(Object))
+    return false;
+  Locations.insert(Object);
+  return true;
+}
+
+// Returns true if F calls nothing and writes no memory, so no cut or call in
+// it can start a region after its prologue has pushed the frame.
+static bool isReadOnlyLeaf(const Function &F) {
+  for (Function::const_iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+    for (BasicBlock::const_iterator I = BB->begin(), E = BB->end(); I != E;
+         ++I) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (ImmutableCallSite(I) || I->mayWriteToMemory())
+        return false;
+    }
+  return true;
+}
+
+// Returns true if every call to F is a direct call from this module, after
+// which the caller can checkpoint.  Optimizing for size, one checkpoint in
+// F's epilogue is smaller than one at each of several call sites.
+static bool isOnlyCalledDirectly(const Function &F) {
+  if (F.isDeclaration() || !F.hasLocalLinkage())
+    return false;
+  unsigned NumCalls = 0;
+  for (Value::const_use_iterator U = F.use_begin(), UE = F.use_end();
+       U != UE; ++U) {
+    const CallInst *CI = dyn_cast<CallInst>(U->getUser());
+    if (!CI || !ImmutableCallSite(CI).isCallee(&*U) || CI->isMustTailCall())
+      return false;
+    ++NumCalls;
+  }
+  return NumCalls <= 1 ||
+         IdempotenceConstructionMode != IdempotenceOptions::OptimizeForSize;
+}
+
+const IdempotenceSummaries::Summary &IdempotenceSummaries::get(Function &F) {
+  DenseMap<const Function *, Summary>::iterator It = Summaries_.find(&F);
+  if (It != Summaries_.end())
+    return It->second;
+
+  // A recursive call sees the conservative default.  Computing the callees
+  // may grow the map, so don't hold on to the entry meanwhile.
+  Summaries_[&F];
+  Summary S;
+  compute(F, S);
+  S.CallerCheckpoint = !S.Transparent && isOnlyCalledDirectly(F) &&
+                       isReadOnlyLeaf(F);
+  DEBUG(dbgs() << "Summary for " << F.getName() << ": "
+        << S.ReadsFirst.size() << " read first, " << S.Writes.size()
+        << " written" << (S.WARFree ? ", WAR-free" : "")
+        << (S.Transparent ? ", transparent" : "") << "\n");
+  return Summaries_[&F] = S;
+}
+
+const IdempotenceSummaries::Summary *
+IdempotenceSummaries::getTransparentCallee(CallSite CS) {
+  Function *Callee = CS.getCalledFunction();
+  if (!Callee)
+    return NULL;
+  const Summary &S = get(*Callee);
+  return S.Transparent ? &S : NULL;
+}
+
+Value *IdempotenceSummaries::mapToCaller(CallSite CS, Value *Location) {
+  if (Argument *A = dyn_cast<Argument>(Location))
+    return CS.getArgument(A->getArgNo());
+  return Location;
+}
+
+void IdempotenceSummaries::compute(Function &F, Summary &S) {
+  if (F.isDeclaration() || F.isVarArg())
+    return;
+
+  // Collect the underlying objects read first and written, locals included.
+  SmallPtrSet<Value *, 8> Reads, Writes;
+  bool Leaf = true;
+  for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+
+      if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+        if (!Load->isSimple())
+          return;
+        if (!isWrittenFirst(Load, AA_) &&
+            !addLocation(Reads, Load->getPointerOperand(), AA_))
+          return;
+      } else if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+        if (!Store->isSimple() ||
+            !addLocation(Writes, Store->getPointerOperand(), AA_))
+          return;
+      } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I)) {
+        // Memory intrinsics are lowered inline or to library routines that
+        // end the region early, either of which a caller may assume away.
+        if (MI->isVolatile())
+          return;
+        if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(MI))
+          if (!addLocation(Reads, MTI->getRawSource(), AA_))
+            return;
+        if (!addLocation(Writes, MI->getRawDest(), AA_))
+          return;
+      } else if (CallSite CS = CallSite(I)) {
+        // Only calls to WAR-free callees can be looked through.  What the
+        // callee reads first may have been written earlier in F, but assume
+        // it reads the caller's values.
+        Leaf = false;
+        Function *Callee = CS.getCalledFunction();
+        if (!Callee)
+          return;
+        const Summary &CalleeSummary = get(*Callee);
+        if (!CalleeSummary.WARFree)
+          return;
+        for (SmallPtrSet<Value *, 4>::const_iterator
+             L = CalleeSummary.ReadsFirst.begin(),
+             LE = CalleeSummary.ReadsFirst.end(); L != LE; ++L)
+          if (!addLocation(Reads, mapToCaller(CS, *L), AA_))
+            return;
+        for (SmallPtrSet<Value *, 4>::const_iterator
+             L = CalleeSummary.Writes.begin(),
+             LE = CalleeSummary.Writes.end(); L != LE; ++L)
+          if (!addLocation(Writes, mapToCaller(CS, *L), AA_))
+            return;
+      } else if (I->mayReadOrWriteMemory()) {
+        // Fences, atomics and va_arg always force a cut.
+        return;
+      }
+    }
+
+  // F is WAR-free if nothing it reads first may be written.  This ignores
+  // the order of the accesses, which the caller's analysis recovers.
+  for (SmallPtrSet<Value *, 8>::iterator R = Reads.begin(), RE = Reads.end();
+       R != RE; ++R)
+    for (SmallPtrSet<Value *, 8>::iterator W = Writes.begin(),
+         WE = Writes.end(); W != WE; ++W)
+      if (AA_->alias(*R, AliasAnalysis::UnknownSize,
+                     *W, AliasAnalysis::UnknownSize) != AliasAnalysis::NoAlias)
+        return;
+  S.WARFree = true;
+
+  // Locals are dead once F returns, so callers only see the rest.
+  for (SmallPtrSet<Value *, 8>::iterator R = Reads.begin(), RE = Reads.end();
+       R != RE; ++R)
+    if (!isa<AllocaInst>(*R))
+      S.ReadsFirst.insert(*R);
+  for (SmallPtrSet<Value *, 8>::iterator W = Writes.begin(),
+       WE = Writes.end(); W != WE; ++W)
+    if (!isa<AllocaInst>(*W))
+      S.Writes.insert(*W);
+
+  // Callers elsewhere treat a call as ending their region and rely on the
+  // callee's return checkpoint, so only functions whose every caller is in
+  // this module can be transparent.
+  S.Transparent = Leaf && F.hasLocalLinkage() && !F.hasAddressTaken();
+}
+
+bool llvm::callIsRegionBoundary(const MachineInstr *MI) {
+  assert(MI->isCall() && "not a call");
+  for (MachineInstr::const_mop_iterator MOP = MI->operands_begin(),
+       MOE = MI->operands_end(); MOP != MOE; ++MOP)
+    if (MOP->isGlobal())
+      if (const Function *Callee = dyn_cast<Function>(MOP->getGlobal()))
+        return !Callee->hasFnAttribute("idempotence-transparent");
+  return true;
+}
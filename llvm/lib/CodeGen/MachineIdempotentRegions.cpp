@@ -21,7 +21,13 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/IdempotenceLiveness.h"
 #include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/IdempotenceReport.h"
+#include "llvm/CodeGen/IdempotenceSummary.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineDominators.h"
@@ -32,9 +38,25 @@
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Target/TargetRegisterInfo.h"
+#include <algorithm>
 
 using namespace llvm;
 
+static cl::opt<unsigned> InlineCheckpointBudget(
+    "idempotence-inline-checkpoint-budget", cl::Hidden,
+    cl::desc("Bytes a function may grow by inlining checkpoints"),
+    cl::init(64));
+
+STATISTIC(NumSpillCuts,      "Number of cuts added for spill slots");
+STATISTIC(NumCallCuts,       "Number of cuts added after calls instead of "
+                             "return checkpoints");
+STATISTIC(NumRemovedCuts,    "Number of redundant cuts removed");
+STATISTIC(NumCheckpoints,    "Number of checkpoints lowered from cuts");
+STATISTIC(NumCheckpointRegs, "Number of registers saved by checkpoints");
+STATISTIC(NumInlineCheckpoints, "Number of checkpoints expanded inline");
+STATISTIC(NumSkippedRegs,    "Number of registers differential checkpoints "
+                             "skip");
+
 //===----------------------------------------------------------------------===//
 // IdempotentRegion
 //===----------------------------------------------------------------------===//
@@ -64,6 +86,8 @@ INITIALIZE_PASS_BEGIN(MachineIdempotentRegions,
                 "machine-idempotence-regions",
                 "Machine Idempotent Regions", false, true)
 INITIALIZE_PASS_DEPENDENCY(MachineDominatorTree)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
 INITIALIZE_PASS_END(MachineIdempotentRegions,
                 "machine-idempotence-regions",
                 "Machine Idempotent Regions", false, true)
@@ -74,6 +98,8 @@ FunctionPass *llvm::createMachineIdempotentRegionsPass() {
 
 void MachineIdempotentRegions::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<MachineDominatorTree>();
+  AU.addRequired<MachineLoopInfo>();
+  AU.addRequired<MachineBlockFrequencyInfo>();
   AU.setPreservesAll();
   MachineFunctionPass::getAnalysisUsage(AU);
 }
@@ -96,6 +122,9 @@ bool MachineIdempotentRegions::runOnMachineFunction(MachineFunction &MF) {
   TII_ = MF.getSubtarget().getInstrInfo();
   TRI_ = MF.getSubtarget().getRegisterInfo();
   DT_  = &getAnalysis<MachineDominatorTree>();
+  MLI_ = &getAnalysis<MachineLoopInfo>();
+  MBFI_ = &getAnalysis<MachineBlockFrequencyInfo>();
+  Report_ = IdempotenceReport::get();
 
   DEBUG(dbgs() << "*** Machine Idempotent Regions Pass *** Function:" << MF.getName() <<"\n");
 
@@ -105,6 +134,13 @@ bool MachineIdempotentRegions::runOnMachineFunction(MachineFunction &MF) {
   // Get rid of dummy calls
   killDummyCalls(MF);
 
+  // Tie the boundaries from the IR to the cuts recorded for the report.
+  if (Report_)
+    Report_->mapBoundaries(MF, TII_, MLI_);
+
+  // Checkpoint after calls to functions that return without one.
+  checkpointAfterCalls(MF);
+
   //// Take care of idempotency breaks between calls
   //wrapCalls(MF);
 
@@ -119,12 +155,22 @@ bool MachineIdempotentRegions::runOnMachineFunction(MachineFunction &MF) {
   // Lower the region entries to checkpoints.
   lowerIdemToCheckpoint(MF); 
 
+  // Skip the registers the checkpoint buffers already hold.
+  if (IdempotenceDifferentialCheckpoints)
+    NumSkippedRegs += TII_->selectDifferentialCheckpoints(MF);
+
   DEBUG(dbgs() << "*** End MIR Pass *** Function:" << MF.getName() <<"\n");
   }
 
   return false;
 }
 
+bool MachineIdempotentRegions::doFinalization(Module &M) {
+  if (IdempotenceReport *Report = IdempotenceReport::get())
+    Report->write();
+  return false;
+}
+
 // We ran into a problem where we would insert a checkpoint into a function that
 // did not expect to have any calls in it. As such it would find no need to save
 // it's link register. This is a very hacky fix to that, we always insert a
@@ -151,6 +197,34 @@ void MachineIdempotentRegions::killDummyCalls(MachineFunction &MF)
           }
 }
 
+// A function marked "idempotence-caller-checkpoint" leaves its return
+// checkpoint to its callers.  Its last region runs on through the return to
+// a boundary right after the call, before anything can overwrite the frame
+// it popped or the memory it read.
+void MachineIdempotentRegions::checkpointAfterCalls(MachineFunction &MF) {
+  for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B)
+    for (MachineBasicBlock::iterator I = B->begin(); I != B->end(); ++I) {
+      if (!I->isCall())
+        continue;
+      for (MachineInstr::mop_iterator MOP = I->operands_begin(),
+           MOE = I->operands_end(); MOP != MOE; ++MOP) {
+        if (!MOP->isGlobal())
+          continue;
+        const Function *Callee = dyn_cast<Function>(MOP->getGlobal());
+        if (!Callee ||
+            !Callee->hasFnAttribute("idempotence-caller-checkpoint"))
+          break;
+        IdempotentRegion &Region = createRegionBefore(&*B, std::next(I));
+        ++NumCallCuts;
+        if (Report_)
+          Report_->addBoundary(&Region.getEntry(), IdempotenceReport::Return,
+                               MLI_->getLoopDepth(B));
+        I = &Region.getEntry();
+        break;
+      }
+    }
+}
+
 // In order to compensate for our intra-procedural alias analysis we need to
 // checkpoint before and after calls. One way to do this is introduce
 // checkpoints before a call to a function or at the beginning of every function
@@ -230,7 +304,11 @@ bool MachineIdempotentRegions::searchForPriorBoundaries(MachineBasicBlock::itera
         return true;
       }
 
-      if(MI->mayLoad())
+      // A call may read memory too.  A transparent one does not end the
+      // region (see callIsRegionBoundary), but what it reads may be written
+      // after I, so it keeps I as much as a load does.  Any other call ends
+      // its callee's region at a boundary placed right after it.
+      if(MI->mayLoad() || MI->isCall())
       {
 
         DEBUG(dbgs() << "JVDW: Found non-redundant: " << *I <<'\n');
@@ -285,6 +363,9 @@ void MachineIdempotentRegions::removeDuplicates(MachineFunction &MF)
     {
       if(PrevI != I && TII_->isIdemBoundary(PrevI) && TII_->isIdemBoundary(I))
       {
+        ++NumRemovedCuts;
+        if (Report_)
+          Report_->removeBoundary(I);
         I->eraseFromParent();
         I = B->begin();
       }
@@ -299,6 +380,9 @@ void MachineIdempotentRegions::removeDuplicates(MachineFunction &MF)
       if(TII_->isIdemBoundary(I))
         if (searchForPriorBoundaries(I))
         {
+          ++NumRemovedCuts;
+          if (Report_)
+            Report_->removeBoundary(I);
           I->eraseFromParent();
           I = B->begin();
         }
@@ -307,12 +391,80 @@ void MachineIdempotentRegions::removeDuplicates(MachineFunction &MF)
 }
 
 // Turn the IDEM intrinsic into an actuall checkpoint.
+namespace {
+  // Orders boundaries by decreasing block frequency.
+  struct HotterBoundary {
+    const MachineBlockFrequencyInfo *MBFI;
+    HotterBoundary(const MachineBlockFrequencyInfo *MBFI) : MBFI(MBFI) {}
+    bool operator()(const MachineInstr *L, const MachineInstr *R) const {
+      return MBFI->getBlockFreq(L->getParent()) >
+        MBFI->getBlockFreq(R->getParent());
+    }
+  };
+}
+
 void MachineIdempotentRegions::lowerIdemToCheckpoint(MachineFunction &MF)
 {
+  SmallVector<MachineInstr *, 16> Boundaries;
   for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B)
     for (MachineBasicBlock::iterator I = B->begin(); I != B->end(); ++I)
       if (TII_->isIdemBoundary(I))
-        TII_->emitCheckpoint(*(I->getParent()), I);
+        Boundaries.push_back(I);
+
+  // Record the registers live at each boundary before any is lowered.  The
+  // code a checkpoint adds only reads registers live at it and writes ones
+  // dead at it, so it does not change the liveness at the others.
+  IdempotenceLiveness Liveness;
+  Liveness.compute(MF);
+  LivePhysRegs Live(TRI_);
+  DenseMap<MachineInstr *, BitVector> LiveAtBoundary;
+  for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B) {
+    Live.clear();
+    Liveness.addLiveOuts(*B, Live);
+    for (MachineBasicBlock::reverse_iterator I = B->rbegin(), E = B->rend();
+         I != E; ++I) {
+      if (I->isDebugValue())
+        continue;
+      Live.stepBackward(*I);
+      if (!TII_->isIdemBoundary(&*I))
+        continue;
+      BitVector &Regs = LiveAtBoundary[&*I];
+      Regs.resize(TRI_->getNumRegs());
+      for (LivePhysRegs::const_iterator R = Live.begin(), RE = Live.end();
+           R != RE; ++R)
+        Regs.set(*R);
+    }
+  }
+
+  // Checkpoints in blocks that run more often than the entry, such as loop
+  // bodies, may be expanded inline, hottest first until the function's code
+  // size budget runs out.  The rest call the checkpoint routines.
+  unsigned Budget = 0;
+  BlockFrequency EntryFreq = MBFI_->getBlockFreq(MF.begin());
+  if (IdempotenceInlineCheckpoints) {
+    Budget = InlineCheckpointBudget;
+    std::stable_sort(Boundaries.begin(), Boundaries.end(),
+                     HotterBoundary(MBFI_));
+  }
+
+  for (unsigned i = 0, e = Boundaries.size(); i != e; ++i) {
+    MachineInstr *MI = Boundaries[i];
+    unsigned OldBudget = Budget;
+    bool Hot = IdempotenceInlineCheckpoints &&
+      MBFI_->getBlockFreq(MI->getParent()) > EntryFreq;
+    const BitVector &Regs = LiveAtBoundary[MI];
+    Live.clear();
+    for (int R = Regs.find_first(); R != -1; R = Regs.find_next(R))
+      Live.addReg(R);
+    unsigned Registers = TII_->emitCheckpoint(*MI->getParent(), MI, Live,
+                                              Hot ? &Budget : nullptr);
+    ++NumCheckpoints;
+    NumCheckpointRegs += Registers;
+    if (Budget != OldBudget)
+      ++NumInlineCheckpoints;
+    if (Report_)
+      Report_->setLiveRegisters(MI, Registers);
+  }
 
   // Remove idem boundaries
   for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B)
@@ -372,7 +524,7 @@ bool MachineIdempotentRegions::scanForAliasingLoad(MachineInstr *Store,
   while (I != E) {
     --I;
     // If we see a forced cut, the path is already cut; don't scan any further.
-    if (TII_->isIdemBoundary(I) || I->isCall())
+    if (TII_->isIdemBoundary(I) || (I->isCall() && callIsRegionBoundary(I)))
       return true;
 
     // Otherwise, check for an aliasing load.
@@ -382,7 +534,12 @@ bool MachineIdempotentRegions::scanForAliasingLoad(MachineInstr *Store,
       DEBUG(dbgs() << "\tJVDW: comparing to " << *I << "\n");
       if (FI == tFI)
       {
-        createRegionBefore(Store->getParent(), Store);
+        IdempotentRegion &Region =
+          createRegionBefore(Store->getParent(), Store);
+        ++NumSpillCuts;
+        if (Report_)
+          Report_->addBoundary(&Region.getEntry(), IdempotenceReport::Spill,
+                               MLI_->getLoopDepth(Store->getParent()));
         return true;
       }
     }
@@ -401,7 +558,7 @@ bool MachineIdempotentRegions::scanForAliasingLoad(MachineInstr *Store,
     DEBUG(dbgs() << "\t" << *I );
 
     // If we see a forced cut, the path is already cut; don't scan any further.
-    if (TII_->isIdemBoundary(I) || I->isCall())
+    if (TII_->isIdemBoundary(I) || (I->isCall() && callIsRegionBoundary(I)))
       return true;
 
 
@@ -22,18 +22,29 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/IdempotenceSummary.h"
 #include "llvm/CodeGen/MemoryIdempotenceAnalysis.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/IR/PredIteratorCache.h"
 #include <algorithm>
+#include <map>
 #include <sstream>
 #include <vector>
 
@@ -53,6 +64,24 @@ static bool isSubloopPreheader(const BasicBlock &BB,
   return false;
 }
 
+// Returns true if every cycle in F goes through a loop header, so that going
+// around a cycle always advances some loop known to LoopInfo.
+static bool isReducible(const Function &F, const DominatorTree &DT) {
+  SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 16> Backedges;
+  FindFunctionBackedges(F, Backedges);
+  for (unsigned i = 0, e = Backedges.size(); i != e; ++i)
+    if (!DT.dominates(Backedges[i].second, Backedges[i].first))
+      return false;
+  return true;
+}
+
+// Returns true if V is an SSA value that needs a register while it is live.
+static bool isRegisterValue(const Value *V) {
+  if (V->getType()->isVoidTy() || isa<AllocaInst>(V))
+    return false;
+  return isa<Instruction>(V) || isa<Argument>(V);
+}
+
 static std::string getLocator(const Instruction &I) {
   unsigned Offset = 0;
   const BasicBlock *BB = I.getParent();
@@ -67,6 +96,35 @@ static std::string getLocator(const Instruction &I) {
 namespace {
   typedef std::pair<Instruction *, Instruction *> AntidependencePairTy;
   typedef SmallVector<Instruction *, 16> AntidependencePathTy;
+
+  // Stores that write the same pointer with the same size alias exactly the
+  // same loads, so they share alias and dependence queries.
+  typedef std::pair<Value *, uint64_t> AliasClassTy;
+
+  // How a load and a later store may access the same location, as far as
+  // alias and dependence analysis can tell.  Only a load that executes
+  // before the store in the same region is a write-after-read.
+  enum {
+    // The store may overwrite what the load read in an earlier iteration of
+    // some common loop.
+    CarriedWAR = 1,
+    // The store may overwrite what the load read in the same iteration of
+    // every common loop, if the load runs first.
+    SameIterationWAR = 2
+  };
+
+  // The effect of a range of instructions on the loads of one alias class
+  // that are exposed at its end, i.e. not yet followed by a cut.
+  struct ExposureTy {
+    enum KindTy {
+      Transparent, // Loads exposed at the start stay exposed
+      Killed,      // A forced cut hides everything before it
+      Generated    // Load is the last aliasing load and hides the rest
+    } Kind;
+    Instruction *Load;
+
+    ExposureTy(KindTy Kind, Instruction *Load = 0) : Kind(Kind), Load(Load) {}
+  };
 }
 
 namespace llvm {
@@ -97,19 +155,32 @@ raw_ostream &llvm::operator<<(raw_ostream &OS, const AntidependencePathTy &P) {
 //===----------------------------------------------------------------------===//
 
 namespace {
+  // Live value counts above this all rank the same.
+  static const unsigned MaxLiveValues = 127;
+
   class CandidateInfo {
    public:
     typedef SmallPtrSet<const AntidependencePathTy *, 4> UnintersectedPaths;
 
-    // Constructor.
+    // Constructor.  Level is the coarse execution cost of the candidate (see
+    // getCandidateLevel()) and Frequency breaks ties between candidates that
+    // cut as many paths.  LiveValues estimates the registers a checkpoint at
+    // the candidate saves.
     CandidateInfo(Instruction *Candidate,
-                  unsigned LoopDepth,
+                  unsigned Level,
+                  uint64_t Frequency,
+                  unsigned LiveValues,
                   bool IsSubloopPreheader);
 
     // Get the candidate instruction.
     Instruction *getCandidate() { return Candidate_; }
     const Instruction *getCandidate() const { return Candidate_; }
 
+    // Get the level of the candidate.
+    unsigned getLevel() const {
+      return ~PriorityElements_.Level & 0xFFFF;
+    }
+
     // Iteration support (const only).
     typedef UnintersectedPaths::const_iterator const_iterator;
     const_iterator begin()  const { return UnintersectedPaths_.begin(); }
@@ -126,24 +197,33 @@ namespace {
     // Debugging support.
     void print(raw_ostream &OS) const;
 
-    // Priority comparison function.
+    // Priority comparison function.  Among candidates at the same level that
+    // cut as many paths, the one executed least often wins, and then the one
+    // with the fewest live values.
     static bool compare(CandidateInfo *L, CandidateInfo *R) {
+      uint64_t LHigh = L->Priority_ >> 32, RHigh = R->Priority_ >> 32;
+      if (LHigh != RHigh)
+        return LHigh < RHigh;
+      if (L->Frequency_ != R->Frequency_)
+        return L->Frequency_ > R->Frequency_;
       return (L->Priority_ < R->Priority_);
     }
 
    private:
     Instruction *Candidate_;
     UnintersectedPaths UnintersectedPaths_;
+    uint64_t Frequency_;
 
     union {
       // Higher priority is better.
       struct {
         // From least important to most important (little endian):
         signed IntersectedPaths:16;    // prefer more already-intersected paths
-        signed IsSubloopPreheader:8;   // prefer preheaders
-        signed IsAntidependentStore:8; // prefer antidependent stores
+        signed IsSubloopPreheader:4;   // prefer preheaders
+        signed IsAntidependentStore:4; // prefer antidependent stores
+        signed FewerLiveValues:8;      // (inverted) prefer fewer live values
         signed UnintersectedPaths:16;  // prefer more unintersected paths
-        signed LoopDepth:16;           // (inverted) prefer outer loops
+        signed Level:16;               // (inverted) prefer colder code
       } PriorityElements_;
       uint64_t Priority_;
     };
@@ -152,14 +232,61 @@ namespace {
     CandidateInfo();
   };
 
-  typedef std::vector<CandidateInfo *> WorklistTy; 
+  // Bucketed priority queue of candidates for the hitting set computation.
+  //
+  // Level and the number of unintersected paths are the two most important
+  // parts of the priority, and the number of unintersected paths only ever
+  // goes down.  Candidates are therefore kept in one bucket per level and
+  // number of unintersected paths, and a cursor walks the
+  // buckets from the highest priority down without ever moving back up.  A
+  // bucket only receives candidates while it is below the cursor, so it is
+  // sorted on the rest of the priority once, when the cursor reaches it.
+  // Updating a candidate appends it to its new bucket in constant time and
+  // leaves a stale entry behind that pop() skips.
+  class CandidateQueue {
+   public:
+    CandidateQueue() : Current_(Levels_.end()) {}
+
+    // Add a candidate with all of its paths.  Must precede any pop().
+    void insert(CandidateInfo *Info);
+
+    // Move a candidate that just lost an unintersected path.
+    void update(CandidateInfo *Info);
+
+    // Remove and return the candidate with the highest priority, or NULL if
+    // no candidate has unintersected paths left.
+    CandidateInfo *pop();
+
+    // Debugging support.
+    void print(raw_ostream &OS) const;
+
+   private:
+    typedef std::vector<CandidateInfo *> BucketTy;
+
+    // The buckets of one level, indexed by unintersected paths.
+    struct LevelTy {
+      LevelTy() : Cursor(0), Sorted(false) {}
+      std::vector<BucketTy> Buckets;
+      unsigned Cursor;
+      bool Sorted;
+    };
+
+    // Coldest level first.
+    typedef std::map<unsigned, LevelTy> LevelMapTy;
+    LevelMapTy Levels_;
+    LevelMapTy::iterator Current_;
+  };
 } // end anonymous namespace
 
 CandidateInfo::CandidateInfo(Instruction *Candidate,
-                             unsigned LoopDepth,
+                             unsigned Level,
+                             uint64_t Frequency,
+                             unsigned LiveValues,
                              bool IsSubloopPreheader)
-    : Candidate_(Candidate), Priority_(0) {
-  PriorityElements_.LoopDepth = ~LoopDepth;
+    : Candidate_(Candidate), Frequency_(Frequency), Priority_(0) {
+  PriorityElements_.Level = ~Level;
+  PriorityElements_.FewerLiveValues =
+    MaxLiveValues - std::min(LiveValues, MaxLiveValues);
   PriorityElements_.IsAntidependentStore = false;
   PriorityElements_.IsSubloopPreheader = IsSubloopPreheader;
   PriorityElements_.UnintersectedPaths = 0;
@@ -169,8 +296,11 @@ CandidateInfo::CandidateInfo(Instruction *Candidate,
 void CandidateInfo::print(raw_ostream &OS) const {
   OS << "Candidate " << getLocator(*Candidate_)
     << "\n Priority:              " << Priority_
-    << "\n  LoopDepth:            " << PriorityElements_.LoopDepth
+    << "\n  Level:                " << getLevel()
+    << "\n  Frequency:            " << Frequency_
     << "\n  UnintersectedPaths:   " << PriorityElements_.UnintersectedPaths
+    << "\n  LiveValues:           "
+    << MaxLiveValues - PriorityElements_.FewerLiveValues
     << "\n  IsAntidependentStore: " << PriorityElements_.IsAntidependentStore
     << "\n  IsSubloopPreheader:   " << PriorityElements_.IsSubloopPreheader
     << "\n  IntersectedPaths:     " << PriorityElements_.IntersectedPaths
@@ -184,7 +314,9 @@ void CandidateInfo::add(const AntidependencePathTy &Path) {
 
   // Update other structures.
   PriorityElements_.UnintersectedPaths++;
-  assert(UnintersectedPaths_.insert(&Path).second && "already inserted");
+  bool Inserted = UnintersectedPaths_.insert(&Path).second;
+  (void)Inserted;
+  assert(Inserted && "already inserted");
 }
 
 void CandidateInfo::remove(const AntidependencePathTy &Path) {
@@ -195,11 +327,70 @@ void CandidateInfo::remove(const AntidependencePathTy &Path) {
          PriorityElements_.IntersectedPaths >= 0 && "Wrap around");
 
   // Remove Path from the list of unintersected paths.
-  assert(UnintersectedPaths_.erase(&Path) && "path not in set");
+  bool Erased = UnintersectedPaths_.erase(&Path);
+  (void)Erased;
+  assert(Erased && "path not in set");
   assert(static_cast<unsigned>(PriorityElements_.UnintersectedPaths) ==
          UnintersectedPaths_.size());
 }
 
+//===----------------------------------------------------------------------===//
+// CandidateQueue
+//===----------------------------------------------------------------------===//
+
+void CandidateQueue::insert(CandidateInfo *Info) {
+  LevelTy &Level = Levels_[Info->getLevel()];
+  if (Level.Buckets.size() <= Info->size())
+    Level.Buckets.resize(Info->size() + 1);
+  Level.Buckets[Info->size()].push_back(Info);
+  Level.Cursor = std::max(Level.Cursor, Info->size());
+  Current_ = Levels_.begin();
+}
+
+void CandidateQueue::update(CandidateInfo *Info) {
+  // Candidates without unintersected paths are never picked.
+  if (Info->empty())
+    return;
+
+  LevelTy &Level = Levels_[Info->getLevel()];
+  assert(Info->size() < Level.Cursor && "candidate moved up");
+  Level.Buckets[Info->size()].push_back(Info);
+}
+
+CandidateInfo *CandidateQueue::pop() {
+  for (; Current_ != Levels_.end(); ++Current_) {
+    LevelTy &Level = Current_->second;
+    for (; Level.Cursor != 0; --Level.Cursor, Level.Sorted = false) {
+      BucketTy &Bucket = Level.Buckets[Level.Cursor];
+      if (!Level.Sorted) {
+        std::sort(Bucket.begin(), Bucket.end(), CandidateInfo::compare);
+        Level.Sorted = true;
+      }
+
+      // Entries of candidates that have since moved down are stale.
+      while (!Bucket.empty()) {
+        CandidateInfo *Info = Bucket.back();
+        Bucket.pop_back();
+        if (Info->size() == Level.Cursor)
+          return Info;
+      }
+    }
+  }
+  return NULL;
+}
+
+void CandidateQueue::print(raw_ostream &OS) const {
+  OS << "Worklist:\n";
+  for (LevelMapTy::const_iterator I = Levels_.begin(), E = Levels_.end();
+       I != E; ++I)
+    for (unsigned U = I->second.Cursor; U != 0; --U)
+      for (BucketTy::const_iterator J = I->second.Buckets[U].begin(),
+           JE = I->second.Buckets[U].end(); J != JE; ++J)
+        if ((*J)->size() == U)
+          (*J)->print(OS);
+  OS << "\n";
+}
+
 //===----------------------------------------------------------------------===//
 // MemoryIdempotenceAnalysisImpl
 //===----------------------------------------------------------------------===//
@@ -222,6 +413,12 @@ class llvm::MemoryIdempotenceAnalysisImpl {
   MemoryIdempotenceAnalysis::CutSet CutSet_;
   MemoryIdempotenceAnalysis::AntidependenceCutMapTy CutMap_;
 
+  // For each cut, the first antidependence pair it was placed for.
+  DenseMap<const Instruction *, AntidependencePairTy> CutCauses_;
+
+  // For each candidate, the number of SSA values live right before it.
+  DenseMap<const Instruction *, unsigned> LiveValues_;
+
   // Intermediary data structure 1.
   typedef SmallVector<AntidependencePairTy, 16> AntidependencePairs;
   AntidependencePairs AntidependencePairs_;
@@ -236,36 +433,65 @@ class llvm::MemoryIdempotenceAnalysisImpl {
   AliasAnalysis *AA_;
   DominatorTree *DT_;
   LoopInfo *LI_;
+  BlockFrequencyInfo *BFI_;
+  DependenceAnalysis *DA_;
+  bool Reducible_;
+
+  // Summaries of the functions in the module, kept across functions so that
+  // a function and its callers agree on them.
+  std::unique_ptr<IdempotenceSummaries> Summaries_;
+
+  // Dependence relations of the alias class being analyzed, by load and loop
+  // of the store.
+  DenseMap<std::pair<Instruction *, Loop *>, unsigned> Relations_;
 
   // Helper functions.
+  bool forcesCut(Instruction &I);
   void forceCut(BasicBlock::iterator I);
-  void findAntidependencePairs(Instruction *Write);
-  bool scanForAliasingLoad(BasicBlock::iterator I,
-                           BasicBlock::iterator E,
-                           StoreInst *Store);
+  bool isStore(Instruction &I);
+  bool mayRead(Instruction &I, const AliasClassTy &Class);
+  void findAntidependencePairs(const AliasClassTy &Class,
+                               ArrayRef<Instruction *> Stores);
+  void findBlockAntidependencePairs(const AliasClassTy &Class,
+                                    ArrayRef<Instruction *> Stores);
+  ExposureTy scanForAliasingLoad(BasicBlock::iterator I,
+                                 BasicBlock::iterator E,
+                                 const AliasClassTy &Class,
+                                 Instruction *Store, bool MayPrecede);
+  unsigned getRelation(Instruction *Load, const AliasClassTy &Class,
+                       Instruction *Store);
   void computeAntidependencePaths();
+  void computeLiveValues(const SmallPtrSetImpl<BasicBlock *> &Blocks);
   void computeHittingSet();
+  unsigned getCandidateLevel(const BasicBlock &BB) const;
+  uint64_t getCandidateFrequency(const BasicBlock &BB) const;
   void processRedundantCandidate(CandidateInfo *RedundantInfo,
-                                 WorklistTy *Worklist,
+                                 CandidateQueue *Worklist,
                                  const AntidependencePathTy &Path);
 };
 
 void MemoryIdempotenceAnalysisImpl::releaseMemory() {
   CutSet_.clear();
   CutMap_.clear();
+  CutCauses_.clear();
+  LiveValues_.clear();
   AntidependencePairs_.clear();
   AntidependencePaths_.clear();
   PredCache_.clear();
 }
 
-static bool forcesCut(const Instruction &I) {
-  // See comment at the head of forceCut() further below.
+bool MemoryIdempotenceAnalysisImpl::forcesCut(Instruction &I) {
+  // See comment at the head of forceCut() further below.  A call to a
+  // transparent function is analyzed as the loads and stores it summarizes,
+  // and a memory intrinsic as the ranges it reads and writes.
   if (const LoadInst *L = dyn_cast<LoadInst>(&I))
     return L->isVolatile();
   if (const StoreInst *S = dyn_cast<StoreInst>(&I))
     return S->isVolatile();
-  if (const CallInst *CI = dyn_cast<CallInst>(&I))
-    return !(CI->isTailCall());
+  if (const MemIntrinsic *MI = dyn_cast<MemIntrinsic>(&I))
+    return MI->isVolatile();
+  if (CallInst *CI = dyn_cast<CallInst>(&I))
+    return !(CI->isTailCall()) && !Summaries_->getTransparentCallee(CI);
   return (isa<InvokeInst>(I) ||
           isa<VAArgInst>(&I) ||
           isa<FenceInst>(&I) ||
@@ -278,6 +504,11 @@ bool MemoryIdempotenceAnalysisImpl::runOnFunction(Function &F) {
   AA_ = &MIA_->getAnalysis<AliasAnalysis>();
   DT_ = &MIA_->getAnalysis<DominatorTreeWrapperPass>().getDomTree();
   LI_ = &MIA_->getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  BFI_ = &MIA_->getAnalysis<BlockFrequencyInfo>();
+  DA_ = &MIA_->getAnalysis<DependenceAnalysis>();
+  Reducible_ = isReducible(F, *DT_);
+  if (!Summaries_)
+    Summaries_.reset(new IdempotenceSummaries(AA_));
   DEBUG(dbgs() << "\n*** MemoryIdempotenceAnalysis for Function "
         << F_->getName() << " ***\n");
 
@@ -288,11 +519,39 @@ bool MemoryIdempotenceAnalysisImpl::runOnFunction(Function &F) {
         forceCut(I);
 
   DEBUG(dbgs() << "\n** Computing Memory Antidependence Pairs\n");
+  typedef MapVector<AliasClassTy, SmallVector<Instruction *, 4> >
+    AliasClassMapTy;
+  AliasClassMapTy AliasClasses;
   for (Function::iterator BB = F.begin(); BB != F.end(); ++BB)
     for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I)
-      //if (isa<StoreInst>(I) || isa<CallInst>(I) || isa<MemIntrinsic>(I))
-      if (isa<StoreInst>(I))
-        findAntidependencePairs(I);
+      if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+        Type *Ty = Store->getValueOperand()->getType();
+        AliasClassTy Class(Store->getPointerOperand(),
+                           AA_->getTypeStoreSize(Ty));
+        AliasClasses[Class].push_back(Store);
+      } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I)) {
+        // A memory intrinsic stores to its whole destination range.
+        uint64_t Size = AliasAnalysis::UnknownSize;
+        if (ConstantInt *Length = dyn_cast<ConstantInt>(MI->getLength()))
+          Size = Length->getZExtValue();
+        AliasClasses[AliasClassTy(MI->getRawDest(), Size)].push_back(MI);
+      } else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+        // A transparent call stores to everything its callee may write.
+        const IdempotenceSummaries::Summary *Summary =
+          Summaries_->getTransparentCallee(CI);
+        if (!Summary)
+          continue;
+        for (SmallPtrSet<Value *, 4>::const_iterator
+             L = Summary->Writes.begin(), LE = Summary->Writes.end();
+             L != LE; ++L) {
+          AliasClassTy Class(IdempotenceSummaries::mapToCaller(CI, *L),
+                             AliasAnalysis::UnknownSize);
+          AliasClasses[Class].push_back(CI);
+        }
+      }
+  for (AliasClassMapTy::iterator I = AliasClasses.begin(),
+       E = AliasClasses.end(); I != E; ++I)
+    findAntidependencePairs(I->first, I->second);
 
   // Return early if there's nothing to analyze.
   if (AntidependencePairs_.empty())
@@ -320,82 +579,243 @@ void MemoryIdempotenceAnalysisImpl::forceCut(BasicBlock::iterator I) {
   CutSet_.insert(++I);
 }
 
-void MemoryIdempotenceAnalysisImpl::findAntidependencePairs(Instruction *Write) {
-  DEBUG(dbgs() << " Analyzing store " << getLocator(*Write) << "\n");
+// Returns true if I is a store, a memory intrinsic or a transparent call that
+// may write memory.
+bool MemoryIdempotenceAnalysisImpl::isStore(Instruction &I) {
+  if (isa<StoreInst>(I) || isa<MemIntrinsic>(I))
+    return true;
+  if (CallInst *CI = dyn_cast<CallInst>(&I))
+    if (const IdempotenceSummaries::Summary *Summary =
+          Summaries_->getTransparentCallee(CI))
+      return !Summary->Writes.empty();
+  return false;
+}
 
-  // Perform a reverse depth-first search to find aliasing loads.
-  typedef std::pair<BasicBlock *, BasicBlock::iterator> WorkItem;
-  SmallVector<WorkItem, 8> Worklist;
-  SmallPtrSet<BasicBlock *, 32> Visited;
+// Returns true if I is a load, a memcpy or memmove, or a transparent call
+// that may read memory of the class that was not written before.
+bool MemoryIdempotenceAnalysisImpl::mayRead(Instruction &I,
+                                            const AliasClassTy &Class) {
+  if (LoadInst *Load = dyn_cast<LoadInst>(&I))
+    return AA_->getModRefInfo(Load, Class.first, Class.second) &
+      AliasAnalysis::Ref;
+  if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(&I))
+    return AA_->alias(AA_->getLocationForSource(MTI),
+                      AliasAnalysis::Location(Class.first, Class.second)) !=
+      AliasAnalysis::NoAlias;
+  if (isa<MemSetInst>(I))
+    return false;
+  if (CallInst *CI = dyn_cast<CallInst>(&I))
+    if (const IdempotenceSummaries::Summary *Summary =
+          Summaries_->getTransparentCallee(CI))
+      for (SmallPtrSet<Value *, 4>::const_iterator
+           L = Summary->ReadsFirst.begin(), LE = Summary->ReadsFirst.end();
+           L != LE; ++L)
+        if (AA_->alias(IdempotenceSummaries::mapToCaller(CI, *L),
+                       AliasAnalysis::UnknownSize, Class.first,
+                       Class.second) != AliasAnalysis::NoAlias)
+          return true;
+  return false;
+}
 
-  BasicBlock *WriteBB = Write->getParent();
-  Worklist.push_back(WorkItem(WriteBB, Write));
-  do {
-    BasicBlock *BB;
-    BasicBlock::iterator I, E;
-    tie(BB, I) = Worklist.pop_back_val();
+void MemoryIdempotenceAnalysisImpl::findAntidependencePairs(
+    const AliasClassTy &Class,
+    ArrayRef<Instruction *> Stores) {
+  DEBUG(dbgs() << " Analyzing " << Stores.size() << " store(s) to "
+        << *Class.first << "\n");
+
+  // Whether a load before the store in its block is antidependent differs
+  // from whether the same load is when reached around a loop back edge, so
+  // the dataflow runs separately for the stores of each block.  Alias and
+  // dependence queries are still shared by the whole class.
+  typedef MapVector<BasicBlock *, SmallVector<Instruction *, 4> > BlockMapTy;
+  BlockMapTy Blocks;
+  for (ArrayRef<Instruction *>::iterator I = Stores.begin(), E = Stores.end();
+       I != E; ++I)
+    Blocks[(*I)->getParent()].push_back(*I);
 
-    // If we are revisiting WriteBB, we scan to Write to complete the cycle.
-    // Otherwise we end at BB->begin().
-    E = (BB == WriteBB && I == BB->end()) ? (BasicBlock::iterator) Write : BB->begin();
+  Relations_.clear();
+  for (BlockMapTy::iterator I = Blocks.begin(), E = Blocks.end(); I != E; ++I)
+    findBlockAntidependencePairs(Class, I->second);
+}
 
-    // Scan for an aliasing load.  Terminate this path if we see one or a cut is
-    // already forced.
-    if(StoreInst *Store = dyn_cast<StoreInst>(Write))
-    {
-      if (scanForAliasingLoad(I, E, Store))
-        continue;
+void MemoryIdempotenceAnalysisImpl::findBlockAntidependencePairs(
+    const AliasClassTy &Class,
+    ArrayRef<Instruction *> Stores) {
+  // A store is antidependent on the nearest aliasing loads before it on any
+  // path that is not already cut.  Instead of searching backwards from each
+  // store, compute the aliasing loads exposed at the start of each block once
+  // for the whole class:
+  //
+  //   Exposed(BB) = U Exposure(P) over predecessors P
+  //   Exposure(P) = {Load}      if Load is the last aliasing load in P and no
+  //                             cut follows it
+  //               = {}          if P forces a cut after its last aliasing load
+  //               = Exposed(P)  otherwise
+  //
+  // Only blocks that a store can reach backwards without meeting an aliasing
+  // load or a cut are solved, and each block is scanned once.
+  typedef SmallSetVector<Instruction *, 4> LoadSetTy;
+  DenseMap<BasicBlock *, ExposureTy> Summaries;
+  DenseMap<BasicBlock *, LoadSetTy> Exposed;
+  DenseMap<BasicBlock *, SmallVector<BasicBlock *, 4> > Successors;
+  SmallVector<BasicBlock *, 16> Worklist;
+
+  // Scan from each store to the start of its block.
+  SmallVector<Instruction *, 4> OpenStores;
+  for (ArrayRef<Instruction *>::iterator I = Stores.begin(), E = Stores.end();
+       I != E; ++I) {
+    Instruction *Store = *I;
+    BasicBlock *BB = Store->getParent();
+    ExposureTy Local = scanForAliasingLoad(Store, BB->begin(), Class, Store,
+                                           true);
+    if (Local.Kind == ExposureTy::Generated) {
+      AntidependencePairTy Pair = AntidependencePairTy(Local.Load, Store);
+      DEBUG(dbgs() << "  " << Pair << "\n");
+      AntidependencePairs_.push_back(Pair);
+    } else if (Local.Kind == ExposureTy::Transparent) {
+      OpenStores.push_back(Store);
+      if (Exposed.insert(std::make_pair(BB, LoadSetTy())).second)
+        Worklist.push_back(BB);
     }
+  }
 
-    // If the path didn't terminate, continue on to predecessors.
-    for (BasicBlock **P = PredCache_.GetPreds(BB); *P; ++P)
-      if (Visited.insert(*P).second)
-        Worklist.push_back(WorkItem((*P), (*P)->end()));
-
-  } while (!Worklist.empty());
-}
+  // Find the blocks to solve and the edges between them, summarizing each
+  // predecessor on the way.  Only the store's own block is summarized as
+  // reached around a loop back edge, and only if every cycle is a loop.
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    for (BasicBlock **P = PredCache_.GetPreds(BB); *P; ++P) {
+      DenseMap<BasicBlock *, ExposureTy>::iterator It = Summaries.find(*P);
+      if (It == Summaries.end())
+        It = Summaries.insert(std::make_pair(
+            *P, scanForAliasingLoad((*P)->end(), (*P)->begin(), Class,
+                                    Stores.front(),
+                                    !Reducible_ ||
+                                    *P != Stores.front()->getParent()))).first;
+
+      const ExposureTy &Summary = It->second;
+      if (Summary.Kind == ExposureTy::Generated) {
+        Exposed[BB].insert(Summary.Load);
+      } else if (Summary.Kind == ExposureTy::Transparent) {
+        Successors[*P].push_back(BB);
+        if (Exposed.insert(std::make_pair(*P, LoadSetTy())).second)
+          Worklist.push_back(*P);
+      }
+    }
+  }
 
-bool MemoryIdempotenceAnalysisImpl::scanForAliasingLoad(BasicBlock::iterator I,
-                                                        BasicBlock::iterator E,
-                                                        StoreInst *Store) {
+  // A store to a global that reaches the function entry is antidependent on
+  // whatever wrote the global before the call.
+  BasicBlock *Entry = &F_->getEntryBlock();
+  if (isa<GlobalValue>(Class.first) && Exposed.count(Entry))
+    Exposed[Entry].insert(Entry->begin());
+
+  // Propagate exposed loads forward through transparent blocks.
+  for (DenseMap<BasicBlock *, LoadSetTy>::iterator I = Exposed.begin(),
+       E = Exposed.end(); I != E; ++I)
+    if (!I->second.empty())
+      Worklist.push_back(I->first);
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    SmallVectorImpl<BasicBlock *> &Succs = Successors[BB];
+    // Every successor was added to Exposed above, so these lookups do not
+    // grow the map.
+    const LoadSetTy &Loads = Exposed[BB];
+    for (SmallVectorImpl<BasicBlock *>::iterator S = Succs.begin(),
+         SE = Succs.end(); S != SE; ++S) {
+      LoadSetTy &SuccLoads = Exposed[*S];
+      bool Changed = false;
+      for (LoadSetTy::iterator L = Loads.begin(), LE = Loads.end(); L != LE;
+           ++L)
+        Changed |= SuccLoads.insert(*L);
+      if (Changed)
+        Worklist.push_back(*S);
+    }
+  }
 
-  Value *Pointer = Store->getOperand(1);
-  unsigned PointerSize = AA_->getTypeStoreSize(Store->getOperand(0)->getType());
+  // Stores not paired within their own block pair with every load exposed at
+  // its start.
+  for (SmallVectorImpl<Instruction *>::iterator I = OpenStores.begin(),
+       E = OpenStores.end(); I != E; ++I) {
+    LoadSetTy &Loads = Exposed[(*I)->getParent()];
+    for (LoadSetTy::iterator L = Loads.begin(), LE = Loads.end(); L != LE;
+         ++L) {
+      AntidependencePairTy Pair = AntidependencePairTy(*L, *I);
+      DEBUG(dbgs() << "  " << Pair << "\n");
+      AntidependencePairs_.push_back(Pair);
+    }
+  }
+}
 
+// Scans backwards from I to E for a forced cut or a load that Store, one of
+// the class's stores, may be antidependent on.  MayPrecede is false if the
+// range is only reached from Store around a loop back edge.
+ExposureTy MemoryIdempotenceAnalysisImpl::scanForAliasingLoad(
+    BasicBlock::iterator I,
+    BasicBlock::iterator E,
+    const AliasClassTy &Class,
+    Instruction *Store,
+    bool MayPrecede) {
   while (I != E) {
     --I;
     // If we see a forced cut, the path is already cut; don't scan any further.
     if (forcesCut(*I))
-      return true;
-
-    // Otherwise, check for an aliasing load.
-    if (isa<LoadInst>(I)) {
-      if (AA_->getModRefInfo(I, Pointer, PointerSize) & AliasAnalysis::Ref) {
-        AntidependencePairTy Pair = AntidependencePairTy(I, Store);
-        DEBUG(dbgs() << "  " << Pair << "\n");
-        AntidependencePairs_.push_back(Pair);
-        DEBUG(dbgs() << "JVDW: Alias Pair Locations\n");
-        DEBUG(dbgs() << "JVDW: Load:\t" << *AA_->getLocation(dyn_cast<LoadInst>(I)).Ptr << "\n");
-        DEBUG(dbgs() << "JVDW: Store:\t" << *AA_->getLocation(Store).Ptr << "\n");
-        //if (AA_->getLocation(dyn_cast<LoadInst>(I)).Ptr != AA_->getLocation(Store).Ptr)
-        //  continue;
-        return true;
-      }
+      return ExposureTy(ExposureTy::Killed);
+
+    // Otherwise, check for an antidependent load or transparent call.
+    if (isa<LoadInst>(I) || isa<CallInst>(I)) {
+      unsigned Relation = getRelation(I, Class, Store);
+      if ((Relation & CarriedWAR) ||
+          (MayPrecede && (Relation & SameIterationWAR)))
+        return ExposureTy(ExposureTy::Generated, I);
     }
   }
+  return ExposureTy(ExposureTy::Transparent);
+}
 
-  // If this is the entry block to the function and it is a store to a global
-  // address
-  if (I->getParent() == &I->getParent()->getParent()->getEntryBlock())
-    if (isa<GlobalValue>(Store->getPointerOperand()))
-    {
-        AntidependencePairTy Pair = AntidependencePairTy(I, Store);
-        DEBUG(dbgs() << "  " << Pair << "\n");
-        AntidependencePairs_.push_back(Pair);
-        return true;
+// Alias analysis alone says "may alias" for a[i] and a[i+1] in a loop, which
+// would force a cut on every iteration.  Dependence analysis tells which
+// iterations of the common loops may touch the same element.  Its direction
+// vector runs from the load to the store, outermost loop first; the store can
+// overwrite a value the load read in an earlier iteration only if some loop
+// can advance ('<') while every loop outside it may stay put ('=').
+// Summarized calls and memory intrinsics are not analyzed further.
+unsigned MemoryIdempotenceAnalysisImpl::getRelation(Instruction *Load,
+                                                    const AliasClassTy &Class,
+                                                    Instruction *Store) {
+  std::pair<Instruction *, Loop *> Key(Load,
+                                       LI_->getLoopFor(Store->getParent()));
+  DenseMap<std::pair<Instruction *, Loop *>, unsigned>::iterator It =
+    Relations_.find(Key);
+  if (It != Relations_.end())
+    return It->second;
+
+  unsigned Relation = 0;
+  if (mayRead(*Load, Class)) {
+    std::unique_ptr<Dependence> D;
+    bool Summarized = !isa<LoadInst>(Load) || !isa<StoreInst>(Store);
+    if (!Summarized)
+      D = DA_->depends(Load, Store, true);
+    if (Summarized || (D && D->isConfused())) {
+      Relation = CarriedWAR | SameIterationWAR;
+    } else if (!D) {
+      DEBUG(dbgs() << "  No dependence from " << getLocator(*Load) << "\n");
+    } else {
+      unsigned Level = 1, Levels = D->getLevels();
+      for (; Level <= Levels; ++Level) {
+        unsigned Direction = D->getDirection(Level);
+        if (Direction & Dependence::DVEntry::LT)
+          Relation |= CarriedWAR;
+        if (!(Direction & Dependence::DVEntry::EQ))
+          break;
+      }
+      if (Level > Levels)
+        Relation |= SameIterationWAR;
     }
+  }
 
-  return false;
+  Relations_[Key] = Relation;
+  return Relation;
 }
 
 void MemoryIdempotenceAnalysisImpl::computeAntidependencePaths() {
@@ -413,13 +833,14 @@ void MemoryIdempotenceAnalysisImpl::computeAntidependencePaths() {
     // The antidependent store is always on the path.
     Path.push_back(Store);
 
-    // The rest of the path consists of other stores that dominate Store but do
-    // not dominate Load.  Handle the block-local case quickly.
+    // The rest of the path consists of other stores (including transparent
+    // calls) that dominate Store but do not dominate Load.  Handle the
+    // block-local case quickly.
     BasicBlock::iterator Cursor = Store;
     BasicBlock *SBB = Store->getParent(), *LBB = Load->getParent();
     if (SBB == LBB && DT_->dominates(Load, Store)) {
       while (--Cursor != Load)
-        if (isa<StoreInst>(Cursor))
+        if (isStore(*Cursor))
           Path.push_back(Cursor);
       DEBUG(dbgs() << " Local " << *I << " has path " << Path << "\n");
       continue;
@@ -432,7 +853,7 @@ void MemoryIdempotenceAnalysisImpl::computeAntidependencePaths() {
       DEBUG(dbgs() << "  Scanning dominating block " << BB->getName() << "\n");
       BasicBlock::iterator E = BB->begin();
       while (Cursor != E)
-        if (isa<StoreInst>(--Cursor))
+        if (isStore(*--Cursor))
           Path.push_back(Cursor);
 
       // Move the cursor to the end of BB's IDom block.
@@ -446,24 +867,91 @@ void MemoryIdempotenceAnalysisImpl::computeAntidependencePaths() {
   }
 }
 
-static void dumpWorklist(const WorklistTy &Worklist) {
-  dbgs() << "Worklist:\n";
-  for (WorklistTy::const_iterator I = Worklist.begin(), E = Worklist.end();
-       I != E; ++I)
-    (*I)->print(dbgs());
-  dbgs() << "\n";
+void MemoryIdempotenceAnalysisImpl::computeLiveValues(
+    const SmallPtrSetImpl<BasicBlock *> &Blocks) {
+  // Values live out of each block in Blocks.  A value is live out of the
+  // blocks a use is reachable from without going through its definition, and
+  // out of the incoming block of a PHI that uses it.
+  DenseMap<BasicBlock *, SmallPtrSet<Value *, 16> > LiveOut;
+  SmallVector<Value *, 64> Values;
+  for (Function::arg_iterator A = F_->arg_begin(), AE = F_->arg_end();
+       A != AE; ++A)
+    Values.push_back(A);
+  for (Function::iterator BB = F_->begin(), BE = F_->end(); BB != BE; ++BB)
+    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+      Values.push_back(I);
+
+  for (unsigned i = 0, e = Values.size(); i != e; ++i) {
+    Value *V = Values[i];
+    if (!isRegisterValue(V))
+      continue;
+    Instruction *Def = dyn_cast<Instruction>(V);
+    BasicBlock *DefBB = Def ? Def->getParent() : &F_->getEntryBlock();
+
+    SmallPtrSet<BasicBlock *, 16> LiveIn;
+    SmallVector<BasicBlock *, 16> Worklist;
+    for (Value::use_iterator U = V->use_begin(), UE = V->use_end();
+         U != UE; ++U) {
+      Instruction *User = cast<Instruction>(U->getUser());
+      if (PHINode *PN = dyn_cast<PHINode>(User)) {
+        BasicBlock *Incoming = PN->getIncomingBlock(*U);
+        if (Blocks.count(Incoming))
+          LiveOut[Incoming].insert(V);
+        if (Incoming != DefBB && LiveIn.insert(Incoming).second)
+          Worklist.push_back(Incoming);
+      } else if (User->getParent() != DefBB &&
+                 LiveIn.insert(User->getParent()).second) {
+        Worklist.push_back(User->getParent());
+      }
+    }
+    while (!Worklist.empty()) {
+      BasicBlock *BB = Worklist.pop_back_val();
+      for (BasicBlock **P = PredCache_.GetPreds(BB); *P; ++P) {
+        if (Blocks.count(*P))
+          LiveOut[*P].insert(V);
+        if (*P != DefBB && LiveIn.insert(*P).second)
+          Worklist.push_back(*P);
+      }
+    }
+  }
+
+  // Walk each block backwards from what is live out of it.
+  for (SmallPtrSetImpl<BasicBlock *>::const_iterator B = Blocks.begin(),
+       BE = Blocks.end(); B != BE; ++B) {
+    SmallPtrSet<Value *, 16> Live(LiveOut[*B]);
+    for (BasicBlock::iterator I = (*B)->end(), E = (*B)->begin(); I != E;) {
+      --I;
+      Live.erase(I);
+      if (!isa<PHINode>(I))
+        for (User::op_iterator O = I->op_begin(), OE = I->op_end();
+             O != OE; ++O)
+          if (isRegisterValue(*O))
+            Live.insert(*O);
+      LiveValues_[I] = Live.size();
+    }
+  }
 }
 
 void MemoryIdempotenceAnalysisImpl::computeHittingSet() {
   // This function does not use the linear-time version of the hitting set
   // approximation algorithm, which requires constant-time lookup and
   // constant-time insertion data structures.  This doesn't mesh well with
-  // a complex priority function such as ours.  This implementation adds a
-  // logarithmic factor using a sorted worklist to track priorities.  Although
-  // the time complexity is slightly higher, it is much more space efficient as
-  // a result.
+  // a complex priority function such as ours.  Instead, the candidates live
+  // in a bucketed priority queue (see CandidateQueue) that exploits the fact
+  // that priorities only ever go down: updates are constant time, and each
+  // bucket is sorted once on the less important parts of the priority.
   typedef DenseMap<const Instruction *, CandidateInfo *> CandidateInfoMapTy;
   CandidateInfoMapTy CandidateInfoMap;
+  BumpPtrAllocator Allocator;
+
+  // Estimate the register pressure in the blocks the candidates are in.
+  SmallPtrSet<BasicBlock *, 16> CandidateBlocks;
+  for (AntidependencePaths::iterator I = AntidependencePaths_.begin(),
+       IE = AntidependencePaths_.end(); I != IE; ++I)
+    for (AntidependencePathTy::iterator J = I->begin(), JE = I->end();
+         J != JE; ++J)
+      CandidateBlocks.insert((*J)->getParent());
+  computeLiveValues(CandidateBlocks);
 
   // Find all candidates and compute their priority.
   for (AntidependencePaths::iterator I = AntidependencePaths_.begin(),
@@ -475,32 +963,26 @@ void MemoryIdempotenceAnalysisImpl::computeHittingSet() {
       BasicBlock *CandidateBB = Candidate->getParent();
       CandidateInfo *&CI = CandidateInfoMap[Candidate];
       if (CI == NULL)
-        CI = new CandidateInfo(Candidate,
-                               LI_->getLoopDepth(CandidateBB),
-                               isSubloopPreheader(*CandidateBB, *LI_));
+        CI = new (Allocator.Allocate<CandidateInfo>())
+          CandidateInfo(Candidate,
+                        getCandidateLevel(*CandidateBB),
+                        getCandidateFrequency(*CandidateBB),
+                        LiveValues_.lookup(Candidate),
+                        isSubloopPreheader(*CandidateBB, *LI_));
       CI->add(Path);
     }
   }
 
-  // Set up a worklist sorted by priority.  The highest priority candidates
-  // will be at the back of the list.
-  WorklistTy Worklist; 
+  // Set up a worklist ordered by priority.
+  CandidateQueue Worklist;
   for (CandidateInfoMapTy::iterator I = CandidateInfoMap.begin(),
        E = CandidateInfoMap.end(); I != E; ++I)
-    Worklist.push_back(I->second);
-  std::sort(Worklist.begin(), Worklist.end(), CandidateInfo::compare);
-  DEBUG(dumpWorklist(Worklist));
-
-  // Process the candidates in the order that we see them popping off the back
-  // of the worklist.
-  while (!Worklist.empty()) {
-    CandidateInfo *Info = Worklist.back();
-    Worklist.pop_back();
-
-    // Skip over candidates with no unintersected paths.
-    if (Info->size() == 0)
-      continue;
+    Worklist.insert(I->second);
+  DEBUG(Worklist.print(dbgs()));
 
+  // Process the candidates in priority order.  Candidates with no
+  // unintersected paths are never returned.
+  while (CandidateInfo *Info = Worklist.pop()) {
     // Pick this candidate and put it in the hitting set.
     DEBUG(dbgs() << "Picking "; Info->print(dbgs()));
     SmallPtrSet<Instruction *, 4> *Antideps = &CutMap_[Info->getCandidate()];
@@ -508,70 +990,76 @@ void MemoryIdempotenceAnalysisImpl::computeHittingSet() {
 
     // For each path that the candidate intersects, the other candidates that
     // also intersect that path now intersect one fewer unintersected paths.
-    // Update those candidates (changes their priority) and intelligently
-    // re-insert them into the worklist at the right place.
+    // Update those candidates (changes their priority) and move them to the
+    // right place in the worklist.
+    unsigned First = AntidependencePaths_.size();
     for (CandidateInfo::const_iterator I = Info->begin(), IE = Info->end();
          I != IE; ++I) {
       DEBUG(dbgs() << " Processing redundant candidates for " << **I << "\n");
       Antideps->insert(*(*I)->begin());
+      First = std::min<unsigned>(First, *I - AntidependencePaths_.begin());
       for (AntidependencePathTy::const_iterator J = (*I)->begin(),
            JE = (*I)->end(); J != JE; ++J)
         if (*J != Info->getCandidate())
           processRedundantCandidate(CandidateInfoMap[*J], &Worklist, **I);
     }
+    CutCauses_[Info->getCandidate()] = AntidependencePairs_[First];
   }
 
-  // Clean up.
+  // Clean up.  The allocator frees the memory, but the path sets may own
+  // heap storage of their own.
   for (CandidateInfoMapTy::iterator I = CandidateInfoMap.begin(),
        E = CandidateInfoMap.end(); I != E; ++I)
-    delete I->second;
+    I->second->~CandidateInfo();
 }
 
-static void dumpCandidate(const CandidateInfo &RedundantInfo,
-                          const WorklistTy &Worklist) {
-  dbgs() << "Redundant candidate in position ";
-  WorklistTy::const_iterator It = std::lower_bound(
-      Worklist.begin(),
-      Worklist.end(),
-      const_cast<CandidateInfo *>(&RedundantInfo),
-      CandidateInfo::compare);
-  while (*It != &RedundantInfo)
-    ++It;
-  dbgs() << (It - Worklist.begin() + 1) << "/" << Worklist.size();
-  dbgs() << " " << getLocator(*RedundantInfo.getCandidate());
+// The level is the most important part of a candidate's priority: cuts go at
+// the lowest level that still cuts the paths.  When optimizing for speed it is
+// the order of magnitude of the block's estimated execution frequency, which
+// follows branch weight (!prof) metadata when present, so the cold side of a
+// branch is preferred even at the same loop depth.  When optimizing for size
+// every candidate is at the same level, so the fewest cuts win, and loop
+// depth only breaks ties between them.  Otherwise outer loops are preferred.
+unsigned
+MemoryIdempotenceAnalysisImpl::getCandidateLevel(const BasicBlock &BB) const {
+  switch (IdempotenceConstructionMode) {
+  case IdempotenceOptions::OptimizeForSpeed:
+    return Log2_64_Ceil(std::max<uint64_t>(getCandidateFrequency(BB), 1));
+  case IdempotenceOptions::OptimizeForSize:
+    return 0;
+  default:
+    return LI_->getLoopDepth(&BB);
+  }
+}
+
+// Speed mode breaks ties on the block frequency.  Size mode puts every
+// candidate at the same level and breaks ties on the loop depth instead, so
+// that of two cuts that cover the same paths the one outside the loop wins.
+uint64_t MemoryIdempotenceAnalysisImpl::getCandidateFrequency(
+    const BasicBlock &BB) const {
+  switch (IdempotenceConstructionMode) {
+  case IdempotenceOptions::OptimizeForSpeed:
+    return BFI_->getBlockFreq(&BB).getFrequency();
+  case IdempotenceOptions::OptimizeForSize:
+    return LI_->getLoopDepth(&BB);
+  default:
+    return 0;
+  }
 }
 
 void MemoryIdempotenceAnalysisImpl::processRedundantCandidate(
     CandidateInfo *RedundantInfo,
-    WorklistTy *Worklist,
+    CandidateQueue *Worklist,
     const AntidependencePathTy &Path) {
-  DEBUG(dbgs() << "  Before: ";
-        dumpCandidate(*RedundantInfo, *Worklist);
-        dbgs() << "\n");
-
-  // Find the place where the redundant candidate was in the worklist.  There
-  // may be multiple candidates at the same priority so we may have to iterate
-  // linearly a little bit.
-  WorklistTy::iterator OldPosition = std::lower_bound(
-    Worklist->begin(), Worklist->end(), RedundantInfo, CandidateInfo::compare);
-  while (*OldPosition != RedundantInfo)
-    ++OldPosition;
-
-  // Remove the path and update the candidate's priority.  The worklist is now
-  // no longer sorted.
-  RedundantInfo->remove(Path);
-
-  // Find the place to re-insert the redundant candidate in the worklist to make
-  // it sorted again.
-  WorklistTy::iterator NewPosition = std::lower_bound(
-    Worklist->begin(), Worklist->end(), RedundantInfo, CandidateInfo::compare);
-  assert(NewPosition <= OldPosition && "new position has higher priority");
+  DEBUG(dbgs() << "  Redundant candidate "
+        << getLocator(*RedundantInfo->getCandidate()) << ": "
+        << RedundantInfo->size());
 
-  // Re-insert by rotation.
-  std::rotate(NewPosition, OldPosition, next(OldPosition));
-  DEBUG(dbgs() << "  After: ";
-        dumpCandidate(*RedundantInfo, *Worklist);
-        dbgs() << "\n");
+  // Remove the path and update the candidate's priority, then move it to its
+  // new bucket.
+  RedundantInfo->remove(Path);
+  Worklist->update(RedundantInfo);
+  DEBUG(dbgs() << " -> " << RedundantInfo->size() << "\n");
 }
 
 void MemoryIdempotenceAnalysisImpl::print(raw_ostream &OS,
@@ -596,6 +1084,8 @@ INITIALIZE_PASS_BEGIN(MemoryIdempotenceAnalysis, "idempotence-analysis",
                 "Idempotence Analysis", true, true)
 INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfo)
+INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis)
 INITIALIZE_AG_DEPENDENCY(AliasAnalysis)
 INITIALIZE_PASS_END(MemoryIdempotenceAnalysis, "idempotence-analysis",
                 "Idempotence Analysis", true, true)
@@ -604,6 +1094,8 @@ void MemoryIdempotenceAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<AliasAnalysis>();
   AU.addRequired<DominatorTreeWrapperPass>();
   AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<BlockFrequencyInfo>();
+  AU.addRequired<DependenceAnalysis>();
   AU.setPreservesAll();
 }
 
@@ -627,6 +1119,19 @@ bool MemoryIdempotenceAnalysis::runOnFunction(Function &F) {
   return Impl->runOnFunction(F);
 }
 
+bool MemoryIdempotenceAnalysis::isTransparent(Function &F) const {
+  return Impl->Summaries_ && Impl->Summaries_->get(F).Transparent;
+}
+
+bool MemoryIdempotenceAnalysis::hasCallerCheckpoint(Function &F) const {
+  return Impl->Summaries_ && Impl->Summaries_->get(F).CallerCheckpoint;
+}
+
+std::pair<Instruction *, Instruction *>
+MemoryIdempotenceAnalysis::getCause(const Instruction *I) const {
+  return Impl->CutCauses_.lookup(I);
+}
+
 void MemoryIdempotenceAnalysis::print(raw_ostream &OS, const Module *M) const {
   Impl->print(OS, M);
 }
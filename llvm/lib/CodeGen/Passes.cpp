@@ -418,6 +418,11 @@ void TargetPassConfig::addIRPasses() {
   if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction)
   {
     addPass(createPromoteMemoryToRegisterPass());
+    addPass(createExpandIdempotentMemIntrinsicsPass());
+    if (IdempotenceVersioning)
+      addPass(createVersionIdempotentRegionsPass());
+    if (IdempotenceStripMining)
+      addPass(createStripMineIdempotentLoopsPass());
     addPass(createConstructIdempotentRegionsPass());
   }
 
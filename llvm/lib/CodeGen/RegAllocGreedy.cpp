@@ -24,6 +24,7 @@
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/CodeGen/CalcSpillWeights.h"
 #include "llvm/CodeGen/EdgeBundles.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
 #include "llvm/CodeGen/LiveIntervalAnalysis.h"
 #include "llvm/CodeGen/LiveRangeEdit.h"
 #include "llvm/CodeGen/LiveRegMatrix.h"
@@ -1110,6 +1111,17 @@ BlockFrequency RAGreedy::calcSpillCost() {
     if (BI.LiveIn && BI.LiveOut && BI.FirstDef)
       Cost += SpillPlacer->getBlockFrequency(Number);
   }
+
+  // With idempotence, a spill store after a reload from its slot in the same
+  // region needs a checkpoint as well.
+  SmallVector<MachineInstr *, 4> Cuts;
+  findIdempotenceSpillCuts(SA->getParent().reg, *MF, *Loops, Cuts);
+  for (unsigned i = 0, e = Cuts.size(); i != e; ++i) {
+    BlockFrequency Freq =
+      SpillPlacer->getBlockFrequency(Cuts[i]->getParent()->getNumber());
+    for (unsigned c = 0; c != IdempotenceSpillCheckpointCost; ++c)
+      Cost += Freq;
+  }
   return Cost;
 }
 
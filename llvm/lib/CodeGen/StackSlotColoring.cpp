@@ -15,6 +15,8 @@
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/IdempotenceSummary.h"
 #include "llvm/CodeGen/LiveIntervalAnalysis.h"
 #include "llvm/CodeGen/LiveStackAnalysis.h"
 #include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
@@ -81,6 +83,10 @@ namespace {
     // Assignments - Color to intervals mapping.
     SmallVector<SmallVector<LiveInterval*,4>, 16> Assignments;
 
+    // RegionWARs - With idempotence, the spill slots that may be reloaded
+    // before a spill slot is stored to in the same idempotent region.
+    SmallVector<BitVector, 16> RegionWARs;
+
   public:
     static char ID; // Pass identification
     StackSlotColoring() :
@@ -104,6 +110,7 @@ namespace {
   private:
     void InitializeSlots();
     void ScanForSpillSlotRefs(MachineFunction &MF);
+    void ScanForRegionWARs(MachineFunction &MF);
     bool OverlapWithAssignments(LiveInterval *li, int Color) const;
     int ColorSlot(LiveInterval *li);
     bool ColorSlots(MachineFunction &MF);
@@ -174,6 +181,48 @@ void StackSlotColoring::ScanForSpillSlotRefs(MachineFunction &MF) {
   }
 }
 
+/// ScanForRegionWARs - Find the spill slots reloaded before each spill slot
+/// is stored to, with no idempotence boundary or region-ending call in
+/// between.  Sharing such slots would turn a reload and a later spill into an
+/// antidependence that MachineIdempotentRegions has to cut.  The slots
+/// reloaded since the last boundary are propagated forward to a fixed point.
+void StackSlotColoring::ScanForRegionWARs(MachineFunction &MF) {
+  unsigned NumObjs = MFI->getObjectIndexEnd();
+  RegionWARs.assign(NumObjs, BitVector(NumObjs));
+  SmallVector<BitVector, 16> ReloadedOut(MF.getNumBlockIDs(),
+                                         BitVector(NumObjs));
+  BitVector Reloaded(NumObjs);
+  bool Changed;
+  do {
+    Changed = false;
+    for (MachineFunction::iterator MBBI = MF.begin(), E = MF.end();
+         MBBI != E; ++MBBI) {
+      Reloaded.reset();
+      for (MachineBasicBlock::pred_iterator P = MBBI->pred_begin(),
+           PE = MBBI->pred_end(); P != PE; ++P)
+        Reloaded |= ReloadedOut[(*P)->getNumber()];
+
+      for (MachineBasicBlock::iterator MII = MBBI->begin(), EE = MBBI->end();
+           MII != EE; ++MII) {
+        int FI;
+        if (TII->isIdemBoundary(MII) ||
+            (MII->isCall() && callIsRegionBoundary(MII)))
+          Reloaded.reset();
+        else if (TII->isLoadFromStackSlot(MII, FI) && FI >= 0)
+          Reloaded.set(FI);
+        else if (TII->isStoreToStackSlot(MII, FI) && FI >= 0)
+          RegionWARs[FI] |= Reloaded;
+      }
+
+      BitVector &Out = ReloadedOut[MBBI->getNumber()];
+      if (Out != Reloaded) {
+        Out = Reloaded;
+        Changed = true;
+      }
+    }
+  } while (Changed);
+}
+
 /// InitializeSlots - Process all spill stack slot liveintervals and add them
 /// to a sorted (by weight) list.
 void StackSlotColoring::InitializeSlots() {
@@ -207,14 +256,22 @@ void StackSlotColoring::InitializeSlots() {
 }
 
 /// OverlapWithAssignments - Return true if LiveInterval overlaps with any
-/// LiveIntervals that have already been assigned to the specified color.
+/// LiveIntervals that have already been assigned to the specified color, or,
+/// with idempotence, if one is reloaded and the other stored to in the same
+/// region.
 bool
 StackSlotColoring::OverlapWithAssignments(LiveInterval *li, int Color) const {
+  int FI = TargetRegisterInfo::stackSlot2Index(li->reg);
   const SmallVectorImpl<LiveInterval *> &OtherLIs = Assignments[Color];
   for (unsigned i = 0, e = OtherLIs.size(); i != e; ++i) {
     LiveInterval *OtherLI = OtherLIs[i];
     if (OtherLI->overlaps(*li))
       return true;
+    if (RegionWARs.empty())
+      continue;
+    int OtherFI = TargetRegisterInfo::stackSlot2Index(OtherLI->reg);
+    if (RegionWARs[FI].test(OtherFI) || RegionWARs[OtherFI].test(FI))
+      return true;
   }
   return false;
 }
@@ -442,6 +499,9 @@ bool StackSlotColoring::runOnMachineFunction(MachineFunction &MF) {
 
   // Gather spill slot references
   ScanForSpillSlotRefs(MF);
+  if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
+      IdempotenceConstructionMode != IdempotenceOptions::OptimizeForIdeal)
+    ScanForRegionWARs(MF);
   InitializeSlots();
   Changed = ColorSlots(MF);
 
@@ -457,6 +517,7 @@ bool StackSlotColoring::runOnMachineFunction(MachineFunction &MF) {
   for (unsigned i = 0, e = Assignments.size(); i != e; ++i)
     Assignments[i].clear();
   Assignments.clear();
+  RegionWARs.clear();
 
   return Changed;
 }
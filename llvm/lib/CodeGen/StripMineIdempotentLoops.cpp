@@ -0,0 +1,350 @@
+//===-------- StripMineIdempotentLoops.cpp ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transformation pass lets one cut cover several iterations of a loop.
+// When MemoryIdempotenceAnalysis cuts inside a loop body, the checkpoint runs
+// on every iteration, even if all the body does is x = f(x) on a global.  The
+// pass unrolls such loops by a factor K and compacts each strip of K
+// iterations:
+//
+//   - loads of a location stored to earlier in the strip use the stored
+//     value, so a loop-carried scalar stays in a register within the strip,
+//   - stores overwritten later in the strip before anything reads them are
+//     removed,
+//   - the remaining loads move above the first store of the strip if no
+//     store in between may write what they read.
+//
+// A strip then reads before it writes, and the analysis, run again on the
+// result, cuts it once.  K is the largest power of two that divides the trip
+// count and keeps the strip within the register and code size budgets.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "strip-mine-idempotent-loops"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/MemoryIdempotenceAnalysis.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
+#include <algorithm>
+using namespace llvm;
+
+STATISTIC(NumStripMined, "Number of loops strip-mined");
+STATISTIC(NumForwarded,  "Number of loads replaced by a stored value");
+STATISTIC(NumDeadStores, "Number of overwritten stores removed");
+STATISTIC(NumHoisted,    "Number of loads moved above a strip's stores");
+
+static cl::opt<unsigned> MaxStripFactor(
+    "idempotence-strip-max-factor", cl::Hidden,
+    cl::desc("Largest number of iterations that share one cut"),
+    cl::init(8));
+
+static cl::opt<unsigned> StripRegisters(
+    "idempotence-strip-registers", cl::Hidden,
+    cl::desc("Registers a strip may keep loaded values in"),
+    cl::init(6));
+
+static cl::opt<unsigned> StripSize(
+    "idempotence-strip-size", cl::Hidden,
+    cl::desc("Largest number of instructions in a strip"),
+    cl::init(64));
+
+class StripMineIdempotentLoops : public FunctionPass {
+public:
+  static char ID;  // Pass identification, replacement for typeid
+  StripMineIdempotentLoops() : FunctionPass(ID) {
+    initializeStripMineIdempotentLoopsPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool runOnFunction(Function &F);
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequiredID(LoopSimplifyID);
+    AU.addRequiredID(LCSSAID);
+    AU.addRequired<AliasAnalysis>();
+    AU.addRequired<AssumptionCacheTracker>();
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolution>();
+    AU.addRequired<MemoryIdempotenceAnalysis>();
+  }
+
+private:
+  AliasAnalysis *AA_;
+  LoopInfo *LI_;
+  ScalarEvolution *SE_;
+
+  unsigned getStripFactor(Loop *L);
+  void forwardStores(BasicBlock *BB);
+  void removeDeadStores(BasicBlock *BB);
+  void hoistLoads(BasicBlock *BB);
+};
+
+char StripMineIdempotentLoops::ID = 0;
+INITIALIZE_PASS_BEGIN(StripMineIdempotentLoops,
+    "strip-mine-idempotent-loops",
+    "Idempotent Loop Strip-Mining", false, false)
+INITIALIZE_PASS_DEPENDENCY(LoopSimplify)
+INITIALIZE_PASS_DEPENDENCY(LCSSA)
+INITIALIZE_PASS_DEPENDENCY(AssumptionCacheTracker)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolution)
+INITIALIZE_PASS_DEPENDENCY(MemoryIdempotenceAnalysis)
+INITIALIZE_AG_DEPENDENCY(AliasAnalysis)
+INITIALIZE_PASS_END(StripMineIdempotentLoops,
+    "strip-mine-idempotent-loops",
+    "Idempotent Loop Strip-Mining", false, false)
+
+FunctionPass *llvm::createStripMineIdempotentLoopsPass() {
+  return new StripMineIdempotentLoops();
+}
+
+// Counts the values that are live throughout L: its induction phis and what
+// it uses from outside.
+static unsigned countLiveIns(Loop *L) {
+  SmallPtrSet<Value *, 16> Live;
+  BasicBlock *Body = L->getHeader();
+  for (BasicBlock::iterator I = Body->begin(), E = Body->end(); I != E; ++I) {
+    if (isa<PHINode>(I)) {
+      Live.insert(I);
+      continue;
+    }
+    for (User::op_iterator O = I->op_begin(), OE = I->op_end(); O != OE;
+         ++O) {
+      Instruction *Def = dyn_cast<Instruction>(*O);
+      if ((Def && !L->contains(Def)) || isa<Argument>(*O) ||
+          isa<GlobalValue>(*O))
+        Live.insert(*O);
+    }
+  }
+  return Live.size();
+}
+
+// Adds to Moves, operands first, the instructions that have to move above
+// the first store of BB for I to move there.  Returns false if one of them
+// cannot move.
+static bool collectHoisted(Instruction *I, BasicBlock *BB,
+                           const SmallPtrSetImpl<Instruction *> &Above,
+                           SmallVectorImpl<Instruction *> &Moves) {
+  for (User::op_iterator O = I->op_begin(), OE = I->op_end(); O != OE; ++O) {
+    Instruction *Op = dyn_cast<Instruction>(*O);
+    if (!Op || Op->getParent() != BB || Above.count(Op) ||
+        std::find(Moves.begin(), Moves.end(), Op) != Moves.end())
+      continue;
+    if (isa<PHINode>(Op) || Op->mayReadOrWriteMemory() ||
+        Op->mayHaveSideEffects())
+      return false;
+    if (!collectHoisted(Op, BB, Above, Moves))
+      return false;
+  }
+  Moves.push_back(I);
+  return true;
+}
+
+bool StripMineIdempotentLoops::runOnFunction(Function &F) {
+  assert(IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
+         "pass should not be run");
+
+  // Unrolling trades code size for fewer checkpoints.
+  if (IdempotenceConstructionMode != IdempotenceOptions::OptimizeForSpeed)
+    return false;
+
+  AA_ = &getAnalysis<AliasAnalysis>();
+  LI_ = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  SE_ = &getAnalysis<ScalarEvolution>();
+  MemoryIdempotenceAnalysis *MIA = &getAnalysis<MemoryIdempotenceAnalysis>();
+  AssumptionCache *AC =
+    &getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+
+  // Find the innermost single-block loops with a cut in their body.  The
+  // analysis is invalidated once a loop changes, so collect them first.
+  SmallPtrSet<BasicBlock *, 16> CutBlocks;
+  for (MemoryIdempotenceAnalysis::const_iterator I = MIA->begin(),
+       E = MIA->end(); I != E; ++I)
+    CutBlocks.insert((*I)->getParent());
+  SmallVector<Loop *, 8> Loops;
+  for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+    if (Loop *L = LI_->getLoopFor(BB))
+      if (L->empty() && L->getNumBlocks() == 1 && CutBlocks.count(BB))
+        Loops.push_back(L);
+
+  bool Changed = false;
+  for (SmallVectorImpl<Loop *>::iterator L = Loops.begin(), LE = Loops.end();
+       L != LE; ++L) {
+    unsigned Factor = getStripFactor(*L);
+    if (Factor < 2)
+      continue;
+
+    // The factor divides the trip count, so only the last copy of the body
+    // keeps its exit test and the copies fold into one block.  Given a
+    // pass, UnrollLoop would also simplify the new induction variables,
+    // which takes a loop pass manager this function pass does not have.
+    // Without one it leaves ScalarEvolution, which the next loops still
+    // use, to be told about the change here; everything else the pass
+    // invalidates anyway.
+    SE_->forgetLoop(*L);
+    if (!UnrollLoop(*L, Factor, 0, false, Factor, LI_, nullptr, nullptr, AC))
+      continue;
+    ++NumStripMined;
+    Changed = true;
+
+    if ((*L)->getNumBlocks() != 1)
+      continue;
+    BasicBlock *Strip = (*L)->getHeader();
+    forwardStores(Strip);
+    removeDeadStores(Strip);
+    hoistLoads(Strip);
+  }
+  return Changed;
+}
+
+// Returns the number of iterations to put in one strip of L, or 1 if L is
+// not worth strip-mining.
+unsigned StripMineIdempotentLoops::getStripFactor(Loop *L) {
+  // Calls end the region on their own, and only simple accesses can be
+  // forwarded or moved.
+  BasicBlock *Body = L->getHeader();
+  unsigned Size = 0, Loads = 0;
+  for (BasicBlock::iterator I = Body->begin(), E = Body->end(); I != E; ++I) {
+    if (isa<PHINode>(I) || isa<DbgInfoIntrinsic>(I))
+      continue;
+    if (isa<CallInst>(I) || isa<InvokeInst>(I))
+      return 1;
+    if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+      if (!Load->isSimple())
+        return 1;
+      ++Loads;
+    } else if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+      if (!Store->isSimple())
+        return 1;
+    } else if (I->mayReadOrWriteMemory()) {
+      return 1;
+    }
+    ++Size;
+  }
+
+  // Loads moved to the top of the strip stay live until their copy of the
+  // body uses them, on top of what the loop keeps live anyway.
+  unsigned LiveIns = countLiveIns(L);
+  unsigned TripMultiple = SE_->getSmallConstantTripMultiple(L);
+  unsigned Factor = 1;
+  while (Factor * 2 <= MaxStripFactor && TripMultiple % (Factor * 2) == 0 &&
+         Factor * 2 * Size <= StripSize &&
+         LiveIns + Factor * 2 * Loads <= StripRegisters)
+    Factor *= 2;
+
+  DEBUG(dbgs() << "Strip-mining loop at " << Body->getName() << ": trip "
+        << "multiple " << TripMultiple << ", " << Size << " instruction(s), "
+        << Loads << " load(s), " << LiveIns << " live-in(s), factor "
+        << Factor << "\n");
+  return Factor;
+}
+
+// Replaces loads of a location stored to earlier in BB by the stored value.
+void StripMineIdempotentLoops::forwardStores(BasicBlock *BB) {
+  SmallVector<LoadInst *, 16> Loads;
+  for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+    if (LoadInst *Load = dyn_cast<LoadInst>(I))
+      Loads.push_back(Load);
+
+  for (SmallVectorImpl<LoadInst *>::iterator Ld = Loads.begin(),
+       LdE = Loads.end(); Ld != LdE; ++Ld) {
+    AliasAnalysis::Location Loc = AA_->getLocation(*Ld);
+    BasicBlock::iterator I = *Ld, B = BB->begin();
+    while (I != B) {
+      StoreInst *Store = dyn_cast<StoreInst>(--I);
+      if (Store && Store->getValueOperand()->getType() == (*Ld)->getType() &&
+          AA_->isMustAlias(AA_->getLocation(Store), Loc)) {
+        (*Ld)->replaceAllUsesWith(Store->getValueOperand());
+        (*Ld)->eraseFromParent();
+        ++NumForwarded;
+        break;
+      }
+      if (AA_->getModRefInfo(I, Loc) & AliasAnalysis::Mod)
+        break;
+    }
+  }
+}
+
+// Removes stores to a location that BB stores to again before anything may
+// read it.
+void StripMineIdempotentLoops::removeDeadStores(BasicBlock *BB) {
+  SmallVector<StoreInst *, 16> Stores;
+  for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+    if (StoreInst *Store = dyn_cast<StoreInst>(I))
+      Stores.push_back(Store);
+
+  for (SmallVectorImpl<StoreInst *>::iterator S = Stores.begin(),
+       SE = Stores.end(); S != SE; ++S) {
+    AliasAnalysis::Location Loc = AA_->getLocation(*S);
+    BasicBlock::iterator I = *S, E = BB->end();
+    for (++I; I != E; ++I) {
+      if (StoreInst *Later = dyn_cast<StoreInst>(I)) {
+        AliasAnalysis::Location LaterLoc = AA_->getLocation(Later);
+        if (LaterLoc.Size >= Loc.Size && AA_->isMustAlias(LaterLoc, Loc)) {
+          (*S)->eraseFromParent();
+          ++NumDeadStores;
+          break;
+        }
+      }
+      if (AA_->getModRefInfo(I, Loc) & AliasAnalysis::Ref)
+        break;
+    }
+  }
+}
+
+// Moves the loads of BB above its first store, with the address arithmetic
+// they need, unless a store in between may write what they read.
+void StripMineIdempotentLoops::hoistLoads(BasicBlock *BB) {
+  Instruction *FirstStore = NULL;
+  SmallPtrSet<Instruction *, 32> Above;
+  SmallVector<LoadInst *, 16> Loads;
+  for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+    if (!FirstStore) {
+      if (isa<StoreInst>(I))
+        FirstStore = I;
+      else
+        Above.insert(I);
+    } else if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+      Loads.push_back(Load);
+    }
+  }
+  if (!FirstStore)
+    return;
+
+  for (SmallVectorImpl<LoadInst *>::iterator Ld = Loads.begin(),
+       LdE = Loads.end(); Ld != LdE; ++Ld) {
+    AliasAnalysis::Location Loc = AA_->getLocation(*Ld);
+    bool Clobbered = false;
+    for (BasicBlock::iterator I = FirstStore; &*I != *Ld && !Clobbered; ++I)
+      Clobbered = AA_->getModRefInfo(I, Loc) & AliasAnalysis::Mod;
+
+    SmallVector<Instruction *, 8> Moves;
+    if (Clobbered || !collectHoisted(*Ld, BB, Above, Moves))
+      continue;
+    for (SmallVectorImpl<Instruction *>::iterator M = Moves.begin(),
+         ME = Moves.end(); M != ME; ++M) {
+      (*M)->moveBefore(FirstStore);
+      Above.insert(*M);
+    }
+    ++NumHoisted;
+  }
+}
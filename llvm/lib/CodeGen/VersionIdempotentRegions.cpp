@@ -0,0 +1,405 @@
+//===-------- VersionIdempotentRegions.cpp ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transformation pass removes memory antidependences in loops before
+// MemoryIdempotenceAnalysis has to cut them.  Scalars are already renamed into
+// SSA values by mem2reg; what is left are small arrays, and scalars that have
+// to stay in memory, that a loop reads and then overwrites.  Each such loop
+// gets a shadow copy of the object:
+//
+//   preheader:  copy the object into the shadow
+//   loop:       loads read the object, stores write the shadow
+//   exits:      copy the shadow back into the object
+//
+// A loop qualifies if none of its loads can read a value stored earlier in
+// the same execution of the loop.  Reads and writes then touch different
+// copies, and the cut needed on every iteration becomes one cut around the
+// copy back.  A simple cost model weighs the checkpoints saved against the
+// copies.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "version-idempotent-regions"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <algorithm>
+using namespace llvm;
+
+STATISTIC(NumVersioned, "Number of objects versioned in a loop");
+
+static cl::opt<unsigned> MaxVersionedBytes(
+    "idempotence-versioning-max-bytes", cl::Hidden,
+    cl::desc("Largest object given a shadow copy to remove antidependences"),
+    cl::init(64));
+
+// Rough Cortex-M0 cycle counts for the cost model.  A checkpoint is a call
+// that stores the live registers; copying an element is a load and a store.
+static const uint64_t CheckpointCallCost = 12;
+static const uint64_t CheckpointRegisterCost = 1;
+static const unsigned CheckpointMaxRegisters = 8;
+static const uint64_t CopyElementCost = 4;
+
+class VersionIdempotentRegions : public FunctionPass {
+public:
+  static char ID;  // Pass identification, replacement for typeid
+  VersionIdempotentRegions() : FunctionPass(ID) {
+    initializeVersionIdempotentRegionsPass(*PassRegistry::getPassRegistry());
+  }
+
+  virtual bool doInitialization(Module &M);
+  virtual bool runOnFunction(Function &F);
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequired<AliasAnalysis>();
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<BlockFrequencyInfo>();
+    AU.addRequired<DependenceAnalysis>();
+    // Not setPreservesCFG: DependenceAnalysis is registered as a CFG-only
+    // analysis and would be kept, stale and without the ScalarEvolution it
+    // holds on to.
+    AU.addPreserved<DominatorTreeWrapperPass>();
+    AU.addPreserved<LoopInfoWrapperPass>();
+  }
+
+private:
+  AliasAnalysis *AA_;
+  DominatorTree *DT_;
+  LoopInfo *LI_;
+  BlockFrequencyInfo *BFI_;
+  DependenceAnalysis *DA_;
+  const DataLayout *DL_;
+
+  // Shadows of globals, shared by every function of the module.  A versioned
+  // loop contains no call that may access its object, and any function that
+  // versions a loop over the object accesses it, so uses of one shadow never
+  // overlap.
+  DenseMap<GlobalVariable *, GlobalVariable *> GlobalShadows_;
+  DenseMap<AllocaInst *, AllocaInst *> LocalShadows_;
+
+  bool versionLoopNest(Loop *L, Value *Object);
+  bool versionLoop(Loop *L, Value *Object);
+  bool mayFlow(StoreInst *Store, LoadInst *Load, Loop *L);
+  uint64_t getCheckpointCost(Loop *L);
+  Value *getShadow(Value *Object);
+};
+
+char VersionIdempotentRegions::ID = 0;
+INITIALIZE_PASS_BEGIN(VersionIdempotentRegions,
+    "version-idempotent-regions",
+    "Idempotent Region Versioning", false, false)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfo)
+INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis)
+INITIALIZE_AG_DEPENDENCY(AliasAnalysis)
+INITIALIZE_PASS_END(VersionIdempotentRegions,
+    "version-idempotent-regions",
+    "Idempotent Region Versioning", false, false)
+
+FunctionPass *llvm::createVersionIdempotentRegionsPass() {
+  return new VersionIdempotentRegions();
+}
+
+// Returns the type of the object Object points to if it is small enough to
+// version: a scalar or an array of scalars.
+static Type *getVersionedType(Value *Object, const DataLayout *DL) {
+  Type *Ty;
+  if (AllocaInst *Alloca = dyn_cast<AllocaInst>(Object)) {
+    if (Alloca->isArrayAllocation())
+      return NULL;
+    Ty = Alloca->getAllocatedType();
+  } else if (GlobalVariable *Global = dyn_cast<GlobalVariable>(Object)) {
+    if (Global->isConstant() || Global->isThreadLocal() ||
+        Global->getType()->getAddressSpace() != 0)
+      return NULL;
+    Ty = Global->getType()->getElementType();
+  } else {
+    return NULL;
+  }
+
+  Type *ElementTy = Ty;
+  if (ArrayType *ArrayTy = dyn_cast<ArrayType>(Ty))
+    ElementTy = ArrayTy->getElementType();
+  if (!ElementTy->isSingleValueType() || ElementTy->isVectorTy())
+    return NULL;
+  if (!DL || DL->getTypeAllocSize(Ty) > MaxVersionedBytes)
+    return NULL;
+  return Ty;
+}
+
+// Returns the object Ptr points into if it is a local or global addressed
+// directly or through a single GEP, the only forms the pass rewrites.
+static Value *getObject(Value *Ptr) {
+  if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(Ptr))
+    Ptr = GEP->getPointerOperand();
+  if (isa<AllocaInst>(Ptr) || isa<GlobalVariable>(Ptr))
+    return Ptr;
+  return NULL;
+}
+
+// Copies the object at From to To, element by element so that the accesses
+// are visible to MemoryIdempotenceAnalysis.
+static void emitCopy(Value *From, Value *To, Type *Ty,
+                     Instruction *InsertBefore) {
+  IRBuilder<> Builder(InsertBefore);
+  if (ArrayType *ArrayTy = dyn_cast<ArrayType>(Ty)) {
+    for (unsigned i = 0, e = ArrayTy->getNumElements(); i != e; ++i) {
+      Value *Src = Builder.CreateConstInBoundsGEP2_32(From, 0, i);
+      Value *Dst = Builder.CreateConstInBoundsGEP2_32(To, 0, i);
+      Builder.CreateStore(Builder.CreateLoad(Src), Dst);
+    }
+  } else {
+    Builder.CreateStore(Builder.CreateLoad(From), To);
+  }
+}
+
+bool VersionIdempotentRegions::doInitialization(Module &M) {
+  GlobalShadows_.clear();
+  return false;
+}
+
+bool VersionIdempotentRegions::runOnFunction(Function &F) {
+  assert(IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
+         "pass should not be run");
+
+  // The cost model needs block frequencies, and a copy is never smaller than
+  // the cut it replaces.
+  if (IdempotenceConstructionMode != IdempotenceOptions::OptimizeForSpeed)
+    return false;
+
+  AA_ = &getAnalysis<AliasAnalysis>();
+  DT_ = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  LI_ = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  BFI_ = &getAnalysis<BlockFrequencyInfo>();
+  DA_ = &getAnalysis<DependenceAnalysis>();
+  DL_ = F.getParent()->getDataLayout();
+  LocalShadows_.clear();
+
+  // Find the objects stored to in loops.
+  SmallSetVector<Value *, 8> Objects;
+  for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB)
+    if (LI_->getLoopFor(BB))
+      for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I)
+        if (StoreInst *Store = dyn_cast<StoreInst>(I))
+          if (Value *Object = getObject(Store->getPointerOperand()))
+            if (getVersionedType(Object, DL_))
+              Objects.insert(Object);
+
+  // Version each object in the outermost loops that allow it.
+  bool Changed = false;
+  for (SmallSetVector<Value *, 8>::iterator O = Objects.begin(),
+       OE = Objects.end(); O != OE; ++O)
+    for (LoopInfo::iterator L = LI_->begin(), LE = LI_->end(); L != LE; ++L)
+      Changed |= versionLoopNest(*L, *O);
+  return Changed;
+}
+
+bool VersionIdempotentRegions::versionLoopNest(Loop *L, Value *Object) {
+  if (versionLoop(L, Object))
+    return true;
+  bool Changed = false;
+  for (Loop::iterator I = L->begin(), E = L->end(); I != E; ++I)
+    Changed |= versionLoopNest(*I, Object);
+  return Changed;
+}
+
+bool VersionIdempotentRegions::versionLoop(Loop *L, Value *Object) {
+  BasicBlock *Preheader = L->getLoopPreheader();
+  if (!Preheader || !L->hasDedicatedExits())
+    return false;
+
+  // Collect the accesses to Object.  Nothing else in the loop may touch it,
+  // and a global must be copied back on every way out of the loop.
+  AliasAnalysis::Location Whole(Object, AliasAnalysis::UnknownSize);
+  SmallVector<LoadInst *, 8> Loads;
+  SmallVector<StoreInst *, 8> Stores;
+  for (Loop::block_iterator B = L->block_begin(), BE = L->block_end();
+       B != BE; ++B)
+    for (BasicBlock::iterator I = (*B)->begin(), E = (*B)->end(); I != E;
+         ++I) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (isa<ReturnInst>(I) && isa<GlobalVariable>(Object))
+        return false;
+      if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+        if (getObject(Load->getPointerOperand()) == Object) {
+          if (!Load->isSimple())
+            return false;
+          Loads.push_back(Load);
+          continue;
+        }
+      } else if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+        if (getObject(Store->getValueOperand()) == Object)
+          return false;
+        if (getObject(Store->getPointerOperand()) == Object) {
+          if (!Store->isSimple())
+            return false;
+          Stores.push_back(Store);
+          continue;
+        }
+      }
+      if (AA_->getModRefInfo(I, Whole) != AliasAnalysis::NoModRef)
+        return false;
+    }
+  if (Loads.empty() || Stores.empty())
+    return false;
+
+  // Loads keep reading the object, so none may depend on a store in the same
+  // execution of the loop.  Only stores that overwrite something a load read
+  // need cuts now.
+  uint64_t PreheaderFreq =
+    std::max<uint64_t>(BFI_->getBlockFreq(Preheader).getFrequency(), 1);
+  uint64_t Cuts = 0;
+  for (SmallVectorImpl<StoreInst *>::iterator S = Stores.begin(),
+       SE = Stores.end(); S != SE; ++S) {
+    bool Antidependent = false;
+    for (SmallVectorImpl<LoadInst *>::iterator Ld = Loads.begin(),
+         LdE = Loads.end(); Ld != LdE; ++Ld) {
+      if (mayFlow(*S, *Ld, L))
+        return false;
+      if (!Antidependent && DA_->depends(*Ld, *S, true))
+        Antidependent = true;
+    }
+    if (Antidependent)
+      Cuts = std::max(Cuts, BFI_->getBlockFreq((*S)->getParent())
+                              .getFrequency() / PreheaderFreq);
+  }
+
+  // Versioning still needs one cut per execution of the loop, around the
+  // copy back.
+  Type *Ty = getVersionedType(Object, DL_);
+  uint64_t Elements = 1;
+  if (ArrayType *ArrayTy = dyn_cast<ArrayType>(Ty))
+    Elements = ArrayTy->getNumElements();
+  uint64_t CheckpointCost = getCheckpointCost(L);
+  uint64_t CutCost = Cuts * CheckpointCost;
+  uint64_t VersionCost = 2 * Elements * CopyElementCost + CheckpointCost;
+  DEBUG(dbgs() << "Versioning " << Object->getName() << " in loop at "
+        << L->getHeader()->getName() << ": " << Cuts << " cut(s) cost "
+        << CutCost << ", copies cost " << VersionCost << "\n");
+  if (CutCost <= VersionCost)
+    return false;
+
+  // Send the stores to the shadow, and copy around the loop.
+  Value *Shadow = getShadow(Object);
+  for (SmallVectorImpl<StoreInst *>::iterator S = Stores.begin(),
+       SE = Stores.end(); S != SE; ++S) {
+    Value *Ptr = (*S)->getPointerOperand();
+    if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(Ptr)) {
+      GetElementPtrInst *Clone = cast<GetElementPtrInst>(GEP->clone());
+      Clone->setOperand(GEP->getPointerOperandIndex(), Shadow);
+      Clone->setName(GEP->getName() + ".shadow");
+      Clone->insertBefore(*S);
+      (*S)->setOperand((*S)->getPointerOperandIndex(), Clone);
+      RecursivelyDeleteTriviallyDeadInstructions(GEP);
+    } else {
+      (*S)->setOperand((*S)->getPointerOperandIndex(), Shadow);
+    }
+  }
+
+  emitCopy(Object, Shadow, Ty, Preheader->getTerminator());
+  SmallVector<BasicBlock *, 4> Exits;
+  L->getUniqueExitBlocks(Exits);
+  for (SmallVectorImpl<BasicBlock *>::iterator E = Exits.begin(),
+       EE = Exits.end(); E != EE; ++E)
+    emitCopy(Shadow, Object, Ty, &*(*E)->getFirstInsertionPt());
+
+  ++NumVersioned;
+  return true;
+}
+
+// Returns true if Load may read what Store wrote earlier in the same
+// execution of L.  Dependence levels outside L have to allow '=', and within
+// L the first level that differs has to let Store run in an earlier
+// iteration.
+bool VersionIdempotentRegions::mayFlow(StoreInst *Store, LoadInst *Load,
+                                       Loop *L) {
+  std::unique_ptr<Dependence> D = DA_->depends(Store, Load, true);
+  if (!D)
+    return false;
+  if (D->isConfused())
+    return true;
+
+  unsigned Level = 1, Levels = D->getLevels(), Depth = L->getLoopDepth();
+  for (; Level < Depth && Level <= Levels; ++Level)
+    if (!(D->getDirection(Level) & Dependence::DVEntry::EQ))
+      return false;
+  for (; Level <= Levels; ++Level) {
+    unsigned Direction = D->getDirection(Level);
+    if (Direction & Dependence::DVEntry::LT)
+      return true;
+    if (!(Direction & Dependence::DVEntry::EQ))
+      return false;
+  }
+
+  // Same iteration of every loop: a flow unless the load always runs first.
+  return !DT_->dominates(Load, Store);
+}
+
+// Estimates the cost of a checkpoint in L from the values live through it,
+// each of which needs a register.
+uint64_t VersionIdempotentRegions::getCheckpointCost(Loop *L) {
+  SmallPtrSet<Value *, 16> Live;
+  for (BasicBlock::iterator I = L->getHeader()->begin();
+       isa<PHINode>(I); ++I)
+    Live.insert(I);
+  for (Loop::block_iterator B = L->block_begin(), BE = L->block_end();
+       B != BE && Live.size() < CheckpointMaxRegisters; ++B)
+    for (BasicBlock::iterator I = (*B)->begin(), E = (*B)->end(); I != E; ++I)
+      for (User::op_iterator O = I->op_begin(), OE = I->op_end(); O != OE;
+           ++O) {
+        Instruction *Def = dyn_cast<Instruction>(*O);
+        if ((Def && !L->contains(Def)) || isa<Argument>(*O))
+          Live.insert(*O);
+      }
+  unsigned Registers = std::min<unsigned>(Live.size(),
+                                          CheckpointMaxRegisters);
+  return CheckpointCallCost + Registers * CheckpointRegisterCost;
+}
+
+Value *VersionIdempotentRegions::getShadow(Value *Object) {
+  if (AllocaInst *Alloca = dyn_cast<AllocaInst>(Object)) {
+    AllocaInst *&Shadow = LocalShadows_[Alloca];
+    if (!Shadow) {
+      Shadow = new AllocaInst(Alloca->getAllocatedType(),
+                              Alloca->getName() + ".shadow", Alloca);
+      Shadow->setAlignment(Alloca->getAlignment());
+    }
+    return Shadow;
+  }
+
+  GlobalVariable *Global = cast<GlobalVariable>(Object);
+  GlobalVariable *&Shadow = GlobalShadows_[Global];
+  if (!Shadow) {
+    Type *Ty = Global->getType()->getElementType();
+    Shadow = new GlobalVariable(*Global->getParent(), Ty, false,
+                                GlobalValue::InternalLinkage,
+                                Constant::getNullValue(Ty),
+                                Global->getName() + ".shadow");
+    Shadow->setAlignment(Global->getAlignment());
+  }
+  return Shadow;
+}
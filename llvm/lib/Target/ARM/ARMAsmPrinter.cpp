@@ -40,6 +40,7 @@
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCInstBuilder.h"
 #include "llvm/MC/MCObjectStreamer.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCSectionMachO.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCSymbol.h"
@@ -49,6 +50,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ELF.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
@@ -108,6 +110,9 @@ bool ARMAsmPrinter::runOnMachineFunction(MachineFunction &MF) {
 
   SetupMachineFunction(MF);
 
+  const SmallVectorImpl<unsigned> &Masks = AFI->getExactCheckpointMasks();
+  ExactCheckpointMasks.insert(Masks.begin(), Masks.end());
+
   if (Subtarget->isTargetCOFF()) {
     bool Internal = MF.getFunction()->hasInternalLinkage();
     COFF::SymbolStorageClass Scl = Internal ? COFF::IMAGE_SYM_CLASS_STATIC
@@ -532,6 +537,11 @@ emitNonLazySymbolPointer(MCStreamer &OutStreamer, MCSymbol *StubLabel,
 
 
 void ARMAsmPrinter::EmitEndOfAsmFile(Module &M) {
+  for (std::set<unsigned>::iterator I = ExactCheckpointMasks.begin(),
+       E = ExactCheckpointMasks.end(); I != E; ++I)
+    emitExactCheckpoint(*I);
+  ExactCheckpointMasks.clear();
+
   if (Subtarget->isTargetMachO()) {
     // All darwin targets use mach-o.
     const TargetLoweringObjectFileMachO &TLOFMacho =
@@ -597,6 +607,177 @@ void ARMAsmPrinter::EmitEndOfAsmFile(Module &M) {
   }
 }
 
+// _checkpoint_m<mask> saves the registers in Mask like _checkpoint_<n> in
+// checkpoint.c saves r0 to r<n-1>, into the same buffer layout, but uses the
+// two lowest dead registers as scratch so that the caller need not move the
+// live ones down first:
+//   ldr   buf, =_idemStorePtr
+//   ldr   buf, [buf]
+//   stmia buf!, {r<i>-r<j>}    or str r<i>, [buf, #4*i] for each run
+//   mov   tmp, sp
+//   str   tmp, [buf, #32]
+//   mov   tmp, lr
+//   str   tmp, [buf, #36]
+//   ldr   buf, [buf, #60]
+//   ldr   tmp, =_idemStorePtr
+//   str   buf, [tmp]
+//   bx    lr
+// The offsets are relative to the start of the buffer.  Every module that
+// calls a routine emits it in its own COMDAT group, so one copy is linked.
+void ARMAsmPrinter::emitExactCheckpoint(unsigned Mask) {
+  SmallString<32> Name;
+  raw_svector_ostream(Name) << "_checkpoint_m" << format("%02x", Mask);
+  MCSymbol *Sym = OutContext.GetOrCreateSymbol(Name.str());
+  MCSymbol *PtrLabel = OutContext.CreateTempSymbol();
+  const MCExpr *PtrRef = MCSymbolRefExpr::Create(PtrLabel, OutContext);
+
+  unsigned Scratch[2], NumScratch = 0;
+  for (unsigned i = 0; i != 8 && NumScratch != 2; ++i)
+    if (!(Mask & (1 << i)))
+      Scratch[NumScratch++] = ARM::R0 + i;
+  assert(NumScratch == 2 && "Exact checkpoint needs two dead registers!");
+  unsigned BufReg = Scratch[0], TmpReg = Scratch[1];
+
+  if (Subtarget->isTargetELF())
+    OutStreamer.SwitchSection(OutContext.getELFSection(
+        (".text." + Name).str(), ELF::SHT_PROGBITS,
+        ELF::SHF_ALLOC | ELF::SHF_EXECINSTR | ELF::SHF_GROUP, 0, Name.str()));
+  else
+    OutStreamer.SwitchSection(getObjFileLowering().getTextSection());
+  OutStreamer.EmitAssemblerFlag(MCAF_Code16);
+  EmitAlignment(1);
+  OutStreamer.EmitSymbolAttribute(Sym, MCSA_Weak);
+  if (MAI->hasDotTypeDotSizeDirective())
+    OutStreamer.EmitSymbolAttribute(Sym, MCSA_ELF_TypeFunction);
+  OutStreamer.EmitThumbFunc(Sym);
+  OutStreamer.EmitLabel(Sym);
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRpci)
+    .addReg(BufReg)
+    .addExpr(PtrRef)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRi)
+    .addReg(BufReg)
+    .addReg(BufReg)
+    .addImm(0)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  // Store each run of live registers.  Advanced is the number of words the
+  // stmias have moved the buffer pointer.  The immediates of tADDi8 are in
+  // bytes, those of tSTRi and tLDRi in words.
+  unsigned Advanced = 0;
+  for (unsigned Lo = 0; Lo != 8; ++Lo) {
+    if (!(Mask & (1 << Lo)))
+      continue;
+    unsigned Hi = Lo;
+    while (Hi != 7 && (Mask & (1 << (Hi + 1))))
+      ++Hi;
+
+    if (Lo == Hi) {
+      EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+        .addReg(ARM::R0 + Lo)
+        .addReg(BufReg)
+        .addImm(Lo - Advanced)
+        // Predicate.
+        .addImm(ARMCC::AL)
+        .addReg(0));
+    } else {
+      if (Lo != Advanced)
+        EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tADDi8)
+          .addReg(BufReg)
+          // 's' bit operand
+          .addReg(ARM::CPSR)
+          .addReg(BufReg)
+          .addImm(4 * (Lo - Advanced))
+          // Predicate.
+          .addImm(ARMCC::AL)
+          .addReg(0));
+      MCInst STM;
+      STM.setOpcode(ARM::tSTMIA_UPD);
+      STM.addOperand(MCOperand::CreateReg(BufReg));
+      STM.addOperand(MCOperand::CreateReg(BufReg));
+      // Predicate.
+      STM.addOperand(MCOperand::CreateImm(ARMCC::AL));
+      STM.addOperand(MCOperand::CreateReg(0));
+      for (unsigned i = Lo; i <= Hi; ++i)
+        STM.addOperand(MCOperand::CreateReg(ARM::R0 + i));
+      EmitToStreamer(OutStreamer, STM);
+      Advanced = Hi + 1;
+    }
+    Lo = Hi;
+  }
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tMOVr)
+    .addReg(TmpReg)
+    .addReg(ARM::SP)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+    .addReg(TmpReg)
+    .addReg(BufReg)
+    .addImm(8 - Advanced)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tMOVr)
+    .addReg(TmpReg)
+    .addReg(ARM::LR)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+    .addReg(TmpReg)
+    .addReg(BufReg)
+    .addImm(9 - Advanced)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRi)
+    .addReg(BufReg)
+    .addReg(BufReg)
+    .addImm(15 - Advanced)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRpci)
+    .addReg(TmpReg)
+    .addExpr(PtrRef)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+    .addReg(BufReg)
+    .addReg(TmpReg)
+    .addImm(0)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tBX)
+    .addReg(ARM::LR)
+    // Predicate.
+    .addImm(ARMCC::AL)
+    .addReg(0));
+
+  EmitAlignment(2);
+  OutStreamer.EmitLabel(PtrLabel);
+  OutStreamer.EmitValue(MCSymbolRefExpr::Create(
+      OutContext.GetOrCreateSymbol(StringRef("_idemStorePtr")), OutContext),
+      4);
+}
+
 //===----------------------------------------------------------------------===//
 // Helper routines for EmitStartOfAsmFile() and EmitEndOfAsmFile()
 // FIXME:
@@ -1775,6 +1956,120 @@ void ARMAsmPrinter::EmitInstruction(const MachineInstr *MI) {
     return;
   }
 
+  case ARM::tCHECKPOINT: {
+    // Outputs: $buf, $tmp; inputs: $ptr, $nlive, $lo
+    // ldr   $buf, [$ptr]
+    // adds  $buf, #4*lo                (if 0 < lo < nlive)
+    // stmia $buf!, {r<lo>-r<nlive-1>}  (if lo < nlive)
+    // mov   $tmp, sp
+    // str   $tmp, [$buf, #32]
+    // mov   $tmp, pc
+    // adds  $tmp, #6
+    // str   $tmp, [$buf, #36]
+    // ldr   $buf, [$buf, #60]
+    // str   $buf, [$ptr]
+    // The offsets are relative to the start of the buffer.  Restoring the
+    // checkpoint resumes after the last store.
+    unsigned BufReg = MI->getOperand(0).getReg();
+    unsigned TmpReg = MI->getOperand(1).getReg();
+    unsigned PtrReg = MI->getOperand(2).getReg();
+    unsigned NumLive = MI->getOperand(3).getImm();
+    unsigned Lo = MI->getOperand(4).getImm();
+    unsigned Advanced = Lo < NumLive ? NumLive : 0;
+
+    OutStreamer.AddComment("checkpoint begin");
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRi)
+      .addReg(BufReg)
+      .addReg(PtrReg)
+      .addImm(0)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    if (Lo > 0 && Lo < NumLive)
+      EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tADDi8)
+        .addReg(BufReg)
+        // 's' bit operand
+        .addReg(ARM::CPSR)
+        .addReg(BufReg)
+        .addImm(4 * Lo)
+        // Predicate.
+        .addImm(ARMCC::AL)
+        .addReg(0));
+
+    if (Lo < NumLive) {
+      MCInst STM;
+      STM.setOpcode(ARM::tSTMIA_UPD);
+      STM.addOperand(MCOperand::CreateReg(BufReg));
+      STM.addOperand(MCOperand::CreateReg(BufReg));
+      // Predicate.
+      STM.addOperand(MCOperand::CreateImm(ARMCC::AL));
+      STM.addOperand(MCOperand::CreateReg(0));
+      for (unsigned i = Lo; i != NumLive; ++i)
+        STM.addOperand(MCOperand::CreateReg(ARM::R0 + i));
+      EmitToStreamer(OutStreamer, STM);
+    }
+
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tMOVr)
+      .addReg(TmpReg)
+      .addReg(ARM::SP)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    // The offset immediates are scaled by 4 for tSTRi and tLDRi.
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+      .addReg(TmpReg)
+      .addReg(BufReg)
+      .addImm(8 - Advanced)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tMOVr)
+      .addReg(TmpReg)
+      .addReg(ARM::PC)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tADDi3)
+      .addReg(TmpReg)
+      // 's' bit operand
+      .addReg(ARM::CPSR)
+      .addReg(TmpReg)
+      .addImm(6)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+      .addReg(TmpReg)
+      .addReg(BufReg)
+      .addImm(9 - Advanced)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tLDRi)
+      .addReg(BufReg)
+      .addReg(BufReg)
+      .addImm(15 - Advanced)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+
+    OutStreamer.AddComment("checkpoint end");
+    EmitToStreamer(OutStreamer, MCInstBuilder(ARM::tSTRi)
+      .addReg(BufReg)
+      .addReg(PtrReg)
+      .addImm(0)
+      // Predicate.
+      .addImm(ARMCC::AL)
+      .addReg(0));
+    return;
+  }
+
   case ARM::Int_eh_sjlj_setjmp_nofp:
   case ARM::Int_eh_sjlj_setjmp: {
     // Two incoming args: GPR:$src, GPR:$val
@@ -13,6 +13,7 @@
 #include "ARMSubtarget.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/Target/TargetMachine.h"
+#include <set>
 
 namespace llvm {
 
@@ -51,6 +52,10 @@ class LLVM_LIBRARY_VISIBILITY ARMAsmPrinter : public AsmPrinter {
   /// labels used for ARMv4t thumb code to make register indirect calls.
   SmallVector<std::pair<unsigned, MCSymbol*>, 4> ThumbIndirectPads;
 
+  /// ExactCheckpointMasks - Live register masks of the exact checkpoint
+  /// routines called in this module, emitted at its end.
+  std::set<unsigned> ExactCheckpointMasks;
+
 public:
   explicit ARMAsmPrinter(TargetMachine &TM,
                          std::unique_ptr<MCStreamer> Streamer);
@@ -93,6 +98,9 @@ private:
   // Helpers for EmitStartOfAsmFile() and EmitEndOfAsmFile()
   void emitAttributes();
 
+  // Emit the exact checkpoint routine for the live registers in Mask.
+  void emitExactCheckpoint(unsigned Mask);
+
   // Generic helper used to emit e.g. ARMv5 mul pseudos
   void EmitPatchedInstruction(const MachineInstr *MI, unsigned TargetOpc);
 
@@ -21,7 +21,9 @@
 #include "MCTargetDesc/ARMAddressingModes.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/CodeGen/LiveVariables.h"
+#include "llvm/CodeGen/IdempotenceLiveness.h"
 #include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineConstantPool.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
@@ -38,6 +40,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 
 using namespace llvm;
 
@@ -595,6 +598,15 @@ template <> bool IsCPSRDead<MachineInstr>(MachineInstr *MI) {
 }
 }
 
+// Returns the size of a tCHECKPOINT saving r<Lo> to r<NumLive-1>; see its
+// expansion in ARMAsmPrinter.
+static unsigned getInlineCheckpointSize(unsigned NumLive, unsigned Lo) {
+  unsigned Instrs = 8;
+  if (Lo < NumLive)
+    Instrs += Lo > 0 ? 2 : 1;
+  return 2 * Instrs;
+}
+
 /// GetInstSize - Return the size of the specified MachineInstr.
 ///
 unsigned ARMBaseInstrInfo::GetInstSizeInBytes(const MachineInstr *MI) const {
@@ -639,6 +651,9 @@ unsigned ARMBaseInstrInfo::GetInstSizeInBytes(const MachineInstr *MI) const {
   case ARM::t2Int_eh_sjlj_setjmp:
   case ARM::t2Int_eh_sjlj_setjmp_nofp:
     return 12;
+  case ARM::tCHECKPOINT:
+    return getInlineCheckpointSize(MI->getOperand(3).getImm(),
+                                   MI->getOperand(4).getImm());
   case ARM::BR_JTr:
   case ARM::BR_JTm:
   case ARM::BR_JTadd:
@@ -733,97 +748,160 @@ void ARMBaseInstrInfo::emitIdemBoundary(MachineBasicBlock &MBB,
 //  
 //}
 
-void fixIdemCondCodes(MachineBasicBlock &MBB, MachineBasicBlock::iterator I)
+// Checkpoints clobber CPSR.  If it is live at the boundary I, move I above
+// the instruction that sets it, and update Live to the registers live there.
+void fixIdemCondCodes(MachineBasicBlock &MBB, MachineBasicBlock::iterator I,
+                      LivePhysRegs &Live)
 {
-  const TargetRegisterInfo *TRI = MBB.getParent()->getSubtarget().getRegisterInfo();
-  if (MBB.computeRegisterLiveness(TRI, ARM::CPSR, I, 10) != MachineBasicBlock::LivenessQueryResult::LQR_Dead)
+  if (!Live.contains(ARM::CPSR))
+    return;
+
+  DEBUG(dbgs() << "JVDW: Bad: " << *I << MBB);
+
+  // Can we move the instruction that defined CPSR closer?
+  MachineBasicBlock::iterator DefCPSR;
+  for (DefCPSR = std::prev(I); DefCPSR != MBB.begin(); DefCPSR--)
   {
-    typedef std::pair<MachineBasicBlock *, MachineBasicBlock::iterator> WorkItem;
-    SmallVector<WorkItem, 8> Worklist;
-    MachineBasicBlock *SearchBB;
-    MachineBasicBlock::iterator Search;
-    MachineBasicBlock::iterator DefCPSR = std::prev(I);
-    bool HasUse = false;
-    bool ReachedTop = false;
-    bool ReachedBot = false;
-
-    // First determine if there is a use of CPSR after the Checkpoint
-    Worklist.push_back(WorkItem(&MBB, std::next(I)));
-    while(!Worklist.empty())
-    {
-      bool HasDef = false;
-      WorkItem NextSearch = Worklist.pop_back_val();
+    DEBUG(dbgs() << "\tJVDW: " << *DefCPSR);
+    if( DefCPSR->definesRegister(ARM::CPSR))
+      break;
+  }
+
+  if (!DefCPSR->definesRegister(ARM::CPSR))
+    assert(false && "JVDW: Instruction that defines CPSR not found in this basic block!");
 
-      tie(SearchBB, Search) = NextSearch;
-      for (; Search != SearchBB->end(); Search++)
+  // Check to make sure that no instructions kill any of DefCPSR's uses
+  for (MachineBasicBlock::iterator MI = std::next(DefCPSR); MI != I; MI++)
+    for (MachineInstr::mop_iterator MOP = DefCPSR->operands_begin(); MOP != DefCPSR->operands_end(); MOP++)
+    {
+      if(MOP->isReg())
       {
-        if (Search->definesRegister(ARM::CPSR))
+        if(MI->killsRegister(ARM::CPSR))
         {
-          HasDef = true;
-          break;
-        }
-        else if (Search->readsRegister(ARM::CPSR))
-        {
-          // We've gotta handle this!
-          HasUse = true;
-          break;
+          assert(false && "JVDW: Register killed before checkpoint, cannot relocate!");
         }
       }
-
-      if(HasDef)
-        continue;
-      if(HasUse)
-        break;
-
-      // Otherwise, add stuff to the worklist
-      for(MachineBasicBlock::succ_iterator SI = SearchBB->succ_begin(); SI != SearchBB->succ_end(); SI++)
-        Worklist.push_back(WorkItem(*SI, (*SI)->begin()));
     }
 
-    // If there is no use of CPSR, just jump to the exit!
-    if(!HasUse)
-    {
-      goto exit;
-    }
+  for (MachineBasicBlock::iterator MI = std::prev(I); ; MI--)
+  {
+    if (!MI->isDebugValue())
+      Live.stepBackward(*MI);
+    if (MI == DefCPSR)
+      break;
+  }
 
-    DEBUG(dbgs() << "JVDW: Bad: " << *I << MBB);
+  MBB.remove_instr(I);
+  MBB.insert((MachineBasicBlock::iterator) DefCPSR, (MachineInstr*) I);
+}
 
-    // If there is a use, can we move the instruction that defined CPSR closer?
-    for (DefCPSR = std::prev(I); DefCPSR != MBB.begin(); DefCPSR--)
-    {
-      DEBUG(dbgs() << "\tJVDW: " << *DefCPSR);
-      if( DefCPSR->definesRegister(ARM::CPSR))
-        break;
-    }
+// The checkpoint routines in checkpoint.c, by number of live registers N and
+// lowest register stored Lo.  _checkpoint_<N> stores r0 to r<N-1>, and the
+// differential _checkpoint_<Lo>_<N> only r<Lo> to r<N-1>.  r7 is always
+// stored when live.
+static const char *const CheckpointNames[9][9] = {
+  { "_checkpoint_0" },
+  { "_checkpoint_1", "_checkpoint_1_1" },
+  { "_checkpoint_2", "_checkpoint_1_2", "_checkpoint_2_2" },
+  { "_checkpoint_3", "_checkpoint_1_3", "_checkpoint_2_3", "_checkpoint_3_3" },
+  { "_checkpoint_4", "_checkpoint_1_4", "_checkpoint_2_4", "_checkpoint_3_4",
+    "_checkpoint_4_4" },
+  { "_checkpoint_5", "_checkpoint_1_5", "_checkpoint_2_5", "_checkpoint_3_5",
+    "_checkpoint_4_5", "_checkpoint_5_5" },
+  { "_checkpoint_6", "_checkpoint_1_6", "_checkpoint_2_6", "_checkpoint_3_6",
+    "_checkpoint_4_6", "_checkpoint_5_6", "_checkpoint_6_6" },
+  { "_checkpoint_7", "_checkpoint_1_7", "_checkpoint_2_7", "_checkpoint_3_7",
+    "_checkpoint_4_7", "_checkpoint_5_7", "_checkpoint_6_7",
+    "_checkpoint_7_7" },
+  { "_checkpoint_8", "_checkpoint_1_8", "_checkpoint_2_8", "_checkpoint_3_8",
+    "_checkpoint_4_8", "_checkpoint_5_8", "_checkpoint_6_8",
+    "_checkpoint_7_8" }
+};
 
-    if (!DefCPSR->definesRegister(ARM::CPSR))
-      assert(false && "JVDW: Instruction that defines CPSR not found in this basic block!");
+// The exact checkpoint routines, by live register mask: bit i stands for
+// r<i>.  ARMAsmPrinter emits the ones a module calls.
+#define EXACT_CHECKPOINT_NAMES(h) \
+  "_checkpoint_m" #h "0", "_checkpoint_m" #h "1", "_checkpoint_m" #h "2", \
+  "_checkpoint_m" #h "3", "_checkpoint_m" #h "4", "_checkpoint_m" #h "5", \
+  "_checkpoint_m" #h "6", "_checkpoint_m" #h "7", "_checkpoint_m" #h "8", \
+  "_checkpoint_m" #h "9", "_checkpoint_m" #h "a", "_checkpoint_m" #h "b", \
+  "_checkpoint_m" #h "c", "_checkpoint_m" #h "d", "_checkpoint_m" #h "e", \
+  "_checkpoint_m" #h "f"
+static const char *const ExactCheckpointNames[256] = {
+  EXACT_CHECKPOINT_NAMES(0), EXACT_CHECKPOINT_NAMES(1),
+  EXACT_CHECKPOINT_NAMES(2), EXACT_CHECKPOINT_NAMES(3),
+  EXACT_CHECKPOINT_NAMES(4), EXACT_CHECKPOINT_NAMES(5),
+  EXACT_CHECKPOINT_NAMES(6), EXACT_CHECKPOINT_NAMES(7),
+  EXACT_CHECKPOINT_NAMES(8), EXACT_CHECKPOINT_NAMES(9),
+  EXACT_CHECKPOINT_NAMES(a), EXACT_CHECKPOINT_NAMES(b),
+  EXACT_CHECKPOINT_NAMES(c), EXACT_CHECKPOINT_NAMES(d),
+  EXACT_CHECKPOINT_NAMES(e), EXACT_CHECKPOINT_NAMES(f)
+};
+#undef EXACT_CHECKPOINT_NAMES
 
-    // Check to make sure that no instructions kill any of DefCPSR's uses
-    for (MachineBasicBlock::iterator MI = std::next(DefCPSR); MI != I; MI++)
-      for (MachineInstr::mop_iterator MOP = DefCPSR->operands_begin(); MOP != DefCPSR->operands_end(); MOP++)
-      {
-        if(MOP->isReg())
-        {
-          if(MI->killsRegister(ARM::CPSR))
-          {
-            assert(false && "JVDW: Register killed before checkpoint, cannot relocate!");
-          }
-        }
-      }
+// The exact routines use two dead low registers as scratch.
+static const unsigned MaxExactCheckpointLiveRegs = 6;
 
-    MBB.remove_instr(I);
-    MBB.insert((MachineBasicBlock::iterator) DefCPSR, (MachineInstr*) I);
+// Returns true if MI calls an exact checkpoint routine.
+static bool isExactCheckpoint(const MachineInstr *MI) {
+  if (MI->getOpcode() != ARM::tBL)
+    return false;
+  for (unsigned i = 0, e = MI->getNumOperands(); i != e; ++i) {
+    const MachineOperand &MO = MI->getOperand(i);
+    if (MO.isSymbol() &&
+        !strncmp(MO.getSymbolName(), "_checkpoint_m", 13))
+      return true;
+  }
+  return false;
+}
 
-exit:
-    //assert(false && "JVDW: Found CC mangle.");
-    return;
+// Returns the number of live registers of the full checkpoint MI calls or
+// expands to, or -1 if MI is not such a checkpoint.
+static int getCheckpointLiveRegs(const MachineInstr *MI) {
+  if (MI->getOpcode() == ARM::tCHECKPOINT)
+    return MI->getOperand(4).getImm() == 0 ? MI->getOperand(3).getImm() : -1;
+  if (MI->getOpcode() != ARM::tBL)
+    return -1;
+  for (unsigned i = 0, e = MI->getNumOperands(); i != e; ++i) {
+    const MachineOperand &MO = MI->getOperand(i);
+    if (!MO.isSymbol())
+      continue;
+    for (int N = 0; N <= 8; ++N)
+      if (!strcmp(MO.getSymbolName(), CheckpointNames[N][0]))
+        return N;
   }
+  return -1;
 }
 
-void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
-                                      MachineBasicBlock::iterator I) const {
-  fixIdemCondCodes(MBB, I);
+// Inline checkpoints need three dead registers above the live ones.
+static const unsigned MaxInlineCheckpointLiveRegs = 5;
+
+// Expands a checkpoint of the NumLive lowest registers inline before I.
+static void emitInlineCheckpoint(MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator I,
+                                 unsigned NumLive, const TargetInstrInfo &TII) {
+  MachineFunction &MF = *MBB.getParent();
+  MachineConstantPool *ConstantPool = MF.getConstantPool();
+  ARMConstantPoolValue *CPV = ARMConstantPoolSymbol::Create(
+      MF.getFunction()->getContext(), "_idemStorePtr", 0, 0);
+  unsigned Idx = ConstantPool->getConstantPoolIndex(CPV, 4);
+
+  AddDefaultPred(BuildMI(MBB, I, DebugLoc(), TII.get(ARM::tLDRpci), ARM::R5)
+    .addConstantPoolIndex(Idx));
+  MachineInstrBuilder MIB =
+    BuildMI(MBB, I, DebugLoc(), TII.get(ARM::tCHECKPOINT), ARM::R7)
+      .addReg(ARM::R6, RegState::Define)
+      .addReg(ARM::R5, RegState::Kill)
+      .addImm(NumLive).addImm(0);
+  for (unsigned i = 0; i != NumLive; ++i)
+    MIB.addReg(ARM::R0 + i, RegState::Implicit);
+}
+
+unsigned ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
+                                          MachineBasicBlock::iterator I,
+                                          LivePhysRegs &Live,
+                                          unsigned *InlineBudget) const {
+  fixIdemCondCodes(MBB, I, Live);
 
   for(int i = 4; i < 8; i++)
     MBB.getParent()->getRegInfo().setPhysRegUsed(ARM::R0+i);
@@ -832,9 +910,8 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
   
   if(IdempotenceConstructionMode == IdempotenceOptions::OptimizeForSpeed)
   {
-    // Compute liveness information
+    // Liveness information
     MachineBasicBlock::LivenessQueryResult Regs[8];
-    const TargetRegisterInfo *TRI = MBB.getParent()->getSubtarget().getRegisterInfo();
     int i;
 
     DEBUG(dbgs() << "JVDW: idem: " << *I << MBB);
@@ -855,10 +932,17 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
       //    break;
       //  }
       //}
-      Regs[i] = MBB.computeRegisterLiveness(TRI, ARM::R0+i, I, 1000);
+      Regs[i] = Live.contains(ARM::R0+i) ?
+        MachineBasicBlock::LivenessQueryResult::LQR_Live :
+        MachineBasicBlock::LivenessQueryResult::LQR_Dead;
     }
 
 
+    unsigned LiveMask = 0;
+    for (i = 0; i < 8; i++)
+      if (Regs[i] != MachineBasicBlock::LivenessQueryResult::LQR_Dead)
+        LiveMask |= 1 << i;
+
     DEBUG(dbgs() << "JVDW: L");
     for(i = 0; i < 8; i++)
       if(Regs[i] == MachineBasicBlock::LivenessQueryResult::LQR_Dead)
@@ -867,6 +951,33 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
         DEBUG(dbgs() << "1");
     DEBUG(dbgs() << "\n");
 
+    // Rather than moving the live registers down, call the routine for
+    // exactly the live ones, which uses the dead ones in between as scratch.
+    // Sites that may be inlined still move them down.
+    unsigned NumLive = CountPopulation_32(LiveMask);
+    bool MayInline = InlineBudget && NumLive <= MaxInlineCheckpointLiveRegs &&
+      *InlineBudget >= 2 + getInlineCheckpointSize(NumLive, 0);
+    bool Packed = (LiveMask & (LiveMask + 1)) == 0;
+    if (!MayInline && !Packed && IdempotenceExactCheckpoints &&
+        NumLive <= MaxExactCheckpointLiveRegs) {
+      // The routine clobbers the two lowest dead registers and the flags
+      // (see ARMAsmPrinter::emitExactCheckpoint).  Later passes must not
+      // assume a copy in a scratch register survives the call.
+      MachineInstrBuilder MIB = BuildMI(MBB, I, DebugLoc(), get(ARM::tBL))
+        .addImm((unsigned)ARMCC::AL).addReg(0)
+        .addExternalSymbol(ExactCheckpointNames[LiveMask]);
+      unsigned NumScratch = 0;
+      for (i = 0; i < 8; i++)
+        if (LiveMask & (1 << i))
+          MIB.addReg(ARM::R0 + i, RegState::Implicit);
+        else if (NumScratch++ < 2)
+          MIB.addReg(ARM::R0 + i, RegState::ImplicitDefine | RegState::Dead);
+      MIB.addReg(ARM::CPSR, RegState::ImplicitDefine | RegState::Dead);
+      MBB.getParent()->getInfo<ARMFunctionInfo>()
+        ->addExactCheckpointMask(LiveMask);
+      return NumLive;
+    }
+
     //SmallVector<unsigned, 8> DeadReg;
     //for(i = 0; i < 8; i++)
     //  if(Regs[i] == MachineBasicBlock::LivenessQueryResult::LQR_Dead)
@@ -932,9 +1043,6 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
         break;
       }
 
-    const char fnName[][14] = {"_checkpoint_0","_checkpoint_1","_checkpoint_2","_checkpoint_3","_checkpoint_4",
-                              "_checkpoint_5","_checkpoint_6","_checkpoint_7","_checkpoint_8"};
-
     //// Scan backwards for the call placeholder
     //MachineInstr *DummyCall;
     //for (MachineBasicBlock::iterator MI = I; MI != MBB.begin(); MI--)
@@ -956,22 +1064,29 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
     for (i = 0; i < SwapPairs.size(); i++)
       AddDefaultPred(BuildMI(MBB, I, DebugLoc(), get(ARM::tMOVr)).addReg(SwapPairs[i].first, RegState::Define).addReg(SwapPairs[i].second));
 
-    BuildMI(MBB, I, DebugLoc(), get(ARM::tBL))
-      .addImm((unsigned)ARMCC::AL).addReg(0)
-      .addExternalSymbol(fnName[HighestLive]);
+    // Inlining replaces a 4 byte call with a literal load, the literal and
+    // the expansion.
+    unsigned InlineSize = 2 + 4 + getInlineCheckpointSize(HighestLive, 0) - 4;
+    if (InlineBudget && HighestLive <= (int)MaxInlineCheckpointLiveRegs &&
+        *InlineBudget >= InlineSize) {
+      emitInlineCheckpoint(MBB, I, HighestLive, *this);
+      *InlineBudget -= InlineSize;
+    } else {
+      BuildMI(MBB, I, DebugLoc(), get(ARM::tBL))
+        .addImm((unsigned)ARMCC::AL).addReg(0)
+        .addExternalSymbol(CheckpointNames[HighestLive][0]);
+    }
 
     for (i = 0; i < SwapPairs.size(); i++)
       AddDefaultPred(BuildMI(MBB, I, DebugLoc(), get(ARM::tMOVr)).addReg(SwapPairs[i].second, RegState::Define).addReg(SwapPairs[i].first));
 
-
-
-    
+    return HighestLive;
   }else{
 
     BuildMI(MBB, I, DebugLoc(), get(ARM::tBL))
       .addImm((unsigned)ARMCC::AL).addReg(0)
-      .addExternalSymbol("_checkpoint_8");
-    //  .addExternalSymbol(fnName[HighestLive]);
+      .addExternalSymbol(CheckpointNames[8][0]);
+    return 8;
   }
 
   //for (i = 0; i < SwapPairs.size(); i++)
@@ -979,6 +1094,181 @@ void ARMBaseInstrInfo::emitCheckpoint(MachineBasicBlock &MBB,
 
 }
 
+// The checkpoints alternate between two buffers, so the buffer a checkpoint
+// writes was last written by the checkpoint before the previous one, or by a
+// later interrupt checkpoint, which saves every register.  A live register
+// that still holds the value it had then is still correct in that buffer and
+// need not be stored again.  For each point and register r<i>, track the
+// registers whose value at the last checkpoint r<i> may no longer hold
+// (Since1[i]) and the same for the checkpoint before it (Since2[i]).  Bit j
+// stands for r<j>.  Copies carry these along, so the moves that bring the
+// live registers down around each checkpoint do not count as changes.
+// Function entry and calls, which may checkpoint any number of times, reset
+// both to every register.
+static const unsigned AllLowRegs = 0xFF;
+
+namespace {
+  struct CheckpointDelta {
+    unsigned Since1[8], Since2[8];
+    explicit CheckpointDelta(unsigned S = 0) {
+      for (unsigned i = 0; i != 8; ++i)
+        Since1[i] = Since2[i] = S;
+    }
+    bool merge(const CheckpointDelta &Other) {
+      bool Changed = false;
+      for (unsigned i = 0; i != 8; ++i) {
+        unsigned S1 = Since1[i] | Other.Since1[i];
+        unsigned S2 = Since2[i] | Other.Since2[i];
+        Changed |= S1 != Since1[i] || S2 != Since2[i];
+        Since1[i] = S1;
+        Since2[i] = S2;
+      }
+      return Changed;
+    }
+    // Starts a new checkpoint interval.
+    void checkpoint() {
+      for (unsigned i = 0; i != 8; ++i) {
+        Since2[i] = Since1[i];
+        Since1[i] = AllLowRegs & ~(1u << i);
+      }
+    }
+    // Returns true if r<i> may differ from what the buffer holds for it.
+    bool changed(unsigned i) const { return Since2[i] & (1 << i); }
+  };
+}
+
+// Returns the low register MI copies to Dst from, or 0 if it is not a copy
+// between low registers.
+static unsigned getLowCopySource(const MachineInstr *MI, unsigned Dst) {
+  if (MI->getOpcode() != ARM::tMOVr || MI->getOperand(0).getReg() != Dst)
+    return 0;
+  unsigned Src = MI->getOperand(1).getReg();
+  return Src >= ARM::R0 && Src <= ARM::R7 ? Src : 0;
+}
+
+// Applies MBB to Delta.  If Rewrite is set, also replaces each checkpoint
+// with the variant that skips the registers unchanged since the checkpoint
+// before the previous one, and adds the number of registers skipped to
+// Skipped.  LiveAfter holds the low registers live after each checkpoint.
+static void transferCheckpointDelta(MachineBasicBlock &MBB,
+                                    CheckpointDelta &Delta, bool Rewrite,
+                                    const TargetInstrInfo *TII,
+                                    const DenseMap<MachineInstr *, unsigned>
+                                      &LiveAfter,
+                                    unsigned &Skipped) {
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E;
+       ++I) {
+    int N = getCheckpointLiveRegs(I);
+    if (N >= 0) {
+      // Store from the lowest live register that may have changed.  r7 is
+      // saved through r12 and always stored.
+      int Lo = 0;
+      if (Rewrite) {
+        int Max = N == 8 ? 7 : N;
+        unsigned Live = LiveAfter.lookup(I);
+        for (Lo = 0; Lo < Max; ++Lo)
+          if ((Live & (1 << Lo)) && Delta.changed(Lo))
+            break;
+      }
+      if (Lo > 0) {
+        DEBUG(dbgs() << "Differential checkpoint skips " << Lo
+              << " register(s): " << *I);
+        if (I->getOpcode() == ARM::tCHECKPOINT) {
+          I->getOperand(4).setImm(Lo);
+        } else {
+          MachineInstr *Call =
+            BuildMI(MBB, I, I->getDebugLoc(), TII->get(ARM::tBL))
+              .addImm((unsigned)ARMCC::AL).addReg(0)
+              .addExternalSymbol(CheckpointNames[N][Lo]);
+          I->eraseFromParent();
+          I = Call;
+        }
+        Skipped += Lo;
+      }
+      Delta.checkpoint();
+      continue;
+    }
+
+    // Exact checkpoints store every live register and are not rewritten.
+    if (isExactCheckpoint(I)) {
+      Delta.checkpoint();
+      continue;
+    }
+
+    if (I->isCall()) {
+      Delta = CheckpointDelta(AllLowRegs);
+      continue;
+    }
+
+    for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i) {
+      const MachineOperand &MO = I->getOperand(i);
+      if (MO.isRegMask()) {
+        Delta = CheckpointDelta(AllLowRegs);
+      } else if (MO.isReg() && MO.isDef() && MO.getReg() >= ARM::R0 &&
+                 MO.getReg() <= ARM::R7) {
+        unsigned Dst = MO.getReg() - ARM::R0;
+        if (unsigned Src = getLowCopySource(I, MO.getReg())) {
+          Delta.Since1[Dst] = Delta.Since1[Src - ARM::R0];
+          Delta.Since2[Dst] = Delta.Since2[Src - ARM::R0];
+        } else {
+          Delta.Since1[Dst] = Delta.Since2[Dst] = AllLowRegs;
+        }
+      }
+    }
+  }
+}
+
+unsigned
+ARMBaseInstrInfo::selectDifferentialCheckpoints(MachineFunction &MF) const {
+  const TargetRegisterInfo *TRI = MF.getSubtarget().getRegisterInfo();
+
+  // Find the low registers live after each checkpoint.  Those an inline
+  // checkpoint reads itself need not be.
+  IdempotenceLiveness Liveness;
+  Liveness.compute(MF);
+  LivePhysRegs Live(TRI);
+  DenseMap<MachineInstr *, unsigned> LiveAfter;
+  for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B) {
+    Live.clear();
+    Liveness.addLiveOuts(*B, Live);
+    for (MachineBasicBlock::reverse_iterator I = B->rbegin(), E = B->rend();
+         I != E; ++I) {
+      if (getCheckpointLiveRegs(&*I) >= 0) {
+        unsigned &Mask = LiveAfter[&*I];
+        for (unsigned i = 0; i != 8; ++i)
+          if (Live.contains(ARM::R0 + i))
+            Mask |= 1 << i;
+      }
+      if (!I->isDebugValue())
+        Live.stepBackward(*I);
+    }
+  }
+
+  DenseMap<MachineBasicBlock *, CheckpointDelta> In;
+  In[MF.begin()] = CheckpointDelta(AllLowRegs);
+
+  // The masks only grow, so iterating to a fixed point terminates.
+  unsigned Skipped = 0;
+  bool Changed;
+  do {
+    Changed = false;
+    for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE;
+         ++B) {
+      CheckpointDelta Delta = In[B];
+      transferCheckpointDelta(*B, Delta, false, this, LiveAfter, Skipped);
+      for (MachineBasicBlock::succ_iterator S = B->succ_begin(),
+           SE = B->succ_end(); S != SE; ++S)
+        Changed |= In[*S].merge(Delta);
+    }
+  } while (Changed);
+
+  for (MachineFunction::iterator B = MF.begin(), BE = MF.end(); B != BE; ++B) {
+    CheckpointDelta Delta = In[B];
+    transferCheckpointDelta(*B, Delta, true, this, LiveAfter, Skipped);
+  }
+  return Skipped;
+}
+
 void ARMBaseInstrInfo::replaceWithIdemPop(MachineFunction &MF) const {
   for(MachineFunction::iterator MBB = MF.begin(), MBBE = MF.end(); MBB != MBBE; MBB++)
     for(MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end(); I != IE; I++)
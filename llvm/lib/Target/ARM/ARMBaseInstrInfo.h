@@ -204,8 +204,12 @@ public:
   virtual void emitIdemBoundary(MachineBasicBlock &MBB,
                                 MachineBasicBlock::iterator I) const;
 
-  virtual void emitCheckpoint(MachineBasicBlock &MBB,
-                              MachineBasicBlock::iterator I) const;
+  virtual unsigned emitCheckpoint(MachineBasicBlock &MBB,
+                                  MachineBasicBlock::iterator I,
+                                  LivePhysRegs &Live,
+                                  unsigned *InlineBudget = nullptr) const;
+
+  virtual unsigned selectDifferentialCheckpoints(MachineFunction &MF) const;
 
   //virtual void fixIdemCondCodes(MachineBasicBlock &MBB,
   //                              MachineBasicBlock::iterator I) const;
@@ -17,9 +17,11 @@
 #include "ARMSubtarget.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetRegisterInfo.h"
+#include <algorithm>
 
 namespace llvm {
 
@@ -127,6 +129,10 @@ class ARMFunctionInfo : public MachineFunctionInfo {
   /// coalesced weights.
   DenseMap<const MachineBasicBlock*, unsigned> CoalescedWeights;
 
+  /// ExactCheckpointMasks - Live register masks of the exact checkpoint
+  /// routines called by this function, which the asm printer emits.
+  SmallVector<unsigned, 4> ExactCheckpointMasks;
+
 public:
   ARMFunctionInfo() :
     isThumb(false),
@@ -245,6 +251,15 @@ public:
     }
     return It;
   }
+
+  void addExactCheckpointMask(unsigned Mask) {
+    if (std::find(ExactCheckpointMasks.begin(), ExactCheckpointMasks.end(),
+                  Mask) == ExactCheckpointMasks.end())
+      ExactCheckpointMasks.push_back(Mask);
+  }
+  const SmallVectorImpl<unsigned> &getExactCheckpointMasks() const {
+    return ExactCheckpointMasks;
+  }
 };
 } // End llvm namespace
 
@@ -13,15 +13,22 @@
 
 #include "Thumb1FrameLowering.h"
 #include "ARMMachineFunctionInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/IdempotenceReport.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/IdempotenceOptions.h"
+#include "llvm/IR/Function.h"
 
 using namespace llvm;
 
+#define DEBUG_TYPE "thumb1-frame-lowering"
+
+STATISTIC(NumReturnCheckpoints, "Number of checkpoints in epilogues");
+
 Thumb1FrameLowering::Thumb1FrameLowering(const ARMSubtarget &sti)
     : ARMFrameLowering(sti) {}
 
@@ -48,6 +55,44 @@ emitSPUpdate(MachineBasicBlock &MBB,
                             MRI, MIFlags);
 }
 
+// Returns true if a return from MF has to checkpoint.  A transparent function
+// (see IdempotenceSummaries) is part of each caller's region and can skip it,
+// unless something it calls, such as a checkpoint added for its spills,
+// starts a new region before it returns.  Inline checkpoints do as well.
+// The callers of a function marked "idempotence-caller-checkpoint" each
+// checkpoint right after the call instead, under the same condition: the
+// popped frame lies below SP until then, where an exception may stack over
+// it, so it must have been pushed within the region that reads it back.
+static bool needsReturnCheckpoint(const MachineFunction &MF) {
+  const Function *F = MF.getFunction();
+  if (!F->hasFnAttribute("idempotence-transparent") &&
+      !F->hasFnAttribute("idempotence-caller-checkpoint"))
+    return true;
+  for (MachineFunction::const_iterator B = MF.begin(), BE = MF.end();
+       B != BE; ++B)
+    for (MachineBasicBlock::const_iterator I = B->begin(), E = B->end();
+         I != E; ++I)
+      if (I->isCall() || I->getOpcode() == ARM::tCHECKPOINT)
+        return true;
+  return false;
+}
+
+// Returns true if MF returns through the checkpointing epilogue, which
+// restores the callee-saved registers through r3 and checkpoints before SP
+// moves past them.  Otherwise it pops them and the return address as usual.
+static bool usesCheckpointEpilogue(const MachineFunction &MF) {
+  return IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
+         needsReturnCheckpoint(MF);
+}
+
+// Counts a checkpoint in an epilogue of MF that saves Registers registers.
+static void recordReturnCheckpoint(const MachineFunction &MF, DebugLoc dl,
+                                   unsigned Registers) {
+  ++NumReturnCheckpoints;
+  if (IdempotenceReport *Report = IdempotenceReport::get())
+    Report->addReturn(MF, dl, Registers);
+}
+
 
 void Thumb1FrameLowering::
 eliminateCallFramePseudoInstr(MachineFunction &MF, MachineBasicBlock &MBB,
@@ -304,9 +349,9 @@ void Thumb1FrameLowering::emitPrologue(MachineFunction &MF) const {
     AFI->setShouldRestoreSPFromFP(true);
 }
 
-static bool isCSRestore(MachineInstr *MI, const MCPhysReg *CSRegs) {
-  if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction &&
-      MI->getOpcode() == ARM::tLDMIA)
+static bool isCSRestore(MachineInstr *MI, const MCPhysReg *CSRegs,
+                        bool CheckpointEpilogue) {
+  if (CheckpointEpilogue && MI->getOpcode() == ARM::tLDMIA)
   {
     // FIXME: Add some checking to make sure this is the correct LDMIA
     return true;  
@@ -347,6 +392,7 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
          "ArgRegsSaveSize is included in NumBytes");
   const MCPhysReg *CSRegs = RegInfo->getCalleeSavedRegs();
   unsigned FramePtr = RegInfo->getFrameRegister(MF);
+  bool CheckpointEpilogue = usesCheckpointEpilogue(MF);
 
   if (!AFI->hasStackFrame()) {
     if (NumBytes - ArgRegsSaveSize != 0)
@@ -356,8 +402,9 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
     if (MBBI != MBB.begin()) {
       do
         --MBBI;
-      while (MBBI != MBB.begin() && isCSRestore(MBBI, CSRegs));
-      if (!isCSRestore(MBBI, CSRegs))
+      while (MBBI != MBB.begin() &&
+             isCSRestore(MBBI, CSRegs, CheckpointEpilogue));
+      if (!isCSRestore(MBBI, CSRegs, CheckpointEpilogue))
         ++MBBI;
     }
 
@@ -367,7 +414,7 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
                  AFI->getDPRCalleeSavedAreaSize() +
                  ArgRegsSaveSize);
 
-    if (IdempotenceConstructionMode == IdempotenceOptions::NoConstruction) {
+    if (!CheckpointEpilogue) {
     if (AFI->shouldRestoreSPFromFP()) {
       NumBytes = AFI->getFramePtrSpillOffset() - NumBytes;
       // Reset SP based on frame pointer only if the stack frame extends beyond
@@ -404,8 +451,7 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
       IsV4PopReturn = true;
   IsV4PopReturn &= STI.hasV4TOps() && !STI.hasV5TOps();
 
-  if(IdempotenceConstructionMode != IdempotenceOptions::NoConstruction && 
-      AFI->hasStackFrame())
+  if (CheckpointEpilogue && AFI->hasStackFrame())
     IsV4PopReturn = true;
 
   // Unlike T2 and ARM mode, the T1 pop instruction cannot restore
@@ -434,10 +480,11 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
         .addReg(ARM::R3, RegState::Kill));
     }
 
-    if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction)
+    if (CheckpointEpilogue)
     {
       // Find the callee reg restoring function
-      while (MBBI != MBB.begin() && !isCSRestore(MBBI, CSRegs))
+      while (MBBI != MBB.begin() &&
+             !isCSRestore(MBBI, CSRegs, CheckpointEpilogue))
         MBBI--;
 
       //if (!AFI->shouldRestoreSPFromFP()) {
@@ -462,7 +509,7 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
       //}
  
 
-      if(isCSRestore(MBBI, CSRegs))
+      if(isCSRestore(MBBI, CSRegs, CheckpointEpilogue))
         MBBI++;
       
       // If there are no CS regs, make sure we have the SP handy
@@ -495,10 +542,13 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
           MBB.computeRegisterLiveness(TRI, ARM::R1, MBBI, 1000) == MachineBasicBlock::LivenessQueryResult::LQR_Live )
       {
       AddDefaultPred(BuildMI(MBB, MBBI, dl, TII.get(ARM::tBL))).addExternalSymbol("_checkpoint_8");
+      recordReturnCheckpoint(MF, dl, 8);
       }else{
       emitThumbRegPlusImmediate(MBB, MBBI, dl, ARM::R2, ARM::SP, StackDecrement+ArgRegsSaveSize, TII, *RegInfo);
 
       AddDefaultPred(BuildMI(MBB, MBBI, dl, TII.get(ARM::tBL))).addExternalSymbol("_checkpoint_ret");
+      // _checkpoint_ret saves r0 and the callee-saved r4-r7.
+      recordReturnCheckpoint(MF, dl, 5);
       }
 
       //// Decrement the stack pointer to reflect the CS regs being popped.
@@ -518,7 +568,7 @@ void Thumb1FrameLowering::emitEpilogue(MachineFunction &MF,
       emitSPUpdate(MBB, MBBI, TII, dl, *RegInfo, ArgRegsSaveSize);
     }
 
-    if (AFI->getReturnRegsCount() > 3 && IdempotenceConstructionMode == IdempotenceOptions::NoConstruction) {
+    if (AFI->getReturnRegsCount() > 3 && !CheckpointEpilogue) {
       AddDefaultPred(BuildMI(MBB, MBBI, dl, TII.get(ARM::tMOVr))
         .addReg(ARM::LR, RegState::Define)
         .addReg(ARM::R3, RegState::Kill));
@@ -590,9 +640,10 @@ restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
   const TargetInstrInfo &TII = *STI.getInstrInfo();
 
   bool isVarArg = AFI->getArgRegsSaveSize() > 0;
+  bool CheckpointEpilogue = usesCheckpointEpilogue(MF);
   DebugLoc DL = MI->getDebugLoc();
   MachineInstrBuilder MIB;
-  if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction)
+  if (CheckpointEpilogue)
   {
     int Reg = ARM::R3;
       
@@ -615,7 +666,7 @@ restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
       // ARMv4T requires BX, see emitEpilogue
       if (STI.hasV4TOps() && !STI.hasV5TOps())
         continue;
-      if (IdempotenceConstructionMode != IdempotenceOptions::NoConstruction)
+      if (CheckpointEpilogue)
         continue;
 
       Reg = ARM::PC;
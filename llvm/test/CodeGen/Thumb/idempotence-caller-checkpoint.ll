@@ -0,0 +1,77 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; An internal function that only reads memory and calls nothing, but is not
+; transparent because it reads through pointers it loads, pops its frame
+; without a checkpoint.  Its caller checkpoints right after the call.
+; CHECK-LABEL: walk:
+; CHECK: push {r4, r5, r7, lr}
+; CHECK-NOT: _checkpoint
+; CHECK: pop {{.*}}pc}
+%node = type { i32, i32, %node* }
+
+define internal i32 @walk(%node* %n) noinline {
+entry:
+  br label %loop
+
+loop:
+  %p = phi %node* [ %n, %entry ], [ %next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s2, %loop ]
+  %t = phi i32 [ 0, %entry ], [ %t1, %loop ]
+  %ap = getelementptr %node* %p, i32 0, i32 0
+  %a = load i32* %ap
+  %bp = getelementptr %node* %p, i32 0, i32 1
+  %b = load i32* %bp
+  %np = getelementptr %node* %p, i32 0, i32 2
+  %next = load %node** %np
+  %m = mul i32 %a, %b
+  %s1 = add i32 %s, %m
+  %t1 = xor i32 %t, %a
+  %s2 = add i32 %s1, %t
+  %c = icmp eq %node* %next, null
+  br i1 %c, label %exit, label %loop
+
+exit:
+  %r = sub i32 %s2, %t1
+  ret i32 %r
+}
+
+; CHECK-LABEL: walk_caller:
+; CHECK: bl walk
+; CHECK-NEXT: mov r1, r4
+; CHECK-NEXT: bl _checkpoint_2
+define void @walk_caller(%node* %n, i32* %out) {
+  %c = call i32 @walk(%node* %n)
+  store i32 %c, i32* %out
+  ret void
+}
+
+@g = global i32 0
+@h = global i32 0
+
+; An internal function with a cut of its own reads its frame back after the
+; cut, so it still checkpoints before popping the frame.
+; CHECK-LABEL: update:
+; CHECK: bl _checkpoint_2
+; CHECK: bl _checkpoint_ret
+; CHECK-NEXT: add sp, #24
+; CHECK-NEXT: bx r3
+define internal i32 @update(i32 %x) noinline {
+  %v = load i32* @g
+  %a = add i32 %v, %x
+  store i32 %a, i32* @g
+  %w = load i32* @h
+  %r = add i32 %w, %a
+  ret i32 %r
+}
+
+; CHECK-LABEL: update_caller:
+; CHECK: bl update
+; CHECK-NOT: _checkpoint
+; CHECK: str
+define i32 @update_caller(i32 %x) {
+  %v = load i32* @h
+  %c = call i32 @update(i32 %x)
+  %s = add i32 %c, %v
+  store i32 %s, i32* @h
+  ret i32 %s
+}
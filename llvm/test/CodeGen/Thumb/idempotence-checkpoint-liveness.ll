@@ -0,0 +1,44 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -verify-machineinstrs %s -o - | FileCheck %s
+
+; The checkpoint in the loop saves exactly the registers live across it.
+; %k, %n and %a in r4-r6 are only read again after the back edge, and the
+; sum in r0 only in %then or after the loop, so liveness has to follow the
+; whole CFG to keep them.  r7 is dead and is not saved.
+
+; CHECK-LABEL: sum:
+; CHECK: mov r4, r2
+; CHECK-NEXT: mov r5, r1
+; CHECK-NEXT: mov r6, r0
+; CHECK: %loop
+; CHECK: ldr r2, [r3]
+; CHECK-NEXT: bl _checkpoint_7
+; CHECK-NEXT: str r1, [r3]
+; CHECK-NOT: bl _checkpoint_{{[0-9]}}
+; CHECK: bne
+; CHECK: bl _checkpoint_ret
+define i32 @sum(i32* %a, i32 %n, i32 %k) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %latch ]
+  %p = getelementptr i32* %a, i32 %i
+  %v = load i32* %p
+  store i32 %i, i32* %p
+  %big = icmp sgt i32 %v, %k
+  br i1 %big, label %then, label %latch
+
+then:
+  %s1 = add i32 %s, %v
+  br label %latch
+
+latch:
+  %s.next = phi i32 [ %s1, %then ], [ %s, %loop ]
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %s.next
+}
@@ -0,0 +1,60 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s -check-prefix=FULL
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-differential-checkpoints %s -o - | FileCheck %s
+
+; The third checkpoint writes the buffer the first one wrote.  %x stays in r0
+; in between, so it need not be stored again.
+
+; FULL-LABEL: keep:
+; FULL: bl _checkpoint_4{{$}}
+; FULL: bl _checkpoint_4{{$}}
+; FULL: bl _checkpoint_4{{$}}
+; CHECK-LABEL: keep:
+; CHECK: ldr r0,
+; CHECK: bl _checkpoint_4{{$}}
+; CHECK-NOT: r0
+; CHECK: bl _checkpoint_4{{$}}
+; CHECK-NOT: r0
+; CHECK: bl _checkpoint_1_4
+define i32 @keep(i32* %p, i32* %q, i32* %r) {
+entry:
+  %x = load i32* %p
+  store i32 1, i32* %p
+  %y = load i32* %q
+  store i32 2, i32* %q
+  %z = load i32* %r
+  store i32 3, i32* %r
+  %s = add i32 %x, %y
+  %t = add i32 %s, %z
+  ret i32 %t
+}
+
+; Only the pointers are live at the checkpoints.  They are moved down into
+; the same registers before each one and back after it, which leaves the
+; values unchanged, so the third checkpoint stores none of them.
+
+; FULL-LABEL: rounds:
+; FULL: bl _checkpoint_3{{$}}
+; FULL: bl _checkpoint_3{{$}}
+; FULL: bl _checkpoint_3{{$}}
+; FULL: bl _checkpoint_1{{$}}
+; CHECK-LABEL: rounds:
+; CHECK: bl _checkpoint_3{{$}}
+; CHECK: bl _checkpoint_3{{$}}
+; CHECK: bl _checkpoint_3_3
+; CHECK: bl _checkpoint_1{{$}}
+define void @rounds(i32* noalias %p, i32* noalias %q, i32* noalias %r) {
+entry:
+  %a = load i32* %p
+  store i32 %a, i32* %r
+  store i32 1, i32* %p
+  %b = load i32* %q
+  store i32 %b, i32* %r
+  store i32 2, i32* %q
+  %c = load i32* %p
+  store i32 %c, i32* %r
+  store i32 3, i32* %p
+  %d = load i32* %q
+  store i32 %d, i32* %r
+  store i32 4, i32* %q
+  ret void
+}
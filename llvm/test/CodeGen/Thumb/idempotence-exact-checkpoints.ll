@@ -0,0 +1,43 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-exact-checkpoints -verify-machineinstrs %s -o - | FileCheck %s
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s -check-prefix=MOVED
+
+; r4-r6 are live at the cut before the call.  The exact routine stores them
+; where they are instead of moving them down into r0-r2 and back.  It uses
+; r0 and r1 as scratch, so the copy of %s into r1 after it must stay.
+
+; CHECK-LABEL: copy:
+; CHECK: ldr r6, [r5]
+; CHECK-NEXT: bl _checkpoint_m70
+; CHECK-NOT: bl
+; CHECK: mov r1, r4
+; CHECK-NEXT: bl __aeabi_memcpy
+
+; MOVED-LABEL: copy:
+; MOVED: mov r0, r6
+; MOVED-NEXT: mov r1, r5
+; MOVED-NEXT: mov r2, r4
+; MOVED-NEXT: bl _checkpoint_3
+; MOVED-NEXT: mov r6, r0
+; MOVED-NOT: _checkpoint_m
+
+; The routine is emitted once, in its own group.
+
+; CHECK: .section .text._checkpoint_m70,"axG",%progbits,_checkpoint_m70,comdat
+; CHECK: .weak _checkpoint_m70
+; CHECK: _checkpoint_m70:
+; CHECK-NEXT: ldr r0, [[PTR:.Ltmp[0-9]+]]
+; CHECK-NEXT: ldr r0, [r0]
+; CHECK-NEXT: adds r0, #16
+; CHECK-NEXT: stm r0!, {r4, r5, r6}
+; CHECK: bx lr
+; CHECK: [[PTR]]:
+; CHECK-NEXT: .long _idemStorePtr
+; CHECK-NOT: _checkpoint_m70:
+define i32 @copy(i8* %d, i8* %s) {
+  %p = bitcast i8* %d to i32*
+  %v = load i32* %p
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 1024, i32 4, i1 false)
+  ret i32 %v
+}
+
+declare void @llvm.memcpy.p0i8.p0i8.i32(i8* nocapture, i8* nocapture readonly, i32, i32, i1)
@@ -0,0 +1,46 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-inline-checkpoints %s -o - | FileCheck %s
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-inline-checkpoints -idempotence-inline-checkpoint-budget=0 %s -o - | FileCheck %s -check-prefix=BUDGET
+
+; The checkpoint in the loop body runs more often than the entry and is
+; expanded inline.  The one in the entry block still calls the routine.
+
+; CHECK-LABEL: inc:
+; CHECK: bl _checkpoint_3
+; CHECK: %loop
+; CHECK-NOT: bl
+; CHECK: ldr r5, [[PTR:.LCPI[0-9_]+]]
+; CHECK-NEXT: ldr r7, [r5] {{.*}}checkpoint begin
+; CHECK-NEXT: stm r7!, {r0, r1, r2, r3}
+; CHECK: str r7, [r5] {{.*}}checkpoint end
+; CHECK-NEXT: str r3, [r1]
+; CHECK: bne
+; CHECK: bl _checkpoint_ret
+; CHECK: [[PTR]]:
+; CHECK-NEXT: .long _idemStorePtr
+
+; Without a budget, every checkpoint calls the routine.
+
+; BUDGET-LABEL: inc:
+; BUDGET-NOT: checkpoint begin
+; BUDGET: %loop
+; BUDGET: bl _checkpoint_4
+; BUDGET-NEXT: str r3, [r1]
+define void @inc(i32* %a, i32 %n) {
+entry:
+  %x = load i32* %a
+  store i32 0, i32* %a
+  br label %loop
+
+loop:
+  %i = phi i32 [ 1, %entry ], [ %i.next, %loop ]
+  %p = getelementptr i32* %a, i32 %i
+  %v = load i32* %p
+  %v1 = add i32 %v, %x
+  store i32 %v1, i32* %p
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
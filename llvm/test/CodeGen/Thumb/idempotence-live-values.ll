@@ -0,0 +1,42 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; The store to %a overwrites what was loaded from it, and the store to %b
+; lies between the two.  A cut before either store breaks the antidependence,
+; and both are in the same block on the same path.  Before the store to %a,
+; five more values loaded from @h are live, so the cut goes before the store
+; to %b, where its checkpoint saves fewer registers, even though the
+; antidependent store would win the tie otherwise.
+
+; CHECK-LABEL: f:
+; CHECK: bl _checkpoint_4
+; CHECK: str r0, [r4]
+; CHECK-NOT: bl _checkpoint
+; CHECK: ldm
+; CHECK-NOT: bl _checkpoint
+; CHECK: str r2, [r0]
+; CHECK: bl _checkpoint_ret
+
+@h = global [8 x i32] zeroinitializer
+
+define i32 @f(i32 %i, i32 %j) {
+entry:
+  %a = alloca [4 x i32]
+  %b = alloca [4 x i32]
+  %pa = getelementptr [4 x i32]* %a, i32 0, i32 %i
+  %v = load i32* %pa
+  %pb = getelementptr [4 x i32]* %b, i32 0, i32 %j
+  store i32 %v, i32* %pb
+  %l0 = load i32* getelementptr ([8 x i32]* @h, i32 0, i32 0)
+  %l1 = load i32* getelementptr ([8 x i32]* @h, i32 0, i32 1)
+  %l2 = load i32* getelementptr ([8 x i32]* @h, i32 0, i32 2)
+  %l3 = load i32* getelementptr ([8 x i32]* @h, i32 0, i32 3)
+  %l4 = load i32* getelementptr ([8 x i32]* @h, i32 0, i32 4)
+  %pa2 = getelementptr [4 x i32]* %a, i32 0, i32 %j
+  store i32 %l0, i32* %pa2
+  %r = load i32* %pb
+  %s1 = add i32 %r, %l1
+  %s2 = xor i32 %s1, %l2
+  %s3 = add i32 %s2, %l3
+  %s4 = mul i32 %s3, %l4
+  ret i32 %s4
+}
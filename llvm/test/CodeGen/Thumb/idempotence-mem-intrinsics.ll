@@ -0,0 +1,55 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; Small fixed-size memory intrinsics are expanded into loads and stores
+; before the analysis runs.  The source of a copy may overlap its
+; destination, so one cut separates all of the loads from all of the stores,
+; and no library call ends the region.
+
+; CHECK-LABEL: copy_small:
+; CHECK-NOT: memcpy
+; CHECK: ldm
+; CHECK-NOT: str
+; CHECK: bl _checkpoint_
+; CHECK-NOT: memcpy
+; CHECK: stm
+; CHECK: bl _checkpoint_ret
+define void @copy_small(i8* %d, i8* %s) {
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 16, i32 4, i1 false)
+  ret void
+}
+
+; The stores of an expanded memset are cut from the load that reads the
+; memory they overwrite.
+
+; CHECK-LABEL: set_small:
+; CHECK-NOT: memset
+; CHECK: ldr
+; CHECK-NOT: str
+; CHECK: bl _checkpoint_
+; CHECK-NOT: memset
+; CHECK: str
+; CHECK: str
+define i32 @set_small(i8* %d, i8 %c) {
+  %p = bitcast i8* %d to i32*
+  %v = load i32* %p
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 %c, i32 8, i32 4, i1 false)
+  ret i32 %v
+}
+
+; A copy too large to expand stays a library call.  It still overwrites
+; memory read before it, so it is cut from that load.
+
+; CHECK-LABEL: copy_large:
+; CHECK: ldr
+; CHECK: bl _checkpoint_
+; CHECK: bl __aeabi_memcpy
+; CHECK: bl _checkpoint_ret
+define i32 @copy_large(i8* %d, i8* %s) {
+  %p = bitcast i8* %d to i32*
+  %v = load i32* %p
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 1024, i32 4, i1 false)
+  ret i32 %v
+}
+
+declare void @llvm.memcpy.p0i8.p0i8.i32(i8* nocapture, i8* nocapture readonly, i32, i32, i1)
+declare void @llvm.memset.p0i8.i32(i8* nocapture, i8, i32, i32, i1)
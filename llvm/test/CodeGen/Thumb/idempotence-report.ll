@@ -0,0 +1,40 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-report=%t.yaml %s -o /dev/null
+; RUN: FileCheck %s < %t.yaml
+
+; Both functions get their cuts placed before either reaches the machine
+; passes, and each cut is still matched to the checkpoint it became.
+; CHECK-NOT: Cause: unknown
+; CHECK:      - Function:        first
+; CHECK-NEXT:   Location:
+; CHECK-NEXT:   Cause:           antidependence
+; CHECK:        LiveRegisters:   2
+; CHECK-NEXT:   Removed:         false
+; CHECK-NEXT: - Function:        second
+; CHECK-NEXT:   Location:
+; CHECK-NEXT:   Cause:           antidependence
+; CHECK:        LiveRegisters:   2
+; CHECK-NEXT:   Removed:         false
+; CHECK-NEXT: - Function:        first
+; CHECK-NEXT:   Location:
+; CHECK-NEXT:   Cause:           return
+; CHECK:      - Function:        second
+; CHECK-NEXT:   Location:
+; CHECK-NEXT:   Cause:           return
+; CHECK-NOT: Cause: unknown
+
+@g = global i32 0
+@h = global i32 0
+
+define void @first(i32 %x) {
+  %v = load i32* @g
+  %a = add i32 %v, %x
+  store i32 %a, i32* @g
+  ret void
+}
+
+define void @second(i32 %x) {
+  %v = load i32* @h
+  %a = mul i32 %v, %x
+  store i32 %a, i32* @h
+  ret void
+}
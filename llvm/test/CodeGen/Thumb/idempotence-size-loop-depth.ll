@@ -0,0 +1,36 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=size %s -o - | FileCheck %s
+
+; Optimizing for size, every candidate is at the same level, so the fewest
+; cuts win.  A cut before the store to %r or before the store to %p breaks
+; the antidependence on %p equally well.  More values are live before the
+; store to %r, and the store to %p is the antidependent one, but it runs on
+; every iteration, so loop depth breaks the tie and the cut stays out of the
+; loop.
+
+; CHECK-LABEL: fill:
+; CHECK: bl _checkpoint_8
+; CHECK-NEXT: str r1, [r6]
+; CHECK: %loop
+; CHECK-NOT: bl
+; CHECK: bne
+; CHECK: %exit
+define i32 @fill(i32* noalias %p, i32* noalias %q, i32* noalias %r, i32 %n) {
+entry:
+  %x = load i32* %p
+  %y = load i32* %q
+  br label %pre
+
+pre:
+  store i32 %x, i32* %r
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %pre ], [ %i.next, %loop ]
+  store i32 %i, i32* %p
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %y
+}
@@ -0,0 +1,184 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; Each function spills the values of two phases, one before a call and one
+; after it.  A call to an external function ends the region, so the slots
+; reloaded before it can be reused by the spills after it.  A call to the
+; transparent @leaf does not, so sharing a slot across it would put a reload
+; and a later spill of the same slot in one region.  The slots are kept
+; apart instead, and no checkpoint is needed between the two phases.
+
+; CHECK-LABEL: across_leaf:
+; CHECK: sub sp, #60
+; CHECK: Reload
+; CHECK: bl leaf
+; CHECK-NOT: bl _checkpoint
+; CHECK: Spill
+
+; CHECK-LABEL: across_ext:
+; CHECK: sub sp, #36
+; CHECK: bl ext
+
+@t = global [8 x i32] zeroinitializer
+@u = global [16 x i32] zeroinitializer
+@v = global [16 x i32] zeroinitializer
+
+define internal i32 @leaf(i32 %i) noinline {
+  %m = and i32 %i, 7
+  %p = getelementptr [8 x i32]* @t, i32 0, i32 %m
+  %r = load i32* %p
+  ret i32 %r
+}
+
+declare i32 @ext(i32)
+
+define i32 @across_leaf() {
+  %a0 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 0)
+  %a1 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 1)
+  %a2 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 2)
+  %a3 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 3)
+  %a4 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 4)
+  %a5 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 5)
+  %a6 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 6)
+  %a7 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 7)
+  %a8 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 8)
+  %a9 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 9)
+  %a10 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 10)
+  %a11 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 11)
+  %as1 = add i32 %a0, %a1
+  %as2 = add i32 %as1, %a2
+  %as3 = add i32 %as2, %a3
+  %as4 = add i32 %as3, %a4
+  %as5 = add i32 %as4, %a5
+  %as6 = add i32 %as5, %a6
+  %as7 = add i32 %as6, %a7
+  %as8 = add i32 %as7, %a8
+  %as9 = add i32 %as8, %a9
+  %as10 = add i32 %as9, %a10
+  %as11 = add i32 %as10, %a11
+  %ax11 = xor i32 %as11, %a11
+  %ax10 = xor i32 %ax11, %a10
+  %ax9 = xor i32 %ax10, %a9
+  %ax8 = xor i32 %ax9, %a8
+  %ax7 = xor i32 %ax8, %a7
+  %ax6 = xor i32 %ax7, %a6
+  %ax5 = xor i32 %ax6, %a5
+  %ax4 = xor i32 %ax5, %a4
+  %ax3 = xor i32 %ax4, %a3
+  %ax2 = xor i32 %ax3, %a2
+  %ax1 = xor i32 %ax2, %a1
+  %ax0 = xor i32 %ax1, %a0
+  %c = call i32 @leaf(i32 %ax0)
+  %b0 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 0)
+  %b1 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 1)
+  %b2 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 2)
+  %b3 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 3)
+  %b4 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 4)
+  %b5 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 5)
+  %b6 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 6)
+  %b7 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 7)
+  %b8 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 8)
+  %b9 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 9)
+  %b10 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 10)
+  %b11 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 11)
+  %bs1 = add i32 %b0, %b1
+  %bs2 = add i32 %bs1, %b2
+  %bs3 = add i32 %bs2, %b3
+  %bs4 = add i32 %bs3, %b4
+  %bs5 = add i32 %bs4, %b5
+  %bs6 = add i32 %bs5, %b6
+  %bs7 = add i32 %bs6, %b7
+  %bs8 = add i32 %bs7, %b8
+  %bs9 = add i32 %bs8, %b9
+  %bs10 = add i32 %bs9, %b10
+  %bs11 = add i32 %bs10, %b11
+  %bx11 = xor i32 %bs11, %b11
+  %bx10 = xor i32 %bx11, %b10
+  %bx9 = xor i32 %bx10, %b9
+  %bx8 = xor i32 %bx9, %b8
+  %bx7 = xor i32 %bx8, %b7
+  %bx6 = xor i32 %bx7, %b6
+  %bx5 = xor i32 %bx6, %b5
+  %bx4 = xor i32 %bx5, %b4
+  %bx3 = xor i32 %bx4, %b3
+  %bx2 = xor i32 %bx3, %b2
+  %bx1 = xor i32 %bx2, %b1
+  %bx0 = xor i32 %bx1, %b0
+  %r = add i32 %c, %bx0
+  ret i32 %r
+}
+
+define i32 @across_ext() {
+  %a0 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 0)
+  %a1 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 1)
+  %a2 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 2)
+  %a3 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 3)
+  %a4 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 4)
+  %a5 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 5)
+  %a6 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 6)
+  %a7 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 7)
+  %a8 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 8)
+  %a9 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 9)
+  %a10 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 10)
+  %a11 = load i32* getelementptr ([16 x i32]* @u, i32 0, i32 11)
+  %as1 = add i32 %a0, %a1
+  %as2 = add i32 %as1, %a2
+  %as3 = add i32 %as2, %a3
+  %as4 = add i32 %as3, %a4
+  %as5 = add i32 %as4, %a5
+  %as6 = add i32 %as5, %a6
+  %as7 = add i32 %as6, %a7
+  %as8 = add i32 %as7, %a8
+  %as9 = add i32 %as8, %a9
+  %as10 = add i32 %as9, %a10
+  %as11 = add i32 %as10, %a11
+  %ax11 = xor i32 %as11, %a11
+  %ax10 = xor i32 %ax11, %a10
+  %ax9 = xor i32 %ax10, %a9
+  %ax8 = xor i32 %ax9, %a8
+  %ax7 = xor i32 %ax8, %a7
+  %ax6 = xor i32 %ax7, %a6
+  %ax5 = xor i32 %ax6, %a5
+  %ax4 = xor i32 %ax5, %a4
+  %ax3 = xor i32 %ax4, %a3
+  %ax2 = xor i32 %ax3, %a2
+  %ax1 = xor i32 %ax2, %a1
+  %ax0 = xor i32 %ax1, %a0
+  %c = call i32 @ext(i32 %ax0)
+  %b0 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 0)
+  %b1 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 1)
+  %b2 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 2)
+  %b3 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 3)
+  %b4 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 4)
+  %b5 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 5)
+  %b6 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 6)
+  %b7 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 7)
+  %b8 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 8)
+  %b9 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 9)
+  %b10 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 10)
+  %b11 = load i32* getelementptr ([16 x i32]* @v, i32 0, i32 11)
+  %bs1 = add i32 %b0, %b1
+  %bs2 = add i32 %bs1, %b2
+  %bs3 = add i32 %bs2, %b3
+  %bs4 = add i32 %bs3, %b4
+  %bs5 = add i32 %bs4, %b5
+  %bs6 = add i32 %bs5, %b6
+  %bs7 = add i32 %bs6, %b7
+  %bs8 = add i32 %bs7, %b8
+  %bs9 = add i32 %bs8, %b9
+  %bs10 = add i32 %bs9, %b10
+  %bs11 = add i32 %bs10, %b11
+  %bx11 = xor i32 %bs11, %b11
+  %bx10 = xor i32 %bx11, %b10
+  %bx9 = xor i32 %bx10, %b9
+  %bx8 = xor i32 %bx9, %b8
+  %bx7 = xor i32 %bx8, %b7
+  %bx6 = xor i32 %bx7, %b6
+  %bx5 = xor i32 %bx6, %b5
+  %bx4 = xor i32 %bx5, %b4
+  %bx3 = xor i32 %bx4, %b3
+  %bx2 = xor i32 %bx3, %b2
+  %bx1 = xor i32 %bx2, %b1
+  %bx0 = xor i32 %bx1, %b0
+  %r = add i32 %c, %bx0
+  ret i32 %r
+}
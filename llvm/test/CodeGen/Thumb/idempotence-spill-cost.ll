@@ -0,0 +1,54 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-spill-checkpoint-cost=0 %s -o - | FileCheck %s -check-prefix=ZERO
+
+; The loop keeps four values around its back edge and uses three values
+; that do not change in it, one register too many.  Spilling a loop-carried
+; value puts its reload and its spill in the same iteration, which needs a
+; checkpoint between them on every iteration.  Charged for that checkpoint,
+; the allocator spills loop invariants instead, which are only reloaded.
+; Without the charge it spills a loop-carried value.
+
+; CHECK-LABEL: f:
+; CHECK: Inner Loop Header
+; CHECK-NOT: _checkpoint
+; CHECK-NOT: Spill
+; CHECK: blo
+
+; ZERO-LABEL: f:
+; ZERO: Inner Loop Header
+; ZERO: bl _checkpoint_7
+; ZERO-NEXT: mov r7, r1
+; ZERO-NEXT: str r0, [sp, #[[SLOT:[0-9]+]]] @ 4-byte Spill
+; ZERO: ldr r0, [sp, #[[SLOT]]] @ 4-byte Reload
+; ZERO: blo
+
+define i32 @f(i32* %p, i32 %n, i32 %a0, i32 %a1) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %x0 = phi i32 [ 0, %entry ], [ %y0, %loop ]
+  %x1 = phi i32 [ 1, %entry ], [ %y1, %loop ]
+  %x2 = phi i32 [ 2, %entry ], [ %y2, %loop ]
+  %x3 = phi i32 [ 3, %entry ], [ %y3, %loop ]
+  %q = getelementptr i32* %p, i32 %i
+  %v = load i32* %q
+  %t0 = add i32 %x0, %a0
+  %y0 = add i32 %t0, %v
+  %t1 = xor i32 %x1, %a1
+  %y1 = add i32 %t1, %v
+  %t2 = mul i32 %x2, %a0
+  %y2 = add i32 %t2, %v
+  %t3 = add i32 %x3, %a1
+  %y3 = add i32 %t3, %v
+  %inc = add i32 %i, 1
+  %cmp = icmp ult i32 %inc, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %s1 = add i32 %y0, %y1
+  %s2 = add i32 %s1, %y2
+  %s3 = add i32 %s2, %y3
+  ret i32 %s3
+}
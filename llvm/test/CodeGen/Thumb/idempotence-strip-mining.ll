@@ -0,0 +1,33 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-strip-mining %s -o - | FileCheck %s
+
+; The loop needs a cut before each store to @g.  Strip-mining it by 4 folds
+; four iterations into one with a single load, checkpoint and store.
+; CHECK-LABEL: f:
+; CHECK: .LBB0_1:
+; CHECK: ldr {{r[0-9]}}, {{\[}}[[G:r[0-9]]]{{\]}}
+; CHECK-NOT: ldr
+; CHECK: bl _checkpoint_
+; CHECK-NEXT: str {{r[0-9]}}, {{\[}}[[G]]{{\]}}
+; CHECK-NOT: str
+; CHECK: cmp {{r[0-9]}}, #192
+; CHECK-NEXT: bne .LBB0_1
+
+@g = global i32 0, align 4
+
+define void @f() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %v = load i32* @g, align 4
+  %mul = mul i32 %v, 3
+  %add = add i32 %mul, %i
+  store i32 %add, i32* @g, align 4
+  %inc = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %inc, 64
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
@@ -0,0 +1,72 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; @leaf is transparent and returns without a checkpoint, so a call to it does
+; not end the caller's region.  A slot reloaded before the call and spilled
+; to after it still needs a checkpoint in between.
+
+; CHECK-LABEL: leaf:
+; CHECK-NOT: _checkpoint
+; CHECK: bx lr
+
+; CHECK-LABEL: acc:
+; CHECK: .LBB1_1:
+; CHECK: ldr {{r[0-9]}}, [sp, #[[SLOT:[0-9]+]]] @ 4-byte Reload
+; CHECK: bl leaf
+; CHECK-NOT: Spill
+; CHECK: bl _checkpoint_
+; CHECK: str {{r[0-9]}}, [sp, #[[SLOT]]] @ 4-byte Spill
+
+@t = global [8 x i32] zeroinitializer
+
+define internal i32 @leaf(i32 %i) noinline {
+  %m = and i32 %i, 7
+  %p = getelementptr [8 x i32]* @t, i32 0, i32 %m
+  %v = load i32* %p
+  ret i32 %v
+}
+
+define i32 @acc(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %x0 = phi i32 [ 0, %entry ], [ %y0, %loop ]
+  %x1 = phi i32 [ 1, %entry ], [ %y1, %loop ]
+  %x2 = phi i32 [ 2, %entry ], [ %y2, %loop ]
+  %x3 = phi i32 [ 3, %entry ], [ %y3, %loop ]
+  %x4 = phi i32 [ 4, %entry ], [ %y4, %loop ]
+  %x5 = phi i32 [ 5, %entry ], [ %y5, %loop ]
+  %x6 = phi i32 [ 6, %entry ], [ %y6, %loop ]
+  %x7 = phi i32 [ 7, %entry ], [ %y7, %loop ]
+  %s0 = add i32 %x0, %x1
+  %s1 = xor i32 %s0, %x2
+  %s2 = xor i32 %s1, %x3
+  %s3 = xor i32 %s2, %x4
+  %s4 = xor i32 %s3, %x5
+  %s5 = xor i32 %s4, %x6
+  %s6 = xor i32 %s5, %x7
+  %l0 = call i32 @leaf(i32 %s6)
+  %l1 = call i32 @leaf(i32 %i)
+  %y0 = add i32 %x0, %l0
+  %y1 = mul i32 %x1, %l1
+  %y2 = xor i32 %x2, %l0
+  %y3 = add i32 %x3, %l1
+  %y4 = mul i32 %x4, %l0
+  %y5 = xor i32 %x5, %l1
+  %y6 = add i32 %x6, %l0
+  %y7 = mul i32 %x7, %l1
+  %inc = add i32 %i, 1
+  %done = icmp eq i32 %inc, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %r0 = add i32 %y0, %y1
+  %r1 = add i32 %r0, %y2
+  %r2 = add i32 %r1, %y3
+  %r3 = add i32 %r2, %y4
+  %r4 = add i32 %r3, %y5
+  %r5 = add i32 %r4, %y6
+  %r6 = add i32 %r5, %y7
+  ret i32 %r6
+}
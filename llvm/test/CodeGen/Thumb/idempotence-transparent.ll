@@ -0,0 +1,92 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed %s -o - | FileCheck %s
+
+; Internal WAR-free leaf functions are transparent: their callers analyze the
+; memory they read and write, and they return without a checkpoint.
+
+@g = global i32 0
+@a = global [8 x i32] zeroinitializer
+
+; CHECK-LABEL: get:
+; CHECK-NOT: _checkpoint
+; CHECK: bx lr
+define internal i32 @get(i32* %p) noinline {
+  %v = load i32* %p
+  ret i32 %v
+}
+
+; CHECK-LABEL: set:
+; CHECK-NOT: _checkpoint
+; CHECK: bx lr
+define internal void @set(i32* %p, i32 %v) noinline {
+  store i32 %v, i32* %p
+  ret void
+}
+
+; The read of @g in get and the write in set need a cut between the calls.
+; CHECK-LABEL: bump:
+; CHECK: bl get
+; CHECK-NEXT: mov r1, r4
+; CHECK-NEXT: bl _checkpoint_2
+; CHECK: bl set
+; CHECK-NOT: _checkpoint_2
+; CHECK: bl _checkpoint_ret
+define void @bump() {
+  %v = call i32 @get(i32* @g)
+  %a = add i32 %v, 1
+  call void @set(i32* @g, i32 %a)
+  ret void
+}
+
+; CHECK-LABEL: bump_twice:
+; CHECK: ldr r1, [r0]
+; CHECK-NEXT: bl _checkpoint_2
+; CHECK: bl set
+define void @bump_twice() {
+  %v = load i32* @g
+  %a = add i32 %v, 2
+  call void @set(i32* @g, i32 %a)
+  ret void
+}
+
+; A transparent function with a frame pops it and returns as usual, without
+; a checkpoint.
+; CHECK-LABEL: mix:
+; CHECK: push {r4, r5, r6, lr}
+; CHECK-NOT: _checkpoint
+; CHECK: pop {{.*}}pc}
+define internal i32 @mix(i32* %p) noinline {
+  %q1 = getelementptr i32* %p, i32 1
+  %q2 = getelementptr i32* %p, i32 2
+  %q3 = getelementptr i32* %p, i32 3
+  %q4 = getelementptr i32* %p, i32 4
+  %q5 = getelementptr i32* %p, i32 5
+  %v0 = load i32* %p
+  %v1 = load i32* %q1
+  %v2 = load i32* %q2
+  %v3 = load i32* %q3
+  %v4 = load i32* %q4
+  %v5 = load i32* %q5
+  %m0 = mul i32 %v0, %v5
+  %m1 = mul i32 %v1, %v4
+  %m2 = mul i32 %v2, %v3
+  %m3 = mul i32 %v3, %v1
+  %m4 = mul i32 %v4, %v0
+  %a0 = xor i32 %m0, %m1
+  %a1 = xor i32 %m2, %m3
+  %a2 = xor i32 %a0, %a1
+  %a3 = xor i32 %a2, %m4
+  ret i32 %a3
+}
+
+; CHECK-LABEL: update:
+; CHECK: bl mix
+; CHECK-NEXT: mov r1, r4
+; CHECK-NEXT: bl _checkpoint_2
+; CHECK-NEXT: mov r4, r1
+; CHECK-NEXT: str r0, [r4]
+define void @update() {
+  %p = getelementptr [8 x i32]* @a, i32 0, i32 0
+  %v = call i32 @mix(i32* %p)
+  store i32 %v, i32* %p
+  ret void
+}
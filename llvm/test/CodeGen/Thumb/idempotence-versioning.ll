@@ -0,0 +1,36 @@
+; RUN: llc -mtriple=thumbv6m-none-eabi -mcpu=cortex-m0 -idempotence-construction=speed -idempotence-versioning %s -o - | FileCheck %s
+
+; Each iteration reads and then overwrites an element of @a.  Versioning
+; stores into a shadow copy instead, so the loop needs no checkpoint and a
+; single cut precedes the copy back.
+; CHECK-LABEL: inc:
+; CHECK-NOT: _checkpoint
+; CHECK: .LBB0_1:
+; CHECK-NOT: _checkpoint
+; CHECK: bne .LBB0_1
+; CHECK: bl _checkpoint_
+; CHECK-NEXT: str
+; CHECK: bl _checkpoint_ret
+; CHECK: .long a
+; CHECK-NEXT: .LCPI0_1:
+; CHECK-NEXT: .long a.shadow
+
+@a = internal global [8 x i32] zeroinitializer, align 4
+
+define void @inc() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %p = getelementptr [8 x i32]* @a, i32 0, i32 %i
+  %v = load i32* %p, align 4
+  %add = add i32 %v, 1
+  store i32 %add, i32* %p, align 4
+  %inc = add i32 %i, 1
+  %done = icmp eq i32 %inc, 8
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
@@ -17,14 +17,33 @@ ifeq ($(NOIDEMCOMP), 1)
 	OBJS := v.o $(OBJS)
 else
 	#LOADIDEM=-Xclang -mllvm -Xclang -no-stack-slot-sharing -Xclang -mllvm -Xclang -idempotence-construction=size #-Xclang -load -Xclang $(IDEMPASSOBJ)
-	ARGS= -no-stack-slot-sharing -idempotence-construction=speed
+	ARGS= -idempotence-construction=speed
 	LINKDIR=-L/opt/arm-newlib/idem/arm-none-eabi/lib
 	INCLIB = -I/opt/arm-newlib/idem/arm-none-eabi/include 
 	OBJS := iv.o checkpoint.o $(OBJS)
 endif
 
+# With LTO=1 the benchmark is compiled to bitcode and linked into one object
+# by llvm-lto, together with the bitcode files in LTOLIBS (e.g. newlib built
+# with -flto). Ratchet then sees every function with all of its callers, and
+# calls to small internal functions need no checkpoint.
+ifeq ($(LTO), 1)
+	LTOFLAGS = -flto
+	STARTOBJS := $(filter iv.o v.o checkpoint.o, $(OBJS))
+	LINKOBJS := $(STARTOBJS) lto.o
+else
+	LINKOBJS := $(OBJS)
+endif
+LTOEXPORTS ?= main
+
+# With REPORT=1 every object gets a YAML record of its checkpoints next to it
+# (main.o.yaml for main.o).
+ifeq ($(REPORT), 1)
+	REPORTARG = -idempotence-report=$@.yaml
+endif
+
 llvm-arg = -Xclang -mllvm -Xclang $(1)
-LLVMARGS = $(foreach ARG, $(ARGS), $(call llvm-arg,$(ARG)))
+LLVMARGS = $(foreach ARG, $(ARGS) $(REPORTARG), $(call llvm-arg,$(ARG)))
 
 all: main.elf 
 
@@ -38,13 +57,16 @@ checkpoint.o: ../checkpoint.c
 	$(CC) $(CLANGFLAGS) -c ../checkpoint.c -o checkpoint.o 
 
 %.o: %.c
-	$(CC) $(LLVMARGS) $(CLANGFLAGS) $(INCLIB) -c -o $@ $< 
+	$(CC) $(LLVMARGS) $(CLANGFLAGS) $(LTOFLAGS) $(INCLIB) -c -o $@ $< 
 
 %.o: ../%.c
-	$(CC) $(LLVMARGS) $(CLANGFLAGS) $(INCLIB) -c -o $@ $< 
+	$(CC) $(LLVMARGS) $(CLANGFLAGS) $(LTOFLAGS) $(INCLIB) -c -o $@ $< 
+
+lto.o: $(filter-out $(STARTOBJS), $(OBJS))
+	$(LLVMOBJSDIR)/bin/llvm-lto $(ARGS) $(REPORTARG) -mcpu=cortex-m0 $(foreach SYM, $(LTOEXPORTS), -exported-symbol=$(SYM)) -o lto.o $^ $(LTOLIBS)
 
-main.elf: $(OBJS) 
-	/opt/gcc-$(ARMGNU)/bin/$(ARMGNU)-ld -T ../memmap $(LINKDIR) $(OBJS) -o main.elf $(LIBS)
+main.elf: $(LINKOBJS) 
+	/opt/gcc-$(ARMGNU)/bin/$(ARMGNU)-ld -T ../memmap $(LINKDIR) $(LINKOBJS) -o main.elf $(LIBS)
 	/opt/gcc-$(ARMGNU)/bin/$(ARMGNU)-objdump -D main.elf > main.lst
 	/opt/gcc-$(ARMGNU)/bin/$(ARMGNU)-objcopy main.elf main.bin -O binary
 
@@ -59,5 +81,5 @@ overhead: main.elf
 
 
 clean:
-	rm -rf main.llvmout *.o *.elf output* *.lst *.bin *~
+	rm -rf main.llvmout *.o *.o.yaml *.elf output* *.lst *.bin *~
 	rm -f tmp/*
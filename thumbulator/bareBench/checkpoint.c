@@ -331,6 +331,75 @@ CHECKPOINT_FUNC(6);
 CHECKPOINT_FUNC(7);
 CHECKPOINT_FUNC(8);
 
+#if NDEBUG
+
+// Differential checkpoints, called as _checkpoint_<lo>_<nlive>, store only
+// r<lo> and up of the nlive live registers.  The compiler picks one when the
+// lower registers have not changed since the checkpoint before the previous
+// one: their values are then still in the buffer being written, so the
+// committed buffer always holds every live register and restoring is
+// unchanged.
+#define SAVE_LOW_FROM(skip, lo, hi, rest) \
+__asm__ __volatile__ (\
+    "adds r7, r7, #" #skip "\n\t"\
+    "stmia r7!, {r" #lo "-r" #hi "}\n\t"\
+    "adds r7, r7, #" #rest "\n\t")
+#define SAVE_LOW_8_FROM(skip, lo) \
+__asm__ __volatile__ (\
+    "adds r7, r7, #" #skip "\n\t"\
+    "stmia r7!, {r" #lo "-r6}\n\t")
+#define SKIP_LOW(skip) \
+__asm__ __volatile__ (\
+    "adds r7, r7, #" #skip "\n\t")
+
+#define DIFF_CHECKPOINT_FUNC(lo, nlive, save)  \
+void _checkpoint_##lo##_##nlive() {     \
+  SAVE_REGS_##nlive; \
+  LOAD_CP_PTR_##nlive;\
+  save;\
+  SAVE_SP_##nlive;\
+  STORE_CP_PTR_##nlive;\
+  RESTORE_REGS_##nlive; \
+}
+
+DIFF_CHECKPOINT_FUNC(1, 1, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 2, SAVE_LOW_FROM(4, 1, 1, 24));
+DIFF_CHECKPOINT_FUNC(2, 2, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 3, SAVE_LOW_FROM(4, 1, 2, 20));
+DIFF_CHECKPOINT_FUNC(2, 3, SAVE_LOW_FROM(8, 2, 2, 20));
+DIFF_CHECKPOINT_FUNC(3, 3, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 4, SAVE_LOW_FROM(4, 1, 3, 16));
+DIFF_CHECKPOINT_FUNC(2, 4, SAVE_LOW_FROM(8, 2, 3, 16));
+DIFF_CHECKPOINT_FUNC(3, 4, SAVE_LOW_FROM(12, 3, 3, 16));
+DIFF_CHECKPOINT_FUNC(4, 4, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 5, SAVE_LOW_FROM(4, 1, 4, 12));
+DIFF_CHECKPOINT_FUNC(2, 5, SAVE_LOW_FROM(8, 2, 4, 12));
+DIFF_CHECKPOINT_FUNC(3, 5, SAVE_LOW_FROM(12, 3, 4, 12));
+DIFF_CHECKPOINT_FUNC(4, 5, SAVE_LOW_FROM(16, 4, 4, 12));
+DIFF_CHECKPOINT_FUNC(5, 5, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 6, SAVE_LOW_FROM(4, 1, 5, 8));
+DIFF_CHECKPOINT_FUNC(2, 6, SAVE_LOW_FROM(8, 2, 5, 8));
+DIFF_CHECKPOINT_FUNC(3, 6, SAVE_LOW_FROM(12, 3, 5, 8));
+DIFF_CHECKPOINT_FUNC(4, 6, SAVE_LOW_FROM(16, 4, 5, 8));
+DIFF_CHECKPOINT_FUNC(5, 6, SAVE_LOW_FROM(20, 5, 5, 8));
+DIFF_CHECKPOINT_FUNC(6, 6, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 7, SAVE_LOW_FROM(4, 1, 6, 4));
+DIFF_CHECKPOINT_FUNC(2, 7, SAVE_LOW_FROM(8, 2, 6, 4));
+DIFF_CHECKPOINT_FUNC(3, 7, SAVE_LOW_FROM(12, 3, 6, 4));
+DIFF_CHECKPOINT_FUNC(4, 7, SAVE_LOW_FROM(16, 4, 6, 4));
+DIFF_CHECKPOINT_FUNC(5, 7, SAVE_LOW_FROM(20, 5, 6, 4));
+DIFF_CHECKPOINT_FUNC(6, 7, SAVE_LOW_FROM(24, 6, 6, 4));
+DIFF_CHECKPOINT_FUNC(7, 7, SKIP_LOW(32));
+DIFF_CHECKPOINT_FUNC(1, 8, SAVE_LOW_8_FROM(4, 1));
+DIFF_CHECKPOINT_FUNC(2, 8, SAVE_LOW_8_FROM(8, 2));
+DIFF_CHECKPOINT_FUNC(3, 8, SAVE_LOW_8_FROM(12, 3));
+DIFF_CHECKPOINT_FUNC(4, 8, SAVE_LOW_8_FROM(16, 4));
+DIFF_CHECKPOINT_FUNC(5, 8, SAVE_LOW_8_FROM(20, 5));
+DIFF_CHECKPOINT_FUNC(6, 8, SAVE_LOW_8_FROM(24, 6));
+DIFF_CHECKPOINT_FUNC(7, 8, SKIP_LOW(28));
+
+#endif
+
 //void _checkpoint()
 //{
 //  SAVE_REGS_8;
@@ -1,6 +1,5 @@
 import gdb
 import thumbulator
-import time
 import os
 import re
 
@@ -46,12 +45,15 @@ def run():
   thumbulator.bp.reset()
 
   if start_sim:
+    # One port file per GDB process so several trials can run at once
+    portfile = outdir + 'rsp.{}.port'.format(os.getpid())
     outf = open(simoutfile, 'w')
-    sim = thumbulator.start_sim(sim_path, binfile, outf)
-
-  time.sleep(1)
+    sim = thumbulator.start_sim(sim_path, binfile, outf, portfile)
+    port = thumbulator.wait_for_sim(sim, portfile)
+  else:
+    port = thumbulator.DEFAULT_PORT
 
-  thumbulator.setup(elffile)
+  thumbulator.setup(elffile, port)
 
   #debug = True
   #debug = False
@@ -71,11 +73,11 @@ def run():
 
     if start_sim:
       sim.kill()
+      sim.wait()
+      os.remove(portfile)
 
     gdb.execute('del')
 
-    time.sleep(1)
-
     gdb.execute('quit')
 
 
@@ -8,9 +8,12 @@ bp_list = []
 bp_metrics = {}
 exit_flag = False
 debug_flag = False
+fail_bp = None  # the scheduled power failure, see FailBP
 
 def reset():
+  global fail_bp
   gdb.execute('del')
+  fail_bp = None
 
   del bp_list[:]
   bp_metrics.clear()
@@ -85,37 +88,55 @@ class ERestore_BP(MetricBP):
     bp_metrics['fail'][-1]['wasted'] = wasted
 
 
-class FailBP(MyBP):
-  def __init__(self, spec, bp_type):
-    super(FailBP, self).__init__(spec, bp_type)
-    self.silent = True
+class FailBP(object):
+  """A power failure scheduled in the simulator, which stops the target with
+     SIGTRAP once the armed number of cycles has passed. Each failure takes a
+     single monitor packet to record the counters, reset the CPU and arm the
+     next one."""
+  def __init__(self, cycles):
+    global fail_bp
+    fail_bp = self
+    self.enabled = True
+    commands.stop_after(cycles)
+
+  def next_failure(self):
+    """Cycles until the next failure, or None to stop failing"""
+    return None
+
+  def _handler(self):
+    pass
 
   def handler(self):
     self._handler()
 
-    cycles = commands.total_cycles()
-    cycles_since = commands.cycles_since_fail()
     cur_pc = commands.get_pc()
-    bp_metrics['fail'].append({'time':cycles, 'last_fail' : cycles_since, 'pc':str(cur_pc), 'wasted': 0})
+    cmds = "counters; reset"
+    cycles = self.next_failure()
+    if cycles is None:
+      self.enabled = False
+    else:
+      cmds += "; stop-after {}".format(cycles)
 
-    commands.cpu_reset()
-    commands.cycle_reset()
+    counters = commands.monitor(cmds)
+    bp_metrics['fail'].append({'time': counters['cycles'], 'last_fail': counters['since_reset'], 'pc':str(cur_pc), 'wasted': 0})
 
 
 class FreqFailBP(FailBP):
   def __init__(self, freq, threshold):
     self.locations = []
     self.threshold = threshold
-    commands.writeword(hex(commands.MEMMAPIO.resetAfterCycles), freq)
-    spec = "*{} > {}".format(hex(commands.MEMMAPIO.cyclesSinceReset), freq)
-    super(FreqFailBP, self).__init__(spec, gdb.BP_WATCHPOINT)
+    self.freq = freq
+    super(FreqFailBP, self).__init__(freq)
+
+  def next_failure(self):
+    return self.freq
 
   def _handler(self):
     pc = commands.get_pc()
     self.locations.append(pc)
 
     if self.count_consecutive_fails(pc) > self.threshold:
-      self.delete()
+      self.enabled = False
       raise GDBExcept("{} failures at {}, no progress being made. Try increasing the number of cycles between failures!".format(self.threshold, pc))
 
 
@@ -132,43 +153,30 @@ class GaussFailBP(FailBP):
   def __init__(self, m, std):
     self.m = m
     self.std = std
+    super(GaussFailBP, self).__init__(self.next_failure())
+
+  def next_failure(self):
     r = -1
     while r < 0:
-      r = int(random.gauss(m, std))
-    commands.writeword(hex(commands.MEMMAPIO.resetAfterCycles), r)
-    spec = "*{} > {}".format(hex(commands.MEMMAPIO.cyclesSinceReset), r)
-    super(GaussFailBP, self).__init__(spec, gdb.BP_WATCHPOINT)
-
-  def _handler(self):
-    for bp in bp_list:
-      if isinstance(bp, GaussFailBP) and bp != self:
-        bp.delete()
-
-    GaussFailBP(self.m, self.std)
-
-    self.enabled = False
+      r = int(random.gauss(self.m, self.std))
+    return r
 
 class DebugFailBP(FailBP):
   def __init__(self, fails, skiplast=False):
-    r = fails.pop(0)
     self.fails = fails
     self.skiplast= skiplast
-    commands.writeword(hex(commands.MEMMAPIO.resetAfterCycles), r)
-    spec = "*{} > {}".format(hex(commands.MEMMAPIO.cyclesSinceReset), r)
-    super(DebugFailBP, self).__init__(spec, gdb.BP_WATCHPOINT)
-    self.silent = False
+    super(DebugFailBP, self).__init__(self.fails.pop(0))
 
-  def _handler(self):
-    pass
+  def next_failure(self):
+    if len(self.fails) == 0:
+      return None
+    return self.fails.pop(0)
 
   def handler(self):
-    self.enabled = False
-
     if len(self.fails) != 0 or not self.skiplast:
       super(DebugFailBP, self).handler()
-
-    if len(self.fails) != 0:
-      DebugFailBP(self.fails, self.skiplast)
+    else:
+      self.enabled = False
 
 
 
@@ -199,7 +207,10 @@ def dump_metrics(fname):
 def stop_handler(stop_event):
   """Handles stop events in GDB. We use this to give our breakpoints
      special functionality"""
-  if not hasattr(stop_event, 'breakpoints'):
+  if isinstance(stop_event, gdb.SignalEvent) and fail_bp is not None and fail_bp.enabled:
+    # The simulator stopped at the scheduled power failure
+    fail_bp.handler()
+  elif not hasattr(stop_event, 'breakpoints'):
     # Don't know what happened... Let's wrap this up.
     print "Umm... don't know how we got here... <stop_handler>"
     dump_metrics('error.log')
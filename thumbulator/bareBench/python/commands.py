@@ -2,6 +2,8 @@ import gdb
 import bp
 from objdumpfile import ObjDumpFile
 import subprocess
+import time
+import os
 
 class MEMMAPIO:
   cycles, cyclesMSB, wasteCycles, wasteCyclesH, \
@@ -30,6 +32,11 @@ def readgword(addr):
   output = gdb.execute("x/gwx {}".format(addr), False, True)
   return int(output.split()[1],16)
 
+def readblock(addr, length):
+  """Returns length bytes of memory from a given address. GDB moves large
+     blocks in a few binary packets, rather than a word at a time"""
+  return bytes(gdb.selected_inferior().read_memory(addr, length))
+
 def writeword(addr,val):
   gdb.execute("set *{}={}".format(addr, val))
 
@@ -39,21 +46,42 @@ def logging(on):
   else:
     writeword(MEMMAPIO.do_logging, 0)
 
-def start_sim(path, binfile, outf):
-  return subprocess.Popen([path, "-g", binfile], stdout=outf, stderr=outf)
+# Port the simulator listens on when it is not given -p
+DEFAULT_PORT = 27272
+
+def start_sim(path, binfile, outf, port_file):
+  """Starts the simulator on a free port; it writes the port to port_file once it is ready"""
+  if os.path.exists(port_file):
+    os.remove(port_file)
+  return subprocess.Popen([path, "-g", "-p", "0", "-r", port_file, binfile], stdout=outf, stderr=outf)
+
+def wait_for_sim(sim, port_file, timeout=30):
+  """Waits until a simulator from start_sim is ready for GDB and returns its port"""
+  deadline = time.time() + timeout
+  while not os.path.exists(port_file):
+    if sim.poll() is not None:
+      raise RuntimeError('simulator exited with code {} before accepting GDB'.format(sim.returncode))
+    if time.time() > deadline:
+      raise RuntimeError('simulator not ready after {} seconds'.format(timeout))
+    time.sleep(0.01)
+
+  f = open(port_file, 'r')
+  port = int(f.read())
+  f.close()
+  return port
 
 def exit_handler(exit_event):
   print 'exit_handler'
   #print "exitcode: {}".format(exit_event.exit_code)
   #gdb.execute("quit")
 
-def setup(fname):
+def setup(fname, port=DEFAULT_PORT):
   """
   Connects to thumbulator, registers our breakpoint handler, inserts our exit breakpoint
   """
   cmd = 'file {}'.format(fname)
   gdb.execute(cmd)
-  gdb.execute('target remote :272727')
+  gdb.execute('target remote :{}'.format(port))
   #gdb.execute("set confirm off")
   gdb.execute("set pagination off")
 
@@ -71,11 +99,30 @@ def setup(fname):
 def cont():
   gdb.execute("c")
 
+def monitor(cmds):
+  """Runs simulator monitor commands, separated by ';', in one packet and
+     returns their output as a dict of name: value"""
+  output = gdb.execute("monitor {}".format(cmds), False, True)
+  if 'reset' in cmds:
+    # The simulator changed the registers behind GDB's back
+    gdb.execute("maintenance flush register-cache", False, True)
+
+  values = {}
+  for field in output.split():
+    name, value = field.split('=')
+    values[name] = int(value, 0) if name != 'hash' else value
+  return values
+
+def stop_after(cycles):
+  """Makes the simulator stop with SIGTRAP after the given number of cycles"""
+  monitor("stop-after {}".format(cycles))
+
+def counters():
+  """Returns all the simulator counters at once"""
+  return monitor("counters")
+
 def get_hash():
-  gdb.execute("set *{}=1".format(hex(MEMMAPIO.md5_0)))
-  hi = gdb.execute("x/xg {}".format(MEMMAPIO.md5_1),False, True).split()[1]
-  lo = gdb.execute("x/xg {}".format(MEMMAPIO.md5_3),False, True).split()[1]
-  return hi + lo[2:]
+  return monitor("hash")['hash']
 
 def cycles_since_fail():
   return readword(MEMMAPIO.cyclesSinceReset)
@@ -0,0 +1,198 @@
+import argparse
+import collections
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# Measures how fast the simulator runs the benchmarks, as opposed to
+# stats.sh which measures how many simulated cycles they take.
+# Each result is appended to a JSON history file and compared against the
+# median of the last few runs on the same host, so slowdowns show up before
+# an overnight campaign does. Comparing with the median instead of the
+# previous run keeps one noisy run from hiding or faking a regression; a
+# slow drift across many changes is caught by pinning the baseline to a
+# known revision with --baseline.
+
+ROOTS = ['crc/', 'rsa/', 'FFT/', 'dijkstra/', 'picojpeg/',
+         'stringsearch/', 'sha/', 'basicmath/']
+
+# Simulator execution modes: extra sim_main flags for each
+MODES = collections.OrderedDict([('cached', []), ('interp', ['-i'])])
+
+PERF_EVENTS = 'cycles,instructions,branch-misses,cache-misses'
+
+exit_re = re.compile(r'^\s*([0-9]+) (ticks|instructions)$')
+
+# Runs sim_main once and returns wall time, peak RSS and the simulated
+# cycle and instruction counts it prints on exit
+def run_sim(cmd, perf_out=None):
+  if perf_out:
+    cmd = ['perf', 'stat', '-x', ',', '-e', PERF_EVENTS, '-o', perf_out, '--'] + cmd
+
+  devnull = open(os.devnull, 'w')
+  start = time.time()
+  p = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=devnull)
+
+  # The memory trace can be huge; only keep the exit report
+  counts = {}
+  for line in p.stdout:
+    m = exit_re.match(line.decode())
+    if m:
+      counts[m.group(2)] = int(m.group(1))
+  p.stdout.close()
+
+  # wait4() rather than wait() to get the child's peak RSS
+  _, status, usage = os.wait4(p.pid, 0)
+  p.returncode = status
+  elapsed = time.time() - start
+  devnull.close()
+
+  return {'seconds': elapsed,
+          'peak_rss_kb': usage.ru_maxrss,
+          'ticks': counts.get('ticks', 0),
+          'instructions': counts.get('instructions', 0)}
+
+def read_perf(path):
+  counters = {}
+  for line in open(path):
+    fields = line.strip().split(',')
+    if len(fields) > 2 and fields[0].isdigit():
+      counters[fields[2]] = int(fields[0])
+  return counters
+
+# Time to start the simulator and reach the first instruction: an empty
+# image makes cpu_reset() stop right after memory is set up
+def startup_time(sim, runs):
+  empty = tempfile.NamedTemporaryFile(suffix='.bin')
+  best = min(run_sim([sim, empty.name])['seconds'] for _ in range(runs))
+  empty.close()
+  return best
+
+def bench(sim, root, mode, runs, perf):
+  cmd = [sim] + MODES[mode] + [os.path.join(root, 'main.bin')]
+  perf_out = None
+  if perf:
+    f = tempfile.NamedTemporaryFile(suffix='.perf', delete=False)
+    perf_out = f.name
+    f.close()
+
+  # Keep the fastest run; slower ones measure the host, not the simulator
+  best = None
+  for _ in range(runs):
+    r = run_sim(cmd, perf_out)
+    if perf:
+      r['perf'] = read_perf(perf_out)
+    if best is None or r['seconds'] < best['seconds']:
+      best = r
+
+  if perf:
+    os.remove(perf_out)
+
+  if best['instructions'] == 0:
+    raise RuntimeError('{} did not report an instruction count'.format(' '.join(cmd)))
+
+  best['mips'] = best['instructions'] / best['seconds'] / 1e6
+  best['ns_per_insn'] = best['seconds'] * 1e9 / best['instructions']
+  return best
+
+def git_revision():
+  try:
+    return subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD']).decode().strip()
+  except (OSError, subprocess.CalledProcessError):
+    return 'unknown'
+
+def load_history(path):
+  if not os.path.exists(path):
+    return []
+  f = open(path, 'r')
+  history = json.load(f)
+  f.close()
+  return history
+
+def median(values):
+  values = sorted(values)
+  mid = len(values) // 2
+  if len(values) % 2:
+    return values[mid]
+  return (values[mid - 1] + values[mid]) / 2.0
+
+# Picks the runs to compare against: those of the baseline revision if one
+# is given, otherwise the last window runs on this host
+def baseline_runs(history, host, window, revision=None):
+  if revision:
+    return [h for h in history if h['revision'] == revision]
+  return [h for h in history if h['host'] == host][-window:]
+
+# Flags results whose host time per instruction grew by more than threshold
+# over their median in the baseline runs
+def find_regressions(baseline, current, threshold):
+  regressions = []
+  for key, r in current['results'].items():
+    old = [h['results'][key]['ns_per_insn'] for h in baseline if key in h['results']]
+    if not old:
+      continue
+    change = r['ns_per_insn'] / median(old) - 1
+    if change > threshold:
+      regressions.append((key, median(old), r['ns_per_insn'], change))
+
+  old = median([h['startup_seconds'] for h in baseline])
+  change = current['startup_seconds'] / old - 1
+  if change > threshold:
+    regressions.append(('startup', old, current['startup_seconds'], change))
+
+  return regressions
+
+def main():
+  parser = argparse.ArgumentParser(description='Benchmark simulator throughput')
+  parser.add_argument('--sim', default='../sim_main', help='simulator binary')
+  parser.add_argument('--roots', nargs='+', default=ROOTS, help='benchmark directories')
+  parser.add_argument('--modes', nargs='+', default=list(MODES.keys()), choices=list(MODES.keys()))
+  parser.add_argument('--runs', type=int, default=3, help='runs per benchmark, fastest is kept')
+  parser.add_argument('--perf', action='store_true', help='also record perf stat counters')
+  parser.add_argument('--history', default='simbench.json', help='JSON history file')
+  parser.add_argument('--threshold', type=float, default=0.05,
+                      help='relative slowdown reported as a regression')
+  parser.add_argument('--window', type=int, default=5,
+                      help='number of previous runs whose median is the baseline')
+  parser.add_argument('--baseline', metavar='REVISION',
+                      help='compare against the runs of this revision instead')
+  args = parser.parse_args()
+
+  current = {'time': time.strftime('%Y-%m-%d %H:%M:%S'),
+             'revision': git_revision(),
+             'host': platform.node(),
+             'startup_seconds': startup_time(args.sim, args.runs),
+             'results': {}}
+
+  print('{:<16}{:<8}{:>14}{:>10}{:>10}{:>12}'.format('benchmark', 'mode', 'instructions', 'MIPS', 'ns/insn', 'peak RSS'))
+  for root in args.roots:
+    for mode in args.modes:
+      r = bench(args.sim, root, mode, args.runs, args.perf)
+      current['results']['{}:{}'.format(root.strip('/'), mode)] = r
+      print('{:<16}{:<8}{:>14}{:>10.2f}{:>10.1f}{:>9} MB'.format(root.strip('/'), mode, r['instructions'],
+            r['mips'], r['ns_per_insn'], r['peak_rss_kb'] // 1024))
+  print('startup: {:.1f} ms'.format(current['startup_seconds'] * 1e3))
+
+  history = load_history(args.history)
+  baseline = baseline_runs(history, current['host'], args.window, args.baseline)
+  if args.baseline and not baseline:
+    print('No runs of revision {} in {}'.format(args.baseline, args.history))
+  regressions = find_regressions(baseline, current, args.threshold) if baseline else []
+  since = args.baseline or 'median of last {} runs'.format(len(baseline))
+  for key, old, new, change in regressions:
+    print('REGRESSION {}: {:.4g} -> {:.4g} (+{:.1f}%) since {}'.format(key, old, new, change * 100, since))
+
+  history.append(current)
+  f = open(args.history, 'w')
+  json.dump(history, f, indent=1, sort_keys=True)
+  f.close()
+
+  return 1 if regressions else 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,59 @@
+import subprocess
+import sys
+
+# Where timing.s stores its results; must match RESULTS in timing.s
+RESULTS = 0x40001000
+
+def read_reference(path):
+  reference = []
+  for line in open(path):
+    line = line.split('#')[0].split()
+    if len(line) == 2:
+      reference.append((line[0], int(line[1])))
+  return reference
+
+# timing.s stores each measurement to the next word of RESULTS. The
+# simulator's memory trace (PRINT_MEM_OPS) lists every program store as
+#   cycles  instructions  W  address  old  new
+def read_results(sim, binary, count):
+  out = subprocess.Popen([sim, binary], stdout=subprocess.PIPE, stderr=open('/dev/null', 'w')).communicate()[0]
+  results = [None] * count
+  for line in out.decode().splitlines():
+    fields = line.split('\t')
+    if len(fields) != 6 or fields[2] != 'W':
+      continue
+    index = (int(fields[3], 16) - RESULTS) // 4
+    if 0 <= index < count:
+      results[index] = int(fields[5])
+  return results
+
+def main():
+  if len(sys.argv) != 4:
+    print('Usage: python check_timing.py <sim_main> <timing.bin> <reference.txt>')
+    return 2
+
+  reference = read_reference(sys.argv[3])
+  results = read_results(sys.argv[1], sys.argv[2], len(reference))
+
+  if results[0] is None:
+    print('No results found: is the simulator built with PRINT_MEM_OPS?')
+    return 2
+
+  # The first benchmark is empty and measures the timing code itself
+  overhead = results[0]
+  failures = 0
+  for (name, expected), measured in zip(reference, results):
+    if measured is None:
+      status = 'MISSING'
+    else:
+      measured -= overhead
+      status = 'ok' if measured == expected else 'MISMATCH'
+    if status != 'ok':
+      failures += 1
+    print('{:<16}{:>9}{:>9}  {}'.format(name, expected, str(measured), status))
+
+  print('{} of {} instructions match the reference'.format(len(reference) - failures, len(reference)))
+  return 1 if failures else 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,270 @@
+
+/* timing.s */
+/* Instruction timing microbenchmarks for the simulator.
+ * Each benchmark reads the cycle counter from the simulator's memory-mapped
+ * counters, runs the instruction under test, reads the counter again and
+ * stores the difference to the next word of RESULTS. check_timing.py
+ * subtracts the empty benchmark and compares against reference.txt, which
+ * lists the benchmarks in the same order as they appear here.
+ *
+ * Registers r8, r9 and r10 hold the counter address, the next result slot
+ * and the start time, so instructions under test may clobber r0-r7. */
+.cpu cortex-m0
+.syntax unified
+.thumb
+
+.equ MMIO_CYCLES, 0x80000000
+.equ RESULTS,     0x40001000
+.equ BUFFER,      0x40002000
+
+.word   0x407FFFFC  /* stack top address */
+.word   _start      /* 1 Reset */
+
+/* Read the start time; nothing after this may change the flags */
+.macro begin
+    mov r7, r8
+    ldr r6, [r7]
+    mov r10, r6
+.endm
+
+/* Read the end time and record the difference */
+.macro end
+    mov r7, r8
+    ldr r5, [r7]
+    mov r6, r10
+    subs r5, r5, r6
+    mov r4, r9
+    str r5, [r4]
+    adds r4, #4
+    mov r9, r4
+.endm
+
+/* Time a single instruction */
+.macro bench insn:vararg
+    begin
+    \insn
+    end
+.endm
+
+/* Time a load or store with r0 pointing at BUFFER and r2 = 0 */
+.macro bench_mem insn:vararg
+    ldr r0, =BUFFER
+    movs r2, #0
+    bench \insn
+.endm
+
+/* Time an instruction that reads a word-aligned label 9 */
+.macro bench_lit insn:vararg
+    begin
+    \insn
+    end
+    b 8f
+.align 2
+9:  .word 0x12345678
+8:
+.endm
+
+/* Time PUSH, then drop what it pushed */
+.macro bench_push n, regs:vararg
+    begin
+    push {\regs}
+    end
+    add sp, #(4*\n)
+.endm
+
+/* Make room on the stack, then time POP */
+.macro bench_pop n, regs:vararg
+    sub sp, #(4*\n)
+    begin
+    pop {\regs}
+    end
+.endm
+
+/* Time POP into the PC; the popped address is the end of the benchmark */
+.macro bench_pop_pc n, regs:vararg
+    sub sp, #(4*\n)
+    adr r0, 9f
+    adds r0, #1
+    str r0, [sp, #(4*(\n-1))]
+    begin
+    pop {\regs}
+.align 2
+9:
+    end
+.endm
+
+/* Time a branch to label 9, placed right after it */
+.macro bench_branch insn:vararg
+    begin
+    \insn
+9:
+    end
+.endm
+
+/* Time a branch through r0 to the word-aligned label 9 */
+.macro bench_reg_branch insn:vararg
+    adr r0, 9f
+    adds r0, #1
+    begin
+    \insn
+.align 2
+9:
+    end
+.endm
+
+/* Literal pool out of the way of the benchmarks */
+.macro pool
+    b 8f
+    .ltorg
+8:
+.endm
+
+.thumb_func
+.global _start
+_start:
+    ldr r0, =MMIO_CYCLES
+    mov r8, r0
+    ldr r0, =RESULTS
+    mov r9, r0
+
+    /* Measurement overhead */
+    begin
+    end
+
+    /* ALU */
+    movs r0, #1
+    movs r1, #2
+    mov r12, r1
+    bench movs r0, #1
+    bench movs r0, r1
+    bench mov r12, r0
+    bench mov r0, r12
+    bench adds r0, r1, #3
+    bench adds r0, #200
+    bench adds r0, r0, r1
+    bench add r0, r12
+    bench adcs r0, r1
+    bench add r0, sp, #8
+    bench add sp, #0
+    bench sub sp, #0
+    bench_lit adr r0, 9f
+    bench subs r0, r1, #1
+    bench subs r0, #1
+    bench subs r0, r0, r1
+    bench sbcs r0, r1
+    bench rsbs r0, r1, #0
+    bench muls r0, r1, r0
+    bench cmp r0, #1
+    bench cmp r0, r1
+    bench cmp r0, r12
+    bench tst r0, r1
+    bench ands r0, r1
+    bench eors r0, r1
+    bench orrs r0, r1
+    bench bics r0, r1
+    bench mvns r0, r1
+    pool
+
+    /* Shifts and extends */
+    bench lsls r0, r1, #2
+    bench lsrs r0, r1, #2
+    bench asrs r0, r1, #2
+    bench lsls r0, r1
+    bench lsrs r0, r1
+    bench asrs r0, r1
+    bench rors r0, r1
+    bench sxtb r0, r1
+    bench sxth r0, r1
+    bench uxtb r0, r1
+    bench uxth r0, r1
+    bench rev r0, r1
+    bench rev16 r0, r1
+    pool
+
+    /* Loads and stores */
+    bench_mem ldr r1, [r0, #4]
+    bench_mem ldr r1, [r0, r2]
+    bench_mem ldr r1, [sp, #0]
+    bench_lit ldr r1, 9f
+    bench_mem ldrb r1, [r0, #1]
+    bench_mem ldrb r1, [r0, r2]
+    bench_mem ldrh r1, [r0, #2]
+    bench_mem ldrh r1, [r0, r2]
+    bench_mem ldrsb r1, [r0, r2]
+    bench_mem ldrsh r1, [r0, r2]
+    bench_mem str r1, [r0, #4]
+    bench_mem str r1, [r0, r2]
+    bench_mem str r1, [sp, #0]
+    bench_mem strb r1, [r0, #1]
+    bench_mem strb r1, [r0, r2]
+    bench_mem strh r1, [r0, #2]
+    bench_mem strh r1, [r0, r2]
+    pool
+
+    /* Load and store multiple */
+    bench_mem ldm r0!, {r1}
+    bench_mem ldm r0!, {r1-r2}
+    bench_mem ldm r0!, {r1-r3}
+    bench_mem ldm r0!, {r1-r4}
+    bench_mem ldm r0!, {r1-r5}
+    bench_mem ldm r0!, {r1-r6}
+    bench_mem ldm r0!, {r1-r7}
+    bench_mem ldm r0, {r0-r7}
+    pool
+    bench_mem stm r0!, {r1}
+    bench_mem stm r0!, {r1-r2}
+    bench_mem stm r0!, {r1-r3}
+    bench_mem stm r0!, {r1-r4}
+    bench_mem stm r0!, {r1-r5}
+    bench_mem stm r0!, {r1-r6}
+    bench_mem stm r0!, {r1-r7}
+    ldr r1, =BUFFER
+    bench stm r1!, {r0-r7}
+    pool
+
+    /* Push and pop */
+    bench_push 1, r0
+    bench_push 2, r0-r1
+    bench_push 3, r0-r2
+    bench_push 4, r0-r3
+    bench_push 5, r0-r4
+    bench_push 6, r0-r5
+    bench_push 7, r0-r6
+    bench_push 8, r0-r7
+    bench_push 1, lr
+    bench_push 5, r0-r3, lr
+    bench_push 9, r0-r7, lr
+    bench_pop 1, r0
+    bench_pop 2, r0-r1
+    bench_pop 3, r0-r2
+    bench_pop 4, r0-r3
+    bench_pop 5, r0-r4
+    bench_pop 6, r0-r5
+    bench_pop 7, r0-r6
+    bench_pop 8, r0-r7
+    bench_pop_pc 1, pc
+    bench_pop_pc 5, r0-r3, pc
+    bench_pop_pc 9, r0-r7, pc
+    pool
+
+    /* Branches */
+    cmp r0, r0
+    bench_branch b 9f
+    cmp r0, r0
+    bench_branch beq 9f
+    cmp r0, r0
+    bench_branch bne 9f
+    bench_branch bl 9f
+    bench_reg_branch bx r0
+    bench_reg_branch blx r0
+    bench_reg_branch mov pc, r0
+    movs r0, #0
+    begin
+    add pc, r0
+    b .
+    end
+
+    swi 1
+    b .
+    .ltorg
+.end
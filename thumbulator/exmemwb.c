@@ -346,12 +346,38 @@ u32 (* executeJumpTable[64])() = { \
     exmemwb_error\
 };
 
+// Returns the function that executes the passed instruction, resolving
+// the secondary jump tables so the result can be cached with the decoding
+u32 (* exwbmem_lookup(const u16 pInsn))(void)
+{
+    switch(pInsn >> 10)
+    {
+        case 6:  return executeJumpTable6[(pInsn >> 9) & 0x1];
+        case 7:  return executeJumpTable7[(pInsn >> 9) & 0x1];
+        case 16: return executeJumpTable16[(pInsn >> 6) & 0xF];
+        case 17: return executeJumpTable17[(pInsn >> 7) & 0x7];
+        case 20: return executeJumpTable20[(pInsn >> 9) & 0x1];
+        case 21: return executeJumpTable21[(pInsn >> 9) & 0x1];
+        case 22: return executeJumpTable22[(pInsn >> 9) & 0x1];
+        case 23: return executeJumpTable23[(pInsn >> 9) & 0x1];
+        case 44: return executeJumpTable44[(pInsn >> 6) & 0xF];
+        case 46: return executeJumpTable46[(pInsn >> 6) & 0xF];
+        case 47: return executeJumpTable47[(pInsn >> 9) & 0x1];
+        default: return executeJumpTable[pInsn >> 10];
+    }
+}
+
 void exwbmem(const u16 pInsn)
+{
+    exwbmem_translated(pInsn, executeJumpTable[pInsn >> 10]);
+}
+
+void exwbmem_translated(const u16 pInsn, u32 (* pExecute)(void))
 {
     ++insnCount;
     insn = pInsn;
     
-    unsigned int insnTicks = executeJumpTable[pInsn >> 10]();
+    unsigned int insnTicks = pExecute();
     INCREMENT_CYCLES(insnTicks);
     
     // Update the systick unit and look for resets
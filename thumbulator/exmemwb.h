@@ -105,6 +105,8 @@ void do_cflag(u32 a, u32 b, u32 carry);
 #define alu_write_pc(x) do{takenBranch = 1; cpu_set_pc((x) | 0x1);} while(0)
 
 void exwbmem(const u16 pInsn);
+void exwbmem_translated(const u16 pInsn, u32 (* pExecute)(void)); // Same as exwbmem(), with the execute function already looked up
+u32 (* exwbmem_lookup(const u16 pInsn))(void);
 
 // Timing model
 #define TIMING_BRANCH       2
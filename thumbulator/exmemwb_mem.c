@@ -95,7 +95,7 @@ u32 pop()
     
     cpu_set_sp(address);
     
-    return 1 + numLoaded + takenBranch ? TIMING_PC_UPDATE : 0;
+    return 1 + numLoaded + (takenBranch ? TIMING_PC_UPDATE : 0);
 }
 
 // Push multiple reg values to the stack and update SP
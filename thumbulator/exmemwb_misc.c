@@ -70,7 +70,8 @@ u32 mov_r()
     else
         cpu_set_gpr(decoded.rD, opA);
     
-    return 1;
+    // Instruction takes two cycles when PC is the destination
+    return (decoded.rD == GPR_PC) ? TIMING_PC_UPDATE : 1;
 }
 
 // MOVS - copy the low source register value to the destination low register
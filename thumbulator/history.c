@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "history.h"
+#include "exmemwb.h"
+#include "translate.h"
+
+// Execution history for reverse debugging
+// RAM and flash are too big to copy, so every store to them logs the word
+// it overwrites. Everything else the simulator keeps (CPU, systick, the
+// memory-mapped counters) is small and is copied into a snapshot every
+// historyInterval cycles. Going back to a snapshot undoes the logged stores
+// made since; the simulator is deterministic, so replaying forward from
+// there reaches any later position exactly.
+
+typedef struct {
+    u32 *word;
+    u32 old;
+} HISTORY_STORE;
+
+typedef struct {
+    u64 position;
+    u32 storeCount;             // Length of the store log when taken
+    struct CPU cpu;
+    struct SYSTICK systick;
+    u32 mmio[MMIO_COUNT];       // Includes cycleCount and the other counters
+    bool addToWasted;
+} HISTORY_SNAPSHOT;
+
+bool historyEnabled = 0;
+u64 historyNextSnapshot = ~0ULL;
+
+static u32 historyInterval = HISTORY_DEFAULT_INTERVAL;
+
+static HISTORY_STORE *stores = NULL;
+static u32 storeCount = 0;
+static u32 storeCapacity = 0;
+
+static HISTORY_SNAPSHOT *snapshots = NULL;
+static u32 snapshotCount = 0;
+static u32 snapshotCapacity = 0;
+
+static int savedStdout = -1;
+
+// Drops every snapshot before the passed one, and the stores only they need
+static void historyDropBefore(u32 snapshot)
+{
+    u32 shift = snapshots[snapshot].storeCount;
+    u32 i;
+
+    memmove(stores, stores + shift, (storeCount - shift) * sizeof(HISTORY_STORE));
+    storeCount -= shift;
+
+    memmove(snapshots, snapshots + snapshot, (snapshotCount - snapshot) * sizeof(HISTORY_SNAPSHOT));
+    snapshotCount -= snapshot;
+
+    for(i = 0; i < snapshotCount; ++i)
+        snapshots[i].storeCount -= shift;
+}
+
+void historyStart(u32 interval)
+{
+    historyEnabled = 1;
+    historyInterval = interval;
+    historyReset();
+}
+
+void historyStop(void)
+{
+    historyEnabled = 0;
+    historyNextSnapshot = ~0ULL;
+
+    free(stores);
+    stores = NULL;
+    storeCount = storeCapacity = 0;
+
+    free(snapshots);
+    snapshots = NULL;
+    snapshotCount = snapshotCapacity = 0;
+}
+
+void historyReset(void)
+{
+    storeCount = 0;
+    snapshotCount = 0;
+
+    if(historyEnabled)
+        historySnapshot();
+}
+
+void historySnapshot(void)
+{
+    HISTORY_SNAPSHOT *snapshot;
+    int i;
+
+    // Several snapshots at one position would make historyFind() ambiguous
+    if(snapshotCount != 0 && snapshots[snapshotCount - 1].position == insnCount)
+        --snapshotCount;
+
+    if(snapshotCount == snapshotCapacity)
+    {
+        if(snapshotCapacity == HISTORY_MAX_SNAPSHOTS)
+            historyDropBefore(snapshotCount / 2);
+        else
+        {
+            snapshotCapacity = snapshotCapacity ? 2 * snapshotCapacity : 64;
+            snapshots = realloc(snapshots, snapshotCapacity * sizeof(HISTORY_SNAPSHOT));
+            if(snapshots == NULL)
+            {
+                fprintf(stderr, "Error: Out of memory for execution history\n");
+                sim_exit(1);
+            }
+        }
+    }
+
+    snapshot = &snapshots[snapshotCount++];
+    snapshot->position = insnCount;
+    snapshot->storeCount = storeCount;
+    snapshot->cpu = cpu;
+    snapshot->systick = systick;
+    for(i = 0; i < MMIO_COUNT; ++i)
+        snapshot->mmio[i] = *(mmio[i]);
+    snapshot->addToWasted = addToWasted;
+
+    historyNextSnapshot = cycleCount + historyInterval;
+}
+
+void historyLogStore(u32 *word)
+{
+    if(storeCount == storeCapacity)
+    {
+        if(storeCapacity == HISTORY_MAX_STORES)
+        {
+            // Keep the newest half of the log, starting at a snapshot
+            u32 keep = 1;
+            while(keep < snapshotCount && snapshots[keep].storeCount < storeCount / 2)
+                ++keep;
+
+            if(keep == snapshotCount)
+                historySnapshot();
+
+            historyDropBefore(keep < snapshotCount ? keep : snapshotCount - 1);
+        }
+        else
+        {
+            storeCapacity = storeCapacity ? 2 * storeCapacity : 4096;
+            stores = realloc(stores, storeCapacity * sizeof(HISTORY_STORE));
+            if(stores == NULL)
+            {
+                fprintf(stderr, "Error: Out of memory for execution history\n");
+                sim_exit(1);
+            }
+        }
+    }
+
+    stores[storeCount].word = word;
+    stores[storeCount].old = *word;
+    ++storeCount;
+}
+
+int historyFind(u64 position)
+{
+    int i;
+
+    for(i = (int)snapshotCount - 1; i >= 0; --i)
+    {
+        if(snapshots[i].position <= position)
+            return i;
+    }
+
+    return -1;
+}
+
+u64 historyPosition(int snapshot)
+{
+    return snapshots[snapshot].position;
+}
+
+void historyRestore(int snapshot)
+{
+    const HISTORY_SNAPSHOT *restored = &snapshots[snapshot];
+    int i;
+
+    // Undo the stores newest first, so each word ends with its oldest value
+    while(storeCount > restored->storeCount)
+    {
+        --storeCount;
+        *(stores[storeCount].word) = stores[storeCount].old;
+    }
+
+    // Restored stores may have been code
+    translateFlush();
+
+    cpu = restored->cpu;
+    systick = restored->systick;
+    for(i = 0; i < MMIO_COUNT; ++i)
+        *(mmio[i]) = restored->mmio[i];
+    insnCount = restored->position;
+    addToWasted = restored->addToWasted;
+
+    snapshotCount = snapshot + 1;
+    historyNextSnapshot = cycleCount + historyInterval;
+}
+
+void historyMute(bool mute)
+{
+    fflush(stdout);
+
+    if(mute && savedStdout == -1)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+
+        savedStdout = dup(STDOUT_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+    else if(!mute && savedStdout != -1)
+    {
+        dup2(savedStdout, STDOUT_FILENO);
+        close(savedStdout);
+        savedStdout = -1;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef HISTORY_HEADER
+#define HISTORY_HEADER
+
+#include "sim_support.h"
+
+// Execution history settings
+#define HISTORY_DEFAULT_INTERVAL 10000      // Cycles between snapshots
+#define HISTORY_MAX_STORES      (1 << 22)   // Logged stores kept before the oldest history is dropped
+#define HISTORY_MAX_SNAPSHOTS   (1 << 16)   // Snapshots kept before the oldest history is dropped
+
+// Positions in the history are instruction counts: position N is the
+// state just before the simulator executes its Nth instruction
+
+// Set while history is recorded
+extern bool historyEnabled;
+
+// Cycle count at which the main loop should call historySnapshot()
+// Never reached while history is off
+extern u64 historyNextSnapshot;
+
+// Starts recording, taking a snapshot every interval cycles
+void historyStart(u32 interval);
+
+// Stops recording and frees the history
+void historyStop(void);
+
+// Forgets the history and starts again from the current state
+// Called whenever the debugger changes registers or memory, since a
+// replay would not repeat the change
+void historyReset(void);
+
+// Records the current state as the start of a replay
+void historySnapshot(void);
+
+// Logs the old value of a word of RAM or flash before a store changes it
+void historyLogStore(u32 *word);
+#define historyStore(word) do { if(historyEnabled) historyLogStore(word); } while(0)
+
+// Returns the index of the latest snapshot at or before position, or -1
+// if position is older than the history
+int historyFind(u64 position);
+
+// Returns the position of a snapshot
+u64 historyPosition(int snapshot);
+
+// Puts the simulator back in the state of a snapshot, undoing every
+// store since, and drops the history after it. Replaying forward with
+// sim_step() records it again.
+void historyRestore(int snapshot);
+
+// Silences the program's standard output during a replay so traces and
+// program output are not printed twice
+void historyMute(bool mute);
+
+#endif
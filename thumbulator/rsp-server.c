@@ -56,6 +56,7 @@
 #include "rsp-server.h"
 #include "exmemwb.h"
 #include "sim_support.h"
+#include "history.h"
 
 /* Define to log each packet */
 #define RSP_TRACE  0
@@ -103,13 +104,29 @@ enum target_signal {
     registers, and (in our implementation) an end-of-string (0)
     character. Adding the EOS allows us to print out the packet as a
     string. So at least NUMREGBYTES*2 + 1 (for the 'G' or the EOS) are needed
-    for register packets */
-#define GDB_BUF_MAX  ((NUM_REGS) * 8 + 1)
+    for register packets. Monitor commands and their replies are hex encoded,
+    and memory transfers are faster the more fits in a packet, so we offer
+    GDB much more room than that. */
+#define GDB_BUF_MAX  0x4000
+
+/*! Size of the buffer for characters read from the client */
+#define RSP_IN_BUF_MAX  4096
+
+/*! Separator between monitor commands sent in one qRcmd packet */
+#define MONITOR_CMD_SEP  ";"
 
 
 /*! String to map hex digits to chars */
 static const char hexchars[]="0123456789abcdef";
 
+/*! Characters read from the client but not yet used by get_rsp_char () */
+static struct
+{
+  unsigned char  data[RSP_IN_BUF_MAX];
+  int            len;
+  int            pos;
+} rsp_in;
+
 /*! Data structure for RSP buffers. Can't be null terminated, since it may
   include zero bytes */
 struct rsp_buf
@@ -120,14 +137,22 @@ struct rsp_buf
 
 struct RSP rsp;
 
+/*! Breakpoint and write watchpoint filters, see rsp-server.h */
+unsigned char  rsp_bp_map[(2 * RSP_BP_REGION_BITS) >> 3];
+unsigned short rsp_watch_pages[2 * RSP_WATCH_REGION_PAGES];
+
 /* Forward declarations of static functions */
+static void               rsp_write_port_file ();
 static void               rsp_get_client ();
 static void               rsp_client_request ();
+static void               rsp_update_attention ();
 static void               rsp_client_close ();
 static void               put_packet (struct rsp_buf *buf);
 static void               put_str_packet (const char *str);
 static struct rsp_buf    *get_packet ();
 static void               put_rsp_char (char  c);
+static void               put_rsp_buf (const char *data,
+				       int         len);
 static int                get_rsp_char ();
 static int                rsp_unescape (char *data,
 					int   len);
@@ -139,6 +164,10 @@ static struct mp_entry   *mp_hash_lookup (enum mp_type       type,
 					  unsigned long int  addr);
 static struct mp_entry   *mp_hash_delete (enum mp_type       type,
 					  unsigned long int  addr);
+static struct mp_entry   *mp_watch_lookup (unsigned long int  addr);
+static void               rsp_count_watch_pages (unsigned long int  addr,
+						 unsigned long int  len,
+						 int                delta);
 static int                hex (int  c);
 static void               reg2hex (unsigned long int  val,
 				   char              *buf);
@@ -156,14 +185,24 @@ static void               rsp_continue_generic (unsigned long int  addr,
 static void               rsp_read_all_regs ();
 static void               rsp_write_all_regs (struct rsp_buf *buf);
 static void               rsp_read_mem (struct rsp_buf *buf);
+static void               rsp_read_mem_bin (struct rsp_buf *buf);
+static void               rsp_memory_map (struct rsp_buf *buf);
 static void               rsp_write_mem (struct rsp_buf *buf);
 static void               rsp_read_reg (struct rsp_buf *buf);
 static void               rsp_write_reg (struct rsp_buf *buf);
 static void               rsp_query (struct rsp_buf *buf);
+static unsigned long long int  rsp_hash_state ();
+static int                rsp_monitor (const char *cmd,
+				       char       *out);
 static void               rsp_command (struct rsp_buf *buf);
 static void               rsp_set (struct rsp_buf *buf);
 static void               rsp_restart ();
 static void               rsp_step (struct rsp_buf *buf);
+static unsigned long long int  rsp_replay (unsigned long long int  end,
+					   int                     find_stop,
+					   unsigned int           *watch);
+static void               rsp_reverse_step ();
+static void               rsp_reverse_continue ();
 static void               rsp_step_with_signal (struct rsp_buf *buf);
 static void               rsp_step_generic (unsigned long int  addr,
 					    unsigned long int  except);
@@ -185,10 +224,17 @@ void set_pc(unsigned int val)
 /*---------------------------------------------------------------------------*/
 /*!Initialize the Remote Serial Protocol connection
 
-   Set up the central data structures.                                       */
+   Set up the central data structures.
+
+   @param[in] port       TCP port to listen on. 0 lets the OS choose a free
+                         port, which is then reported on stdout and in
+                         port_file.
+   @param[in] port_file  If not NULL, file to write the port number to once
+                         the simulator is ready to accept GDB.               */
 /*---------------------------------------------------------------------------*/
 void
-rsp_init ()
+rsp_init (unsigned int  port,
+	  const char   *port_file)
 {
   /* Clear out the central data structure */
   rsp.client_waiting =  0;		/* GDB client is not waiting for us */
@@ -197,7 +243,12 @@ rsp_init ()
   //rsp.start_addr     = EXCEPT_RESET;	/* Default restart point */
   //JVDW FIX
   rsp.start_addr = 0;
-  rsp.port = 272727;
+  rsp.port = port;
+  rsp.port_file = port_file;
+  rsp.attention = 0;
+  rsp.replaying = 0;
+  rsp.replay_hit = 0;
+  rsp.stop_cycle = RSP_NO_STOP;
   rsp.stalled = 1;
   rsp.stepping = 0;
 
@@ -249,9 +300,32 @@ handle_rsp ()
   /* Get a RSP client request */
   rsp_client_request ();
 
+  /* If that resumed the target, work out what needs checking as it runs */
+  if (!rsp.stalled)
+    {
+      rsp_update_attention ();
+    }
+
 }	/* handle_rsp () */
 
 
+/*---------------------------------------------------------------------------*/
+/*!Work out whether rsp_check_stall () must run after every instruction
+
+   Breakpoints and cycle deadlines are tested directly by
+   rsp_needs_attention (). Stepping and the cycles-since-reset watchpoint on
+   WATCHPOINT_ADDR cannot be, so they set rsp.attention. Only called when
+   the target resumes, since neither changes while it runs.                  */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_update_attention ()
+{
+  rsp.attention = rsp.stepping ||
+    (NULL != mp_hash_lookup (WP_WRITE, WATCHPOINT_ADDR));
+
+}	/* rsp_update_attention () */
+
+
 /*---------------------------------------------------------------------------*/
 /*!Note an exception for future processing
 
@@ -302,6 +376,44 @@ rsp_exception (unsigned long int  except)
 }	/* rsp_exception () */
 
 
+/*---------------------------------------------------------------------------*/
+/*!Tell whoever started the simulator that it is ready for GDB
+
+   Writes the port we are listening on to rsp.port_file, if there is one. The
+   file is written under a temporary name and then renamed, so a harness
+   polling for it never reads a partial port number.                         */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_write_port_file ()
+{
+  char  tmp_name[FILENAME_MAX];
+  FILE *fd;
+
+  if (NULL == rsp.port_file)
+    {
+      return;
+    }
+
+  snprintf (tmp_name, sizeof (tmp_name), "%s.tmp", rsp.port_file);
+  fd = fopen (tmp_name, "w");
+  if (NULL == fd)
+    {
+      fprintf (stderr, "ERROR: Cannot write RSP port file %s\n", tmp_name);
+      exit (1);
+    }
+
+  fprintf (fd, "%u\n", rsp.port);
+  fclose (fd);
+
+  if (rename (tmp_name, rsp.port_file))
+    {
+      fprintf (stderr, "ERROR: Cannot write RSP port file %s\n",
+	       rsp.port_file);
+      exit (1);
+    }
+}	/* rsp_write_port_file () */
+
+
 /*---------------------------------------------------------------------------*/
 /*!Get a new client connection.
 
@@ -313,9 +425,13 @@ rsp_exception (unsigned long int  except)
    connections from a single GDB instance (we couldn't be talking to multiple
    GDBs at once!).
 
-   The service is specified either as a port number in the Or1ksim configuration
-   (parameter rsp_port in section debug, default 51000) or as a service name
-   in the constant OR1KSIM_RSP_SERVICE.
+   The port is rsp.port, as passed to rsp_init (). Port 0 binds to any free
+   port; the port actually used is stored back in rsp.port. Once the socket is
+   listening the port is reported on stdout and in rsp.port_file, so GDB may
+   connect as soon as either appears.
+
+   Failing to set up the socket is fatal: there is no way to make progress
+   without a client.
 
    The protocol used for communication is specified in OR1KSIM_RSP_PROTOCOL. */
 /*---------------------------------------------------------------------------*/
@@ -350,8 +466,7 @@ rsp_get_client ()
   if (tmp_fd < 0)
     {
       fprintf (stderr, "ERROR: Cannot open RSP socket\n");
-      //sim_done ();
-      return;
+      exit (1);
     }
 
   /* Allow rapid reuse of the port on this socket */
@@ -365,22 +480,29 @@ rsp_get_client ()
   sock_addr.sin_addr.s_addr = INADDR_ANY;
   if (bind (tmp_fd, (struct sockaddr *) &sock_addr, sizeof (sock_addr)))
     {
-      fprintf (stderr, "ERROR: Cannot bind to RSP socket\n");
-      //sim_done ();
-      return;
+      fprintf (stderr, "ERROR: Cannot bind to RSP port %u\n", rsp.port);
+      exit (1);
     }
       
   /* Listen for (at most one) client */
   if (listen (tmp_fd, 1))
     {
       fprintf (stderr, "ERROR: Cannot listen on RSP socket\n");
-      //sim_done ();
-      return;
+      exit (1);
     }
-    
 
-  printf ("Listening for RSP on port %d\n", rsp.port);
+  /* Find out which port we got if the OS chose it */
+  len = sizeof (sock_addr);
+  if (getsockname (tmp_fd, (struct sockaddr *) &sock_addr, &len))
+    {
+      fprintf (stderr, "ERROR: Cannot get RSP socket address\n");
+      exit (1);
+    }
+  rsp.port = ntohs (sock_addr.sin_port);
+
+  printf ("Listening for RSP on port %u\n", rsp.port);
   fflush (stdout);
+  rsp_write_port_file ();
 
   /* Accept a client which connects */
   len = sizeof (socklen_t);		/* Bug fix by Julius Baxter */
@@ -464,6 +586,19 @@ rsp_client_request ()
       return;
 
     case 'b':
+      if (0 == strcmp ("bs", buf->data))
+	{
+	  /* Backward single step */
+	  rsp_reverse_step ();
+	  return;
+	}
+      else if (0 == strcmp ("bc", buf->data))
+	{
+	  /* Backward continue */
+	  rsp_reverse_continue ();
+	  return;
+	}
+
       /* Setting baud rate is deprecated */
       fprintf (stderr, "Warning: RSP 'b' packet is deprecated and not "
 	       "supported: ignored\n");
@@ -552,10 +687,8 @@ rsp_client_request ()
       return;
 
     case 'M':
-      fprintf (stderr, "Warning: RSP %c not supported: ignored\n", buf->data[0]);
-      return;
       /* Write memory (symbolic) */
-      //rsp_write_mem (buf);
+      rsp_write_mem (buf);
       return;
 
     case 'p':
@@ -625,6 +758,11 @@ rsp_client_request ()
       rsp_vpkt (buf);
       return;
 
+    case 'x':
+      /* Read memory (binary) */
+      rsp_read_mem_bin (buf);
+      return;
+
     case 'X':
       /* Write memory (binary) */
       rsp_write_mem_bin (buf);
@@ -659,6 +797,10 @@ rsp_client_close ()
       close (rsp.client_fd);
       rsp.client_fd = -1;
     }
+
+  /* Anything still buffered came from the old client */
+  rsp_in.len = 0;
+  rsp_in.pos = 0;
 }	/* rsp_client_close () */
 
 
@@ -670,12 +812,18 @@ rsp_client_close ()
    escaped by preceding them with '}' and then XORing the character with
    0x20.
 
+   The whole packet is framed first and written to the socket at once: with
+   TCP_NODELAY set, writing it a character at a time sends a segment per
+   character.
+
    @param[in] buf  The data to send                                          */
 /*---------------------------------------------------------------------------*/
 static void
 put_packet (struct rsp_buf *buf)
 {
-  int  ch;				/* Ack char */
+  /* Worst case every char is escaped, plus '$', '#' and the checksum */
+  static char  frame[2 * GDB_BUF_MAX + 4];
+  int          ch;			/* Ack char */
 
   /* Construct $<packet info>#<checksum>. Repeat until the GDB client
      acknowledges satisfactory receipt. */
@@ -683,13 +831,14 @@ put_packet (struct rsp_buf *buf)
     {
       unsigned char checksum = 0;	/* Computed checksum */
       int           count    = 0;	/* Index into the buffer */
+      int           len      = 0;	/* Chars in the frame */
 
 #if RSP_TRACE
       printf ("Putting %s\n", buf->data);
       fflush (stdout);
 #endif
 
-      put_rsp_char ('$');		/* Start char */
+      frame[len++] = '$';		/* Start char */
 
       /* Body of the packet */
       for (count = 0; count < buf->len; count++)
@@ -701,18 +850,20 @@ put_packet (struct rsp_buf *buf)
 	    {
 	      ch       ^= 0x20;
 	      checksum += (unsigned char)'}';
-	      put_rsp_char ('}');
+	      frame[len++] = '}';
 	    }
 
 	  checksum += ch;
-	  put_rsp_char (ch);
+	  frame[len++] = ch;
 	}
 
-      put_rsp_char ('#');		/* End char */
+      frame[len++] = '#';		/* End char */
 
       /* Computed checksum */
-      put_rsp_char (hexchars[checksum >> 4]);
-      put_rsp_char (hexchars[checksum % 16]);
+      frame[len++] = hexchars[checksum >> 4];
+      frame[len++] = hexchars[checksum % 16];
+
+      put_rsp_buf (frame, len);
 
       /* Check for ack of connection failure */
       ch = get_rsp_char ();
@@ -894,19 +1045,38 @@ get_packet ()
 /*---------------------------------------------------------------------------*/
 static void
 put_rsp_char (char  c)
+{
+  put_rsp_buf (&c, 1);
+
+}	/* put_rsp_char () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Put a block of characters out onto the client socket
+
+   This should only be called if the client is open, but we check for safety.
+
+   @param[in] data  The characters to put out
+   @param[in] len   The number of characters                                 */
+/*---------------------------------------------------------------------------*/
+static void
+put_rsp_buf (const char *data,
+	     int         len)
 {
   if (-1 == rsp.client_fd)
     {
-      fprintf (stderr, "Warning: Attempt to write '%c' to unopened RSP "
-	       "client: Ignored\n", c);
+      fprintf (stderr, "Warning: Attempt to write to unopened RSP "
+	       "client: Ignored\n");
       return;
     }
 
-  /* Write until successful (we retry after interrupts) or catastrophic
-     failure. */
-  while (1)
+  /* Write until everything is written (we retry after interrupts and
+     partial writes) or catastrophic failure. */
+  while (len > 0)
     {
-      switch (write (rsp.client_fd, &c, sizeof (c)))
+      ssize_t  written = write (rsp.client_fd, data, len);
+
+      switch (written)
 	{
 	case -1:
 	  /* Error: only allow interrupts or would block */
@@ -925,10 +1095,12 @@ put_rsp_char (char  c)
 	  break;		/* Nothing written! Try again */
 
 	default:
-	  return;		/* Success, we can return */
+	  data += written;	/* Carry on with whatever is left */
+	  len  -= written;
+	  break;
 	}
     }
-}	/* put_rsp_char () */
+}	/* put_rsp_buf () */
 
 
 /*---------------------------------------------------------------------------*/
@@ -936,6 +1108,9 @@ put_rsp_char (char  c)
 
    This should only be called if the client is open, but we check for safety.
 
+   Reads as much as the client has sent into rsp_in, so a packet costs one
+   read () rather than one per character.
+
    @return  The character read, or -1 on failure                             */
 /*---------------------------------------------------------------------------*/
 static int
@@ -948,13 +1123,18 @@ get_rsp_char ()
       return  -1;
     }
 
+  if (rsp_in.pos < rsp_in.len)
+    {
+      return  rsp_in.data[rsp_in.pos++];
+    }
+
   /* Non-blocking read until successful (we retry after interrupts) or
      catastrophic failure. */
   while (1)
     {
-      unsigned char  c;
+      ssize_t  got = read (rsp.client_fd, rsp_in.data, sizeof (rsp_in.data));
 
-      switch (read (rsp.client_fd, &c, sizeof (c)))
+      switch (got)
 	{
 	case -1:
 	  /* Error: only allow interrupts */
@@ -975,7 +1155,10 @@ get_rsp_char ()
 	  return  -1;
 
 	default:
-	  return  c & 0xff; /* Success, we can return (no sign extend!) */
+	  /* Success, we can return (no sign extend!) */
+	  rsp_in.len = got;
+	  rsp_in.pos = 1;
+	  return  rsp_in.data[0];
 	}
     }
 }	/* get_rsp_char () */
@@ -1075,6 +1258,7 @@ mp_hash_add (enum mp_type       type,
   curr->type  = type;
   curr->addr  = addr;
   curr->instr = instr;
+  curr->len   = 1;
   curr->next  = rsp.mp_hash[hv];
 
   rsp.mp_hash[hv] = curr;
@@ -1168,6 +1352,46 @@ mp_hash_delete (enum mp_type       type,
 }	/* mp_hash_delete () */
 
 
+/*---------------------------------------------------------------------------*/
+/*!Look up a write watchpoint covering a store
+
+   Stores are whole words, so a watchpoint matches if any of its bytes lies
+   in the word at addr. An exact match is tried first; otherwise the table is
+   searched for a watchpoint starting below addr that reaches into it.
+
+   @param[in] addr  The word address stored to
+
+   @return  A pointer to the watchpoint found, or NULL if there is none     */
+/*---------------------------------------------------------------------------*/
+static struct mp_entry *
+mp_watch_lookup (unsigned long int  addr)
+{
+  struct mp_entry *curr;
+  int              i;
+
+  curr = mp_hash_lookup (WP_WRITE, addr);
+  if (NULL != curr)
+    {
+      return  curr;
+    }
+
+  for (i = 0; i < MP_HASH_SIZE; i++)
+    {
+      for (curr = rsp.mp_hash[i]; NULL != curr; curr = curr->next)
+	{
+	  if ((WP_WRITE == curr->type) && (curr->addr < addr + 4) &&
+	      (addr < curr->addr + curr->len))
+	    {
+	      return  curr;
+	    }
+	}
+    }
+
+  return  NULL;
+
+}	/* mp_watch_lookup () */
+
+
 /*---------------------------------------------------------------------------*/
 /*!Utility to give the value of a hex char
 
@@ -1555,58 +1779,91 @@ rsp_read_mem (struct rsp_buf *buf)
   //fprintf(stderr, "rsp_read_mem: m%x,%x\n", addr,len);
 
   /* Make sure we won't overflow the buffer (2 chars per byte) */
-  if ((len * 2) >= GDB_BUF_MAX)
+  if ((len < 0) || ((len * 2) >= GDB_BUF_MAX))
     {
       fprintf (stderr, "Warning: Memory read %s too large for RSP packet: "
 	       "truncated\n", buf->data);
       len = (GDB_BUF_MAX - 1) / 2;
     }
 
-  /* Refill the buffer with the reply */
-  for (off = 0; off < len; off++)
-    {
-      unsigned char ch;		/* The byte at the address */
+  /* Read the whole block into the second half of the buffer, then expand it
+     to hex from the front */
+  {
+    unsigned char *bytes = (unsigned char *) &(buf->data[GDB_BUF_MAX / 2]);
 
-      /* Check memory area is valid */
-      if (!simValidMem(addr + off))
-	{
-	  /* The error number doesn't matter. The GDB client will substitute
-	     its own */
-	  put_str_packet ("E01");
-	  return;
-	}
+    if (simDebugReadBlock (addr, bytes, len))
+      {
+	/* The error number doesn't matter. The GDB client will substitute
+	   its own */
+	put_str_packet ("E01");
+	return;
+      }
 
-      // Get the memory direct - no translation.
-      //ch = eval_direct8 (addr + off, 0, 0);
-      //fprintf(stderr, "Trying to read %x\n", addr+off);
-      simDebugRead(addr + off, &ch);
+    for (off = 0; off < len; off++)
+      {
+	unsigned char  ch = bytes[off];	/* The byte at the address */
 
-      ////memcpy(&buf->data[off*2], ch, 1);
-      //fprintf (stderr, "Byte: %x\n", ch);
-      ////for(int i = 0; i < 4 && off+i < len; i++)
-      //int cutBytes = 0;
-      //for(int i = 0; i < 4 && (off+i-cutBytes) < len; i++)
-      //{
-      //  if(off == 0 && i < (addr % 4))
-      //  {
-      //    cutBytes++;
-      //    continue;
-      //  }
-      //  buf->data[(off+i-cutBytes)*2] = hexchars[((ch >> 8*i)>>4) & 0xf];
-      //  buf->data[(off+i-cutBytes)*2+1] = hexchars[(ch >> 8*i) & 0xf];
-      //}
-      
-      buf->data[off * 2]     = hexchars[ch >>   4];
-      buf->data[off * 2 + 1] = hexchars[ch &  0xf];
-    }
+	buf->data[off * 2]     = hexchars[ch >>   4];
+	buf->data[off * 2 + 1] = hexchars[ch &  0xf];
+      }
+  }
 
   buf->data[off * 2] = 0;			/* End of string */
-  buf->len           = strlen (buf->data);
+  buf->len           = off * 2;
   put_packet (buf);
 
 }	/* rsp_read_mem () */
 
 
+/*---------------------------------------------------------------------------*/
+/*!Handle a RSP read memory (binary) request
+
+   Syntax is:
+
+     x<addr>,<length>:
+
+   The reply is 'b' followed by the bytes read, escaped by put_packet (), so
+   it takes about half the characters of an 'm' reply. GDB only sends this
+   because qSupported reports binary-upload. A shorter reply than requested
+   is allowed, so requests too large for the packet are simply truncated.
+
+   @param[in] buf  The command received                                      */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_read_mem_bin (struct rsp_buf *buf)
+{
+  unsigned int    addr;			/* Where to read the memory */
+  unsigned int    len;			/* Number of bytes to read */
+
+  if (2 != sscanf (buf->data, "x%x,%x", &addr, &len))
+    {
+      fprintf (stderr, "Warning: Failed to recognize RSP read memory "
+	       "command: %s\n", buf->data);
+      put_str_packet ("E01");
+      return;
+    }
+
+  /* Leave room for the 'b' and the EOS. The length is unsigned, so a huge
+     request cannot slip past this as a negative one. */
+  if (len > GDB_BUF_MAX - 2)
+    {
+      len = GDB_BUF_MAX - 2;
+    }
+
+  if (simDebugReadBlock (addr, (unsigned char *) &(buf->data[1]), len))
+    {
+      put_str_packet ("E01");
+      return;
+    }
+
+  buf->data[0]       = 'b';
+  buf->data[len + 1] = 0;
+  buf->len           = len + 1;
+  put_packet (buf);
+
+}	/* rsp_read_mem_bin () */
+
+
 /*---------------------------------------------------------------------------*/
 /*!Handle a RSP write memory (symbolic) request
 
@@ -1653,34 +1910,26 @@ rsp_write_mem (struct rsp_buf *buf)
       return;
     }
 
-  /* Write the bytes to memory */
+  /* Convert the hex in place, then write the bytes to memory */
   for (off = 0; off < len; off++)
     {
-      if (!isValidMem(addr + off))
-	{
-	  /* The error number doesn't matter. The GDB client will substitute
-	     its own */
-	  put_str_packet ("E01");
-	  return;
-	}
-      else
-	{
-	  unsigned char  nyb1 = hex (symdat[off * 2]);
-	  unsigned char  nyb2 = hex (symdat[off * 2 + 1]);
-    
-    simDebugWrite(addr+off, (nyb1 << 4) | nyb2); 
+      unsigned char  nyb1 = hex (symdat[off * 2]);
+      unsigned char  nyb2 = hex (symdat[off * 2 + 1]);
 
-	  ///* circumvent the read-only check usually done for mem accesses
-	  //   data is in host order, because that's what set_direct32 needs
+      symdat[off] = (nyb1 << 4) | nyb2;
+    }
 
-	  //   We make sure both data and instruction cache are invalidated
-	  //   first, so that the write goes through the cache. */
-	  //dc_inv (addr + off);
-	  //ic_inv (addr + off);
-	  //set_program8 (addr + off, (nyb1 << 4) | nyb2);
-	}
+  if (simDebugWriteBlock (addr, (unsigned char *) symdat, len))
+    {
+      /* The error number doesn't matter. The GDB client will substitute
+	 its own */
+      put_str_packet ("E01");
+      return;
     }
 
+  /* A replay would not repeat this change, so history starts again here */
+  historyReset ();
+
   put_str_packet ("OK");
 
 }	/* rsp_write_mem () */
@@ -1812,6 +2061,9 @@ rsp_write_reg (struct rsp_buf *buf)
       return;
     }
 
+  /* A replay would not repeat this change, so history starts again here */
+  historyReset ();
+
   put_str_packet ("OK");
 
 }	/* rsp_write_reg () */
@@ -1887,8 +2139,7 @@ rsp_query (struct rsp_buf *buf)
   else if (0 == strncmp ("qRcmd,", buf->data, strlen ("qRcmd,")))
     {
       /* This is used to interface to commands to do "stuff" */
-      //rsp_command (buf);
-      fprintf (stderr, "Warning: RSP qRcmd query not supported\n");
+      rsp_command (buf);
     }
   else if (0 == strncmp ("qSupported", buf->data, strlen ("qSupported")))
     {
@@ -1900,7 +2151,8 @@ rsp_query (struct rsp_buf *buf)
 
       char  reply[GDB_BUF_MAX];
 
-      sprintf (reply, "PacketSize=%x", GDB_BUF_MAX);
+      sprintf (reply, "PacketSize=%x;qXfer:memory-map:read+;binary-upload+;"
+	       "ReverseStep+;ReverseContinue+", GDB_BUF_MAX - 1);
       put_str_packet (reply);
     }
   else if (0 == strncmp ("qSymbol:", buf->data, strlen ("qSymbol:")))
@@ -1926,9 +2178,14 @@ rsp_query (struct rsp_buf *buf)
       put_str_packet ("");
       //put_str_packet ("T0");
     }
+  else if (0 == strncmp ("qXfer:memory-map:read::", buf->data,
+			 strlen ("qXfer:memory-map:read::")))
+    {
+      rsp_memory_map (buf);
+    }
   else if (0 == strncmp ("qXfer:", buf->data, strlen ("qXfer:")))
     {
-      /* For now we support no 'qXfer' requests, but these should not be
+      /* We support no other 'qXfer' requests, but these should not be
 	 expected, since they were not reported by 'qSupported' */
       fprintf (stderr, "Warning: RSP 'qXfer' not supported: ignored\n");
       put_str_packet ("");
@@ -1946,80 +2203,274 @@ rsp_query (struct rsp_buf *buf)
       fprintf (stderr, "Unrecognized RSP query: ignored\n");
     }
 }	/* rsp_query () */
-//
-//
-///*---------------------------------------------------------------------------*/
-///*!Handle a RSP qRcmd request
-//
-//  The actual command follows the "qRcmd," in ASCII encoded to hex
-//
-//   @param[in] buf  The request in full                                       */
-///*---------------------------------------------------------------------------*/
-//static void
-//rsp_command (struct rsp_buf *buf)
-//{
-//  char  cmd[GDB_BUF_MAX];
-//
-//  hex2ascii (cmd, &(buf->data[strlen ("qRcmd,")]));
-//
-//  /* Work out which command it is */
-//  if (0 == strncmp ("readspr ", cmd, strlen ("readspr")))
-//    {
-//      unsigned int       regno;
-//
-//      /* Parse and return error if we fail */
-//      if( 1 != sscanf (cmd, "readspr %4x", &regno))
-//	{
-//	  fprintf (stderr, "Warning: qRcmd %s not recognized: ignored\n",
-//		   cmd);
-//	  put_str_packet ("E01");
-//	  return;
-//	}
-//
-//      /* SPR out of range */
-//      if (regno > MAX_SPRS)
-//	{
-//	  fprintf (stderr, "Warning: qRcmd readspr %x too large: ignored\n",
-//		   regno);
-//	  put_str_packet ("E01");
-//	  return;
-//	}
-//
-//      /* Construct the reply */
-//      sprintf (cmd, "%8lx", (unsigned long int)mfspr (regno));
-//      ascii2hex (buf->data, cmd);
-//      buf->len = strlen (buf->data);
-//      put_packet (buf);
-//    }
-//  else if (0 == strncmp ("writespr ", cmd, strlen ("writespr")))
-//    {
-//      unsigned int       regno;
-//      unsigned long int  val;
-//
-//      /* Parse and return error if we fail */
-//      if( 2 != sscanf (cmd, "writespr %4x %8lx", &regno, &val))
-//	{
-//	  fprintf (stderr, "Warning: qRcmd %s not recognized: ignored\n",
-//		   cmd);
-//	  put_str_packet ("E01");
-//	  return;
-//	}
-//
-//      /* SPR out of range */
-//      if (regno > MAX_SPRS)
-//	{
-//	  fprintf (stderr, "Warning: qRcmd writespr %x too large: ignored\n",
-//		   regno);
-//	  put_str_packet ("E01");
-//	  return;
-//	}
-//
-//      /* Update the SPR and reply "OK" */
-//      mtspr (regno, val);
-//      put_str_packet ("OK");
-//    }
-//      
-//}	/* rsp_command () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Handle a RSP qXfer:memory-map:read request
+
+   Describes flash, RAM and the memory mapped registers to GDB, so it never
+   asks for memory that does not exist. Flash is reported as RAM: the
+   simulator writes it directly, so GDB need not use the flash packets.
+
+   Syntax is:
+
+     qXfer:memory-map:read::<offset>,<length>
+
+   The reply is 'm' and part of the document if there is more to come, or
+   'l' and the rest of it.
+
+   @param[in] buf  The request. Reused for the reply.                       */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_memory_map (struct rsp_buf *buf)
+{
+  char          map[512];
+  unsigned int  offset;
+  unsigned int  len;
+  unsigned int  map_len;
+
+  if (2 != sscanf (buf->data, "qXfer:memory-map:read::%x,%x", &offset, &len))
+    {
+      fprintf (stderr, "Warning: Failed to recognize RSP memory map "
+	       "request: %s\n", buf->data);
+      put_str_packet ("E01");
+      return;
+    }
+
+  map_len = snprintf (map, sizeof (map),
+		      "<?xml version=\"1.0\"?>\n"
+		      "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+		      "<memory-map>\n"
+		      "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n"
+		      "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n"
+		      "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n"
+		      "</memory-map>\n",
+		      FLASH_START, FLASH_SIZE, RAM_START, RAM_SIZE,
+		      MEMMAPIO_START, MEMMAPIO_SIZE);
+
+  if (offset >= map_len)
+    {
+      put_str_packet ("l");
+      return;
+    }
+
+  /* Leave room for the 'm' or 'l' and the EOS */
+  if (len > GDB_BUF_MAX - 2)
+    {
+      len = GDB_BUF_MAX - 2;
+    }
+  if (len > map_len - offset)
+    {
+      len = map_len - offset;
+    }
+
+  buf->data[0] = (offset + len < map_len) ? 'm' : 'l';
+  memcpy (&(buf->data[1]), &(map[offset]), len);
+  buf->data[len + 1] = 0;
+  buf->len = len + 1;
+  put_packet (buf);
+
+}	/* rsp_memory_map () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Hash memory and the registers that locate the program state
+
+   64-bit FNV-1a over RAM, flash, SP, LR and PC: the same state the MD5
+   memory-mapped command covers, without needing OpenSSL. Used to check that
+   a run with power failures ends in the same state as one without.
+
+   @return  The hash                                                         */
+/*---------------------------------------------------------------------------*/
+static unsigned long long int
+rsp_hash_state ()
+{
+  unsigned long long int  hash = 0xcbf29ce484222325ULL;	/* FNV offset basis */
+  const unsigned char    *regions[3];
+  size_t                  sizes[3];
+  size_t                  r;
+  size_t                  i;
+
+  regions[0] = (const unsigned char *) ram;
+  sizes[0]   = sizeof (ram);
+  regions[1] = (const unsigned char *) flash;
+  sizes[1]   = sizeof (flash);
+  regions[2] = (const unsigned char *) &(cpu.gpr[13]);
+  sizes[2]   = 3 * sizeof (cpu.gpr[13]);
+
+  for (r = 0; r < 3; r++)
+    {
+      for (i = 0; i < sizes[r]; i++)
+	{
+	  hash ^= regions[r][i];
+	  hash *= 0x100000001b3ULL;	/* FNV prime */
+	}
+    }
+
+  return hash;
+
+}	/* rsp_hash_state () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Run a single monitor command
+
+   Supported commands:
+   - stop-at N     Stop with SIGTRAP once the cycle count reaches N
+   - stop-after N  Stop with SIGTRAP N cycles from now
+   - stop-clear    Cancel any pending cycle stop
+   - reset         Reset the CPU, as a write to the do_reset register does
+   - counters      Report the cycle, instruction and checkpoint counters
+   - hash          Report a hash of memory (see rsp_hash_state ())
+   - history on [K]  Record execution history for reverse debugging, with a
+                   snapshot every K cycles
+   - history off   Stop recording and forget the history
+
+   @param[in]  cmd  The command, NUL terminated, no surrounding white space
+   @param[out] out  Text output of the command is appended here. Must have
+                    room for at least GDB_BUF_MAX / 2 characters.
+
+   @return  0 if the command was recognized and run, 1 otherwise            */
+/*---------------------------------------------------------------------------*/
+static int
+rsp_monitor (const char *cmd,
+	     char       *out)
+{
+  unsigned long long int  cycles;
+  unsigned int            interval;
+  char                    text[GDB_BUF_MAX / 2];
+
+  text[0] = '\0';
+
+  if (1 == sscanf (cmd, "stop-at %llu", &cycles))
+    {
+      rsp.stop_cycle = cycles;
+    }
+  else if (1 == sscanf (cmd, "stop-after %llu", &cycles))
+    {
+      rsp.stop_cycle = cycleCount + cycles;
+    }
+  else if (0 == strcmp ("stop-clear", cmd))
+    {
+      rsp.stop_cycle = RSP_NO_STOP;
+    }
+  else if (0 == strcmp ("reset", cmd))
+    {
+      /* PC seen is PC + 4 */
+      cpu_reset ();
+      cpu_set_pc (cpu_get_pc () + 0x4);
+      historyReset ();
+    }
+  else if (1 == sscanf (cmd, "history on %u", &interval))
+    {
+      historyStart (interval ? interval : HISTORY_DEFAULT_INTERVAL);
+    }
+  else if (0 == strcmp ("history on", cmd))
+    {
+      historyStart (HISTORY_DEFAULT_INTERVAL);
+    }
+  else if (0 == strcmp ("history off", cmd))
+    {
+      historyStop ();
+    }
+  else if (0 == strcmp ("counters", cmd))
+    {
+      snprintf (text, sizeof (text),
+		"cycles=%llu insns=%llu wasted=%llu since_reset=%u "
+		"since_cp=%u pc=0x%08x\n",
+		(unsigned long long int) cycleCount,
+		(unsigned long long int) insnCount,
+		(unsigned long long int) wastedCycles,
+		cyclesSinceReset, cyclesSinceCP,
+		get_pc () & 0xfffffffe);
+    }
+  else if (0 == strcmp ("hash", cmd))
+    {
+      snprintf (text, sizeof (text), "hash=%016llx\n", rsp_hash_state ());
+    }
+  else
+    {
+      return  1;
+    }
+
+  /* Leave room for the hex encoding of the whole reply */
+  if (strlen (out) + strlen (text) >= GDB_BUF_MAX / 2)
+    {
+      fprintf (stderr, "Warning: qRcmd output too long: truncated\n");
+      return  0;
+    }
+
+  strcat (out, text);
+  return  0;
+
+}	/* rsp_monitor () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Handle a RSP qRcmd request
+
+   The actual command follows the "qRcmd," in ASCII encoded to hex. Several
+   monitor commands may be separated by MONITOR_CMD_SEP, so a harness can
+   read the counters, reset the CPU and schedule the next power failure with
+   one packet. Commands are run in order; an unrecognized command stops the
+   sequence and is reported as an error.
+
+   The reply is the hex encoded output of all the commands, or "OK" if there
+   was none.
+
+   @param[in] buf  The request in full                                       */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_command (struct rsp_buf *buf)
+{
+  char  cmd[GDB_BUF_MAX];
+  char  out[GDB_BUF_MAX / 2];
+  char *next;
+
+  hex2ascii (cmd, &(buf->data[strlen ("qRcmd,")]));
+  out[0] = '\0';
+
+  for (next = strtok (cmd, MONITOR_CMD_SEP); NULL != next;
+       next = strtok (NULL, MONITOR_CMD_SEP))
+    {
+      char *end;
+
+      /* Trim white space around each command */
+      while (' ' == *next)
+	{
+	  next++;
+	}
+      for (end = next + strlen (next); (end > next) && (' ' == end[-1]);
+	   end--)
+	{
+	  end[-1] = '\0';
+	}
+
+      if ('\0' == *next)
+	{
+	  continue;
+	}
+
+      if (rsp_monitor (next, out))
+	{
+	  fprintf (stderr, "Warning: qRcmd %s not recognized: ignored\n",
+		   next);
+	  put_str_packet ("E01");
+	  return;
+	}
+    }
+
+  if ('\0' == out[0])
+    {
+      put_str_packet ("OK");
+      return;
+    }
+
+  ascii2hex (buf->data, out);
+  buf->len = strlen (buf->data);
+  put_packet (buf);
+
+}	/* rsp_command () */
 //
 //
 ///*---------------------------------------------------------------------------*/
@@ -2103,6 +2554,155 @@ rsp_step (struct rsp_buf *buf)
 }	/* rsp_step () */
 
 
+/*---------------------------------------------------------------------------*/
+/*!Replay execution history up to a later position
+
+   Runs the simulator forward from a state restored by historyRestore ()
+   until insnCount reaches end, recording snapshots as the main loop
+   does. Program output is muted, and watchpoint hits are only noted.
+
+   @param[in]  end        Position to stop at
+   @param[in]  find_stop  Nonzero to look for where forward execution would
+                          have stopped
+   @param[out] watch      Set to the address of the watchpoint hit at the
+                          returned position, or 0 for a breakpoint. May be
+                          NULL if find_stop is 0.
+
+   @return  The last position before end at which a breakpoint or write
+            watchpoint would have stopped the target, or RSP_NO_STOP     */
+/*---------------------------------------------------------------------------*/
+static unsigned long long int
+rsp_replay (unsigned long long int  end,
+	    int                     find_stop,
+	    unsigned int           *watch)
+{
+  unsigned long long int  stop = RSP_NO_STOP;
+
+  historyMute (1);
+  rsp.replaying = 1;
+  rsp.replay_hit = 0;
+
+  while (1)
+    {
+      unsigned int  pc = get_pc () & 0xfffffffe;
+
+      if (find_stop && (insnCount < end) &&
+	  (rsp.replay_hit ||
+	   (rsp_bp_hint (pc) && (NULL != mp_hash_lookup (BP_MEMORY, pc)))))
+	{
+	  stop = insnCount;
+	  *watch = rsp.replay_hit ? rsp.replay_addr : 0;
+	}
+
+      if (insnCount >= end)
+	{
+	  break;
+	}
+
+      rsp.replay_hit = 0;
+      sim_step ();
+
+      if (cycleCount >= historyNextSnapshot)
+	{
+	  historySnapshot ();
+	}
+    }
+
+  rsp.replaying = 0;
+  historyMute (0);
+
+  return  stop;
+
+}	/* rsp_replay () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Handle a RSP backward step request
+
+   Goes back one instruction: restores the latest snapshot before it and
+   replays up to it. If there is no history that far back the target does
+   not move and GDB is told it reached the start of the replay log.        */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_reverse_step ()
+{
+  unsigned long long int  target;
+  int                     snapshot;
+
+  if ((0 == insnCount) || (-1 == (snapshot = historyFind (insnCount - 1))))
+    {
+      put_str_packet ("T05replaylog:begin;");
+      return;
+    }
+
+  target = insnCount - 1;
+  historyRestore (snapshot);
+  rsp_replay (target, 0, NULL);
+
+  put_str_packet ("S05");
+
+}	/* rsp_reverse_step () */
+
+
+/*---------------------------------------------------------------------------*/
+/*!Handle a RSP backward continue request
+
+   Looks for the last point before the current one at which a breakpoint
+   or write watchpoint would have stopped a forward run. The history is
+   searched one snapshot interval at a time, newest first: each interval is
+   replayed to find its last stop, if any, then replayed again to stop
+   there. With no stop in the history the target is left at its start.    */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_reverse_continue ()
+{
+  unsigned long long int  end = insnCount;
+  int                     snapshot;
+
+  if ((0 == end) || (-1 == (snapshot = historyFind (end - 1))))
+    {
+      put_str_packet ("T05replaylog:begin;");
+      return;
+    }
+
+  for (; snapshot >= 0; snapshot--)
+    {
+      unsigned long long int  stop;
+      unsigned int            watch;
+
+      historyRestore (snapshot);
+      stop = rsp_replay (end, 1, &watch);
+
+      if (RSP_NO_STOP != stop)
+	{
+	  historyRestore (snapshot);
+	  rsp_replay (stop, 0, NULL);
+
+	  if (0 != watch)
+	    {
+	      char  buf[30];
+
+	      snprintf (buf, sizeof (buf), "T05watch:%08X;", watch);
+	      put_str_packet (buf);
+	    }
+	  else
+	    {
+	      put_str_packet ("S05");
+	    }
+
+	  return;
+	}
+
+      end = historyPosition (snapshot);
+    }
+
+  /* Nothing stops us before the start of the history */
+  historyRestore (0);
+  put_str_packet ("T05replaylog:begin;");
+
+}	/* rsp_reverse_continue () */
+
+
 ///*---------------------------------------------------------------------------*/
 ///*!Handle a RSP step with signal request
 //
@@ -2298,34 +2898,53 @@ rsp_write_mem_bin (struct rsp_buf *buf)
     }
 
   /* Write the bytes to memory */
-  for (off = 0; off < len; off++)
+  if (simDebugWriteBlock (addr, (unsigned char *) bindat, len))
     {
-      if (!simValidMem(addr + off))
-	{
-	  /* The error number doesn't matter. The GDB client will substitute
-	     its own */
-	  put_str_packet ("E01");
-	  return;
-	}
-      else
-	{
-	  ///* Circumvent the read-only check usually done for mem accesses
-
-	  //   We make sure both data and instruction cache are invalidated
-	  //   first, so that the write goes through the cache. */
-	  //dc_inv (addr + off);
-	  //ic_inv (addr + off);
-	  //set_program8 (addr + off, bindat[off]);
-    //memcpy(&flash[addr+off], &bindat[off], len);
-    simDebugWrite(addr+off, bindat[off]);
-	}
+      /* The error number doesn't matter. The GDB client will substitute
+	 its own */
+      put_str_packet ("E01");
+      return;
     }
 
+  /* A replay would not repeat this change, so history starts again here */
+  historyReset ();
+
   put_str_packet ("OK");
 
 }	/* rsp_write_mem_bin () */
 
       
+/*---------------------------------------------------------------------------*/
+/*!Count a write watchpoint on every page it covers
+
+   Stores are only checked against the watchpoints on pages with a nonzero
+   count, so a watchpoint that crosses into the next page has to be counted
+   there too.
+
+   @param[in] addr   The first address watched
+   @param[in] len    The number of bytes watched
+   @param[in] delta  1 when inserting the watchpoint, -1 when removing it    */
+/*---------------------------------------------------------------------------*/
+static void
+rsp_count_watch_pages (unsigned long int  addr,
+		       unsigned long int  len,
+		       int                delta)
+{
+  unsigned long int  page;
+  unsigned long int  last = (addr + len - 1) >> RSP_WATCH_PAGE_BITS;
+
+  for (page = addr >> RSP_WATCH_PAGE_BITS; page <= last; page++)
+    {
+      unsigned long int  page_addr = page << RSP_WATCH_PAGE_BITS;
+
+      if (page_addr < MEMMAPIO_START)
+	{
+	  rsp_watch_pages[rsp_watch_page (page_addr)] += delta;
+	}
+    }
+}	/* rsp_count_watch_pages () */
+
+
 /*---------------------------------------------------------------------------*/
 /*!Handle a RSP remove breakpoint or matchpoint request
 
@@ -2343,13 +2962,13 @@ rsp_remove_matchpoint (struct rsp_buf *buf)
   enum mp_type       type;		/* What sort of matchpoint */
   int                type_for_scanf;	/* To avoid old GCC limitations */
   unsigned long int  addr;		/* Address specified */
-  int                len;		/* Matchpoint length (not used) */
+  unsigned int       len;		/* Matchpoint length */
   struct mp_entry   *mpe;		/* Info about the replaced instr */
 
   /* Break out the instruction. We have to use an intermediary for the type,
      since older GCCs do not like taking the address of an enum
      (dereferencing type-punned pointer). */
-  if (3 != sscanf (buf->data, "z%1d,%lx,%1d", &type_for_scanf, &addr, &len))
+  if (3 != sscanf (buf->data, "z%1d,%lx,%x", &type_for_scanf, &addr, &len))
     {
       fprintf (stderr, "Warning: RSP matchpoint deletion request not "
 	       "recognized: ignored\n");
@@ -2362,7 +2981,7 @@ rsp_remove_matchpoint (struct rsp_buf *buf)
   /* Sanity check that the length is 4 */
   if (type == BP_MEMORY && 2 != len)
     {
-      fprintf (stderr, "Warning: RSP matchpoint deletion length %d not "
+      fprintf (stderr, "Warning: RSP matchpoint deletion length %u not "
 	       "valid: 2 assumed\n", len);
       len = 2;
     }
@@ -2374,6 +2993,11 @@ rsp_remove_matchpoint (struct rsp_buf *buf)
       /* Memory breakpoint - replace the original instruction. */
       //addr-=4; //Because of PC
       mpe = mp_hash_delete (type, addr);
+      if (NULL != mpe)
+	{
+	  rsp_bp_map[rsp_bp_index (addr) >> 3] &= ~(1 << (rsp_bp_index (addr) & 7));
+	  free (mpe);
+	}
 
       /* If the BP hasn't yet been deleted, put the original instruction
 	 back. Don't forget to free the hash table entry afterwards.
@@ -2397,7 +3021,12 @@ rsp_remove_matchpoint (struct rsp_buf *buf)
 
     case WP_WRITE:
       mpe = mp_hash_delete (type, addr);
-      put_str_packet ("OK");		/* Not supported */
+      if (NULL != mpe)
+	{
+	  rsp_count_watch_pages (mpe->addr, mpe->len, -1);
+	  free (mpe);
+	}
+      put_str_packet ("OK");
       return;
 
     case WP_READ:
@@ -2435,12 +3064,12 @@ rsp_insert_matchpoint (struct rsp_buf *buf)
   enum mp_type       type;		/* What sort of matchpoint */
   int                type_for_scanf;	/* To avoid old GCC limitations */
   unsigned long int  addr;		/* Address specified */
-  int                len;		/* Matchpoint length (not used) */
+  unsigned int       len;		/* Matchpoint length */
 
   /* Break out the instruction. We have to use an intermediary for the type,
      since older GCCs do not like taking the address of an enum
      (dereferencing type-punned pointer). */
-  if (3 != sscanf (buf->data, "Z%1d,%lx,%1d", &type_for_scanf, &addr, &len))
+  if (3 != sscanf (buf->data, "Z%1d,%lx,%x", &type_for_scanf, &addr, &len))
     {
       fprintf (stderr, "Warning: RSP matchpoint insertion request not "
 	       "recognized: ignored\n");
@@ -2454,7 +3083,7 @@ rsp_insert_matchpoint (struct rsp_buf *buf)
   /* Sanity check that the length is 4 */
   if (type == BP_MEMORY && 2 != len)
     {
-      fprintf (stderr, "Warning: RSP matchpoint insertion length %d not "
+      fprintf (stderr, "Warning: RSP matchpoint insertion length %u not "
 	       "valid: 2 assumed\n", len);
       len = 2;
     }
@@ -2471,6 +3100,7 @@ rsp_insert_matchpoint (struct rsp_buf *buf)
       //addr -=4; // Because of PC points to 4 ahead.
       simLoadInsn(addr,&instr);
       mp_hash_add (type, addr, instr);
+      rsp_bp_map[rsp_bp_index (addr) >> 3] |= 1 << (rsp_bp_index (addr) & 7);
       put_str_packet ("OK");
       return;
      
@@ -2487,7 +3117,12 @@ rsp_insert_matchpoint (struct rsp_buf *buf)
       //}
       //else
       //{
-      mp_hash_add (type, addr, instr);
+      if (NULL == mp_hash_lookup (type, addr))
+	{
+	  mp_hash_add (type, addr, instr);
+	  mp_hash_lookup (type, addr)->len = (0 == len) ? 1 : len;
+	  rsp_count_watch_pages (addr, mp_hash_lookup (type, addr)->len, 1);
+	}
       put_str_packet ("OK");
       //}
       return;
@@ -2524,6 +3159,14 @@ void rsp_check_stall()
     rsp.stepping = 0;
     put_str_packet("S05");
   }
+  // Cycle deadline set by a monitor command
+  else if( cycleCount >= rsp.stop_cycle)
+  {
+    rsp.stalled = 1;
+    rsp.stepping = 0;
+    rsp.stop_cycle = RSP_NO_STOP;
+    put_str_packet("S05");
+  }
   // Watchpoint that fires every x cycles
   else if( NULL != mp_hash_lookup(WP_WRITE,WATCHPOINT_ADDR) && cyclesSinceReset >= resetAfterCycles)
   {
@@ -2533,12 +3176,24 @@ void rsp_check_stall()
   }
 }
 
-void rsp_check_watch(unsigned int addr)
+// Called by rsp_check_watch() for stores to a page with a watchpoint
+void rsp_watch_hit(unsigned int addr)
 {
-  const char buff[30];
+  char buff[30];
+  struct mp_entry *mpe;
   if( addr != WATCHPOINT_ADDR )
   {
-  if( NULL != mp_hash_lookup(WP_WRITE, addr))
+  mpe = mp_watch_lookup(addr);
+  // Report an address inside the watched range, as GDB expects
+  if( NULL != mpe && addr < mpe->addr )
+    addr = mpe->addr;
+  if( NULL != mpe && rsp.replaying)
+  {
+    // Only note the hit, see rsp_replay()
+    rsp.replay_hit = 1;
+    rsp.replay_addr = addr;
+  }
+  else if( NULL != mpe)
   {
     rsp.stalled = 1;
     rsp.stepping = 0;
@@ -26,16 +26,54 @@
 #ifndef RSP_SERVER__H
 #define RSP_SERVER__H
 
+#include "sim_support.h"
+
 /*! Size of the matchpoint hash table. Largest prime < 2^10 */
 #define MP_HASH_SIZE  1021
 
+/*! Memory breakpoints are mirrored in a bitmap with one bit per halfword of
+    flash and RAM, so the check after every instruction does not have to
+    search the matchpoint hash table. Addresses outside flash and RAM alias
+    into the bitmap; a set bit is only a hint confirmed by the hash table. */
+#define RSP_BP_REGION_BITS  (FLASH_SIZE >> 1)
+#define rsp_bp_index(addr)  ((((addr) >= RAM_START) ? RSP_BP_REGION_BITS : 0) + \
+                             (((addr) & FLASH_ADDRESS_MASK) >> 1))
+#define rsp_bp_hint(addr)   (rsp_bp_map[rsp_bp_index(addr) >> 3] & \
+                             (1 << (rsp_bp_index(addr) & 7)))
+
+/*! Write watchpoints are counted per page of flash and RAM, so stores to
+    pages without a watchpoint skip the hash table */
+#define RSP_WATCH_PAGE_BITS     8
+#define RSP_WATCH_REGION_PAGES  (FLASH_SIZE >> RSP_WATCH_PAGE_BITS)
+#define rsp_watch_page(addr)    ((((addr) >= RAM_START) ? RSP_WATCH_REGION_PAGES : 0) + \
+                                 (((addr) & FLASH_ADDRESS_MASK) >> RSP_WATCH_PAGE_BITS))
+
+/*! Value of stop_cycle when no cycle deadline is pending */
+#define RSP_NO_STOP  (~0ULL)
+
+/*! Nonzero if rsp_check_stall () has to look at the instruction about to
+    execute at addr: we are stepping or watching the cycle counter, a
+    breakpoint may be set there, or a cycle deadline has passed */
+#define rsp_needs_attention(addr)  (rsp.attention || \
+                                    cycleCount >= rsp.stop_cycle || \
+                                    rsp_bp_hint(addr))
+
+/*! Stop if a write watchpoint covers addr */
+#define rsp_check_watch(addr)  do {                                 \
+    if (rsp_watch_pages[rsp_watch_page(addr)])                      \
+      rsp_watch_hit(addr);                                          \
+  } while (0)
+
+/*! Port to listen on when none is given on the command line */
+#define RSP_DEFAULT_PORT  27272
+
 /* Function prototypes for external use */
-void  rsp_init ();
+void  rsp_init (unsigned int port, const char *port_file);
 void  handle_rsp ();
 void  rsp_exception (unsigned long int  except);
 void  rsp_trap();
 void rsp_check_stall();
-void rsp_check_watch(unsigned int addr);
+void rsp_watch_hit(unsigned int addr);
 
 /*! Enumeration of different types of matchpoint. These have explicit values
     matching the second digit of 'z' and 'Z' packets. */
@@ -53,6 +91,7 @@ struct mp_entry
   enum mp_type       type;		/*!< Type of matchpoint */
   unsigned long int  addr;		/*!< Address with the matchpoint */
   unsigned long int  instr;		/*!< Substituted instruction */
+  unsigned long int  len;		/*!< Bytes watched by a watchpoint */
   struct mp_entry   *next;		/*!< Next entry with this hash */
 };
 
@@ -65,11 +104,21 @@ struct RSP
   int                sigval;		/*!< GDB signal for any exception */
   unsigned long int  start_addr;	/*!< Start of last run */
   struct mp_entry   *mp_hash[MP_HASH_SIZE];	/*!< Matchpoint hash table */
-  unsigned int       port;
+  unsigned int       port;		/*!< TCP port, 0 until the OS picks one */
+  const char        *port_file;		/*!< Where to report the port, or NULL */
   int                stalled;
   int                stepping;
+  int                attention;		/*!< Stepping or watching cycles */
+  int                replaying;		/*!< Replaying history, see
+					     rsp_replay () */
+  int                replay_hit;	/*!< Watchpoint hit while replaying */
+  unsigned int       replay_addr;	/*!< Address of that watchpoint */
+  unsigned long long int  stop_cycle;	/*!< Stop at this cycle, or
+					     RSP_NO_STOP */
 };
 
 extern struct RSP rsp;
+extern unsigned char  rsp_bp_map[];
+extern unsigned short rsp_watch_pages[];
 
 #endif	/* RSP_SERVER__H */
@@ -5,6 +5,8 @@
 #include "except.h"
 #include "decode.h"
 #include "rsp-server.h"
+#include "translate.h"
+#include "history.h"
 
 // Load a program into the simulator's RAM
 static void fillState(const char *pFileName)
@@ -94,23 +96,239 @@ void sim_exit(int i)
 }
 
 
+bool addToWasted = 0;
+
+// Checkpoint and wasted cycle accounting once an instruction has moved
+// the PC on from lastPC
+static void trackCheckpoints(u32 lastPC)
+{
+    u32 pc = cpu.gpr[GPR_PC];
+
+    // Increment counters
+    if(((pc - 6)&0xfffffffe) == addrOfCP)
+      cyclesSinceCP = 0;
+
+    unsigned cp_addr = (pc - 4) & (~0x1);
+    switch(cp_addr) {
+      case 0x000000d8:
+      case 0x000000f0:
+      case 0x00000102:
+      case 0x00000116:
+      case 0x0000012a:
+      case 0x0000013e:
+      case 0x00000152:
+      case 0x00000168:
+      case 0x00000180:
+      case 0x0000019c:
+        #if MEM_COUNT_INST
+          cp_count++;
+        #endif
+        reportAndReset(0);
+        #if PRINT_CHECKPOINTS
+          fprintf(stderr, "%08X: CP: %lu, Caller: %08X\n", cp_addr, cycleCount, (lastPC-4 &(~0x1)));
+        #endif
+        break;
+      default:
+        break;
+    }
+
+    if(addToWasted)
+    {
+      addToWasted = 0;
+      wastedCycles += cyclesSinceCP; 
+      cyclesSinceCP = 0;
+    }
+
+    if(((pc - 4)&0xfffffffe) == addrOfRestoreCP)
+      addToWasted = 1;
+}
+
+// Executes one instruction and does the per-instruction bookkeeping
+void sim_step(void)
+{
+    struct CPU lastCPU;
+    
+    u16 insn;
+    takenBranch = 0;
+    
+    if(PRINT_ALL_STATE)
+    {
+        printf("%08X\n", cpu_get_pc() - 0x3);
+        printState();
+    }
+
+ 
+    // Backup CPU state
+    //if(PRINT_STATE_DIFF)
+        memcpy(&lastCPU, &cpu, sizeof(struct CPU));
+    
+    #if THUMB_CHECK
+      if((cpu_get_pc() & 0x1) == 0)
+      {
+          fprintf(stderr, "ERROR: PC moved out of thumb mode: %08X\n", (cpu_get_pc() - 0x4));
+          sim_exit(1);
+      }
+    #endif
+    
+    if(translateEnabled)
+    {
+      const TRANSLATED_INSN *translated = translateFetch(cpu_get_pc() - 0x4);
+      insn = translated->insn;
+      diss_printf("%04X\n", insn);
+
+      decoded = translated->decoded;
+      exwbmem_translated(insn, translated->execute);
+    }
+    else
+    {
+      simLoadInsn(cpu_get_pc() - 0x4, &insn);
+      diss_printf("%04X\n", insn);
+    
+      decode(insn);
+      exwbmem(insn);
+    }
+
+    // Print any differences caused by the last instruction
+    if(PRINT_STATE_DIFF)
+        printStateDiff(&lastCPU, &cpu);
+ 
+    if (cpu_get_except() != 0)
+    {
+      lastCPU.exceptmask = cpu.exceptmask;
+      memcpy(&cpu, &lastCPU, sizeof(struct CPU));
+      check_except();
+    }
+   
+    // Hacky way to advance PC if no jumps
+    if(!takenBranch)
+    {
+      #if VERIFY_BRANCHES_TAGGED
+        if(cpu_get_pc() != lastCPU.gpr[15])
+        {
+            fprintf(stderr, "Error: Break in control flow not accounted for\n");
+            sim_exit(1);
+        }
+      #endif
+      cpu_set_pc(cpu_get_pc() + 0x2);
+    }
+    else
+        cpu_set_pc(cpu_get_pc() + 0x4);
+
+    trackCheckpoints(lastCPU.gpr[15]);
+}
+
+// Executes cached instructions from the PC up to and including the first
+// one that branches, without sim_step()'s tracing and CPU backup
+// The backup is only needed to undo an instruction that raised the
+// watchdog exception, so stores (which may start the watchdog) and every
+// instruction while the watchdog counts still go through sim_step()
+// Stops early when GDB has to look at the next instruction
+void sim_run_block(void)
+{
+    // Tracing needs every instruction to go through sim_step()
+    if(PRINT_ALL_STATE || PRINT_STATE_DIFF || PRINT_INST)
+    {
+      sim_step();
+      return;
+    }
+
+    // The PC is tracked here rather than with cpu_get_pc(), whose GPR
+    // hooks are meant for the program's own register accesses
+    u32 pc = cpu.gpr[GPR_PC];
+
+    #if THUMB_CHECK
+      if((pc & 0x1) == 0)
+      {
+          fprintf(stderr, "ERROR: PC moved out of thumb mode: %08X\n", (pc - 0x4));
+          sim_exit(1);
+      }
+    #endif
+
+    while(1)
+    {
+      const TRANSLATED_INSN *translated = translateFetch(pc - 0x4);
+      u32 lastPC = pc;
+
+      if(translated->stores || wdt_seed != 0)
+      {
+        sim_step();
+        if(takenBranch)
+          return;
+        pc = cpu.gpr[GPR_PC];
+      }
+      else
+      {
+        takenBranch = 0;
+        decoded = translated->decoded;
+        exwbmem_translated(translated->insn, translated->execute);
+
+        if(takenBranch)
+          pc = cpu.gpr[GPR_PC] + 0x4;
+        else
+        {
+          #if VERIFY_BRANCHES_TAGGED
+            if(cpu.gpr[GPR_PC] != pc)
+            {
+                fprintf(stderr, "Error: Break in control flow not accounted for\n");
+                sim_exit(1);
+            }
+          #endif
+          pc += 0x2;
+        }
+
+        cpu.gpr[GPR_PC] = pc;
+        trackCheckpoints(lastPC);
+
+        if(takenBranch)
+          return;
+      }
+
+      if(cpu.debug && (cycleCount >= historyNextSnapshot ||
+                       rsp_needs_attention((pc - 4) & 0xfffffffe)))
+        return;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     char *file = 0;
     int debug = 0;
+    unsigned int port = RSP_DEFAULT_PORT;
+    const char *portFile = NULL;
+    int arg;
     
     if(argc < 2)
     {
-        fprintf(stderr, "Usage: %s [-g] memory_file\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-g] [-p port] [-r port_file] [-i] memory_file\n", argv[0]);
+        fprintf(stderr, "\t-g\twait for GDB to connect before running\n");
+        fprintf(stderr, "\t-p\tRSP port for GDB (default %d, 0 picks a free port)\n", RSP_DEFAULT_PORT);
+        fprintf(stderr, "\t-r\twrite the RSP port to port_file once GDB can connect\n");
+        fprintf(stderr, "\t-i\tinterpret every instruction, do not cache decoded instructions\n");
         return 1;
     }
 
-    if(argc == 2)
-      file = argv[1];
-    else if(0 == strncmp("-g", argv[1], strlen("-g")))
+    for(arg = 1; arg < argc - 1; ++arg)
     {
-      file = argv[2];
-      debug = 1;
+      if(0 == strncmp("-g", argv[arg], strlen("-g")))
+        debug = 1;
+      else if(0 == strcmp("-p", argv[arg]) && arg + 1 < argc - 1)
+        port = strtoul(argv[++arg], NULL, 0);
+      else if(0 == strcmp("-r", argv[arg]) && arg + 1 < argc - 1)
+        portFile = argv[++arg];
+      else if(0 == strcmp("-i", argv[arg]))
+        translateEnabled = 0;
+      else
+      {
+        fprintf(stderr, "Error: Unknown option %s\n", argv[arg]);
+        return 1;
+      }
+    }
+    file = argv[argc - 1];
+
+    if(port > 0xFFFF)
+    {
+        fprintf(stderr, "Error: RSP port %u out of range\n", port);
+        return 1;
     }
 
 
@@ -124,6 +342,7 @@ int main(int argc, char *argv[])
     memset(ram, 0, sizeof(ram));
     memset(flash, 0, sizeof(flash));
     fillState(file);
+    translateFlush();
     
     // Initialize CPU state
     cpu_reset();
@@ -133,113 +352,27 @@ int main(int argc, char *argv[])
     cpu_set_pc(cpu_get_pc() + 0x4);
 
     if(cpu.debug){
-    rsp_init();
+    rsp_init(port, portFile);
     while(rsp.stalled)
       handle_rsp();
     }
 
     // Execute the program
     // Simulation will terminate when it executes insn == 0xBFAA
-    bool addToWasted = 0;
     while(1)
     {
-        struct CPU lastCPU;
-        
-        u16 insn;
-        takenBranch = 0;
-        
-        if(PRINT_ALL_STATE)
-        {
-            printf("%08X\n", cpu_get_pc() - 0x3);
-            printState();
-        }
-
- 
-        // Backup CPU state
-        //if(PRINT_STATE_DIFF)
-            memcpy(&lastCPU, &cpu, sizeof(struct CPU));
-        
-        #if THUMB_CHECK
-          if((cpu_get_pc() & 0x1) == 0)
-          {
-              fprintf(stderr, "ERROR: PC moved out of thumb mode: %08X\n", (cpu_get_pc() - 0x4));
-              sim_exit(1);
-          }
-        #endif
-        
-        simLoadInsn(cpu_get_pc() - 0x4, &insn);
-        diss_printf("%04X\n", insn);
-        
-        decode(insn);
-        exwbmem(insn);
-
-        // Print any differences caused by the last instruction
-        if(PRINT_STATE_DIFF)
-            printStateDiff(&lastCPU, &cpu);
- 
-        if (cpu_get_except() != 0)
-        {
-          lastCPU.exceptmask = cpu.exceptmask;
-          memcpy(&cpu, &lastCPU, sizeof(struct CPU));
-          check_except();
-        }
-       
-        // Hacky way to advance PC if no jumps
-        if(!takenBranch)
-        {
-          #if VERIFY_BRANCHES_TAGGED
-            if(cpu_get_pc() != lastCPU.gpr[15])
-            {
-                fprintf(stderr, "Error: Break in control flow not accounted for\n");
-                sim_exit(1);
-            }
-          #endif
-          cpu_set_pc(cpu_get_pc() + 0x2);
-        }
+        if(translateEnabled)
+          sim_run_block();
         else
-            cpu_set_pc(cpu_get_pc() + 0x4);
-
-        // Increment counters
-        if(((cpu_get_pc() - 6)&0xfffffffe) == addrOfCP)
-          cyclesSinceCP = 0;
-
-        unsigned cp_addr = (cpu.gpr[15] - 4) & (~0x1);
-        switch(cp_addr) {
-          case 0x000000d8:
-          case 0x000000f0:
-          case 0x00000102:
-          case 0x00000116:
-          case 0x0000012a:
-          case 0x0000013e:
-          case 0x00000152:
-          case 0x00000168:
-          case 0x00000180:
-          case 0x0000019c:
-            #if MEM_COUNT_INST
-              cp_count++;
-            #endif
-            reportAndReset(0);
-            #if PRINT_CHECKPOINTS
-              fprintf(stderr, "%08X: CP: %lu, Caller: %08X\n", cp_addr, cycleCount, (lastCPU.gpr[15]-4 &(~0x1)));
-            #endif
-            break;
-          default:
-            break;
-        }
-
-        if(addToWasted)
-        {
-          addToWasted = 0;
-          wastedCycles += cyclesSinceCP; 
-          cyclesSinceCP = 0;
-        }
-
-        if(((cpu_get_pc() - 4)&0xfffffffe) == addrOfRestoreCP)
-          addToWasted = 1;
+          sim_step();
 
       // Wait for commands from GDB
       if(debug){
-      rsp_check_stall();
+      if(cycleCount >= historyNextSnapshot)
+        historySnapshot();
+
+      if(rsp_needs_attention((cpu.gpr[GPR_PC] - 4) & 0xfffffffe))
+        rsp_check_stall();
 
       while(rsp.stalled)
         handle_rsp();
@@ -5,6 +5,8 @@
 #include "sim_support.h"
 #include "exmemwb.h"
 #include "rsp-server.h"
+#include "translate.h"
+#include "history.h"
 
 u64 cycleCount = 0;
 u64 insnCount = 0;
@@ -39,7 +41,7 @@ int addressReads = 0;
 // Essentially creates a new block of addresses on the bus of the processor that only the debug read and write commands can access
 //MEMMAPIO mmio = {.cycleCountLSB = &cycleCount, .cycleCountMSB = &cycleCount+4,
 //                 .cyclesSince = &cyclesSinceReset, .resetAfter = &resetAfterCycles};
-u32* mmio[] = {&cycleCount, ((u32*)&cycleCount)+1, &wastedCycles, ((u32*)&wastedCycles)+1,
+u32* mmio[MMIO_COUNT] = {&cycleCount, ((u32*)&cycleCount)+1, &wastedCycles, ((u32*)&wastedCycles)+1,
   &cyclesSinceReset, &cyclesSinceCP, &addrOfCP, &addrOfRestoreCP, 
   &resetAfterCycles, &do_reset, &PRINT_STATE_DIFF, &wdt_seed, 
   &wdt_val, &(md5[0]), &(md5[1]), &(md5[2]), 
@@ -367,6 +369,14 @@ char simLoadData_internal(u32 address, u32 *value, u32 falseRead)
         return 0;
       }
 
+      // Check for cycle count
+      // Lets programs time themselves, e.g., bareBench/timing
+      if(address >= MEMMAPIO_START && address < (MEMMAPIO_START + 4*(sizeof(mmio)/sizeof(mmio[0]))))
+      {
+        *value = *(mmio[(address - MEMMAPIO_START) >> 2]);
+        return 0;
+      }
+
       fprintf(stderr, "Error: DLR Memory access out of range: 0x%8.8X, pc=%x\n", address, cpu_get_pc());
       sim_exit(1);
     }
@@ -504,7 +514,9 @@ char simStoreData(u32 address, u32 value)
       printf("%llu\t%llu\tW\t%8.8X\t%d\t%d\n", cycleCount, insnCount, address, ram[(address & RAM_ADDRESS_MASK) >> 2], value);
     #endif
 
+    historyStore(&ram[(address & RAM_ADDRESS_MASK) >> 2]);
     ram[(address & RAM_ADDRESS_MASK) >> 2] = value;
+    translateInvalidate(address);
     
     #if MEM_COUNT_INST
       ++store_count;
@@ -528,7 +540,9 @@ char simStoreData(u32 address, u32 value)
       printf("%llu\t%llu\tW\t%8.8X\t%d\t%d\n", cycleCount, insnCount, address, flash[(address & FLASH_ADDRESS_MASK) >> 2], value);
     #endif
       
+    historyStore(&flash[(address & FLASH_ADDRESS_MASK) >> 2]);
     flash[(address & FLASH_ADDRESS_MASK) >> 2] = value;
+    translateInvalidate(address);
       
     #if MEM_COUNT_INST
       ++store_count;
@@ -546,13 +560,7 @@ char simDebugRead(u32 address, unsigned char* value)
 {
   unsigned int word;
 
-  #if MEM_CHECKS
-    if((address & 0x3) != 0)
-    {
-      fprintf(stderr, "Unalinged data memory read: 0x%8.8X\n", address);
-      sim_exit(1);
-    }
-  #endif
+  // Debugger accesses are byte wide, so no alignment check here
     
   if(address >= RAM_START)
   {
@@ -619,13 +627,7 @@ char simDebugWrite(u32 address, unsigned char value)
 {
   unsigned int word;
 
-  #if MEM_CHECKS
-    if((address & 0x3) != 0)
-    {
-      fprintf(stderr, "Unalinged data memory read: 0x%8.8X\n", address);
-      sim_exit(1);
-    }
-  #endif
+  // Debugger accesses are byte wide, so no alignment check here
 
   if(address >= RAM_START)
   {
@@ -668,6 +670,7 @@ char simDebugWrite(u32 address, unsigned char value)
     word &= ~(0xff << (8*(address%4)));
     word |= (value << (8*(address%4)));
     ram[(address & RAM_ADDRESS_MASK) >> 2] = word; 
+    translateInvalidate(address);
   }
   else
   {
@@ -681,11 +684,96 @@ char simDebugWrite(u32 address, unsigned char value)
     word &= ~(0xff << (8*(address%4)));
     word |= (value << (8*(address%4)));
     flash[(address & FLASH_ADDRESS_MASK) >> 2] = word;
+    translateInvalidate(address);
   }
 
   return 0;
 }
 
+// Returns a pointer to the word holding address if [address, address+len)
+// lies entirely in RAM or in flash, otherwise NULL
+static u32 *simDebugWords(u32 address, u32 len)
+{
+  if(address >= RAM_START && address < (RAM_START + RAM_SIZE) &&
+      len <= (RAM_START + RAM_SIZE) - address)
+    return &ram[(address & RAM_ADDRESS_MASK) >> 2];
+
+  if(address < (FLASH_START + FLASH_SIZE) && len <= (FLASH_START + FLASH_SIZE) - address)
+    return &flash[(address & FLASH_ADDRESS_MASK) >> 2];
+
+  return NULL;
+}
+
+// Block versions of simDebugRead() and simDebugWrite() for the GDB server
+// RAM and flash are copied a word at a time, anything else falls back
+// to the byte accessors so memory mapped registers behave the same
+char simDebugReadBlock(u32 address, unsigned char* dest, u32 len)
+{
+  u32 *word = simDebugWords(address, len);
+  u32 off = 0;
+
+  if(word == NULL)
+  {
+    for(off = 0; off < len; ++off)
+    {
+      if(!simValidMem(address + off))
+        return 1;
+      simDebugRead(address + off, &dest[off]);
+    }
+    return 0;
+  }
+
+  // Leading bytes up to a word boundary
+  for(; off < len && ((address + off) & 0x3) != 0; ++off)
+    dest[off] = (*word >> (8*((address + off) % 4))) & 0xff;
+  if((address & 0x3) != 0)
+    ++word;
+
+  // Whole words
+  for(; off + 4 <= len; off += 4, ++word)
+  {
+    dest[off]     = *word & 0xff;
+    dest[off + 1] = (*word >> 8) & 0xff;
+    dest[off + 2] = (*word >> 16) & 0xff;
+    dest[off + 3] = (*word >> 24) & 0xff;
+  }
+
+  // Trailing bytes
+  for(; off < len; ++off)
+    dest[off] = (*word >> (8*((address + off) % 4))) & 0xff;
+
+  return 0;
+}
+
+char simDebugWriteBlock(u32 address, const unsigned char* src, u32 len)
+{
+  u32 *word = simDebugWords(address, len);
+  u32 off;
+
+  if(word == NULL || (address & 0x3) != 0)
+  {
+    for(off = 0; off < len; ++off)
+    {
+      if(!simValidMem(address + off))
+        return 1;
+      simDebugWrite(address + off, src[off]);
+    }
+    return 0;
+  }
+
+  // Whole words, then leave any trailing bytes to simDebugWrite()
+  for(off = 0; off + 4 <= len; off += 4, ++word)
+  {
+    *word = src[off] | (src[off + 1] << 8) | (src[off + 2] << 16) | ((u32)src[off + 3] << 24);
+    translateInvalidate(address + off);
+  }
+
+  for(; off < len; ++off)
+    simDebugWrite(address + off, src[off]);
+
+  return 0;
+}
+
 char simValidMem(u32 address)
 {
   if((address >= RAM_START && address <= (RAM_START+RAM_SIZE)) ||
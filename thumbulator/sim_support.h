@@ -12,6 +12,7 @@
 #define CPU_FREQ            24000000
 #define MEMMAPIO_START      0x80000000
 #define MEMMAPIO_SIZE       (4*19)
+#define MMIO_COUNT          18          // Registers in the memory-mapped block
 #define WATCHPOINT_ADDR     0x80000010
 
 typedef __uint32_t u32;
@@ -26,7 +27,10 @@ typedef char bool;
 extern u32 ram[RAM_SIZE >> 2];
 extern u32 flash[FLASH_SIZE >> 2];
 extern bool takenBranch;    // Informs fetch that previous instruction caused a control flow change
+extern bool addToWasted;    // Set after a checkpoint restore: the next instruction adds cyclesSinceCP to wastedCycles
 extern void sim_exit(int);  // All sim ends lead through here
+void sim_step(void);        // Executes one instruction, used by the main loop and to replay history
+void sim_run_block(void);   // Executes cached instructions up to the next branch, used by the main loop
 void cpu_reset();           // Resets the CPU according to the specification
 char simLoadInsn(u32 address, u16 *value);  // All memory accesses one simulation starts should be through these interfaces
 char simLoadData(u32 address, u32 *value);
@@ -84,6 +88,7 @@ struct ADDRESS_LIST {
 typedef struct ADDRESS_LIST ADDRESS_LIST;
 
 
+extern u32* mmio[MMIO_COUNT];
 extern u64 cycleCount;
 extern u64 insnCount;
 extern u32 cyclesSinceReset;
@@ -107,7 +112,12 @@ extern u32 PRINT_STATE_DIFF;
     void (* gprReadHooks[16])(void);
     void (* gprWriteHooks[16])(void);
 #endif
-char simValidMem(u32 address); // Interface for rsp (GDB) server
+// Interface for rsp (GDB) server
+char simValidMem(u32 address);
+char simDebugRead(u32 address, unsigned char* value);
+char simDebugWrite(u32 address, unsigned char value);
+char simDebugReadBlock(u32 address, unsigned char* dest, u32 len);   // Returns nonzero if any byte is invalid
+char simDebugWriteBlock(u32 address, const unsigned char* src, u32 len);
 
 
 //struct MEMMAPIO {
@@ -0,0 +1,93 @@
+#include <string.h>
+#include "translate.h"
+#include "exmemwb.h"
+
+// Decoded instruction cache
+// Decoding only depends on the instruction bits (and the second half of
+// BL), so an instruction is fetched and decoded once and then reused
+// until the program or GDB writes to the memory it came from. Execution
+// still goes through the normal execute functions one instruction at a
+// time, so cycle counts and memory side effects match the interpreter.
+#define TRANSLATE_CACHE_SIZE    (1 << TRANSLATE_CACHE_BITS)
+#define TRANSLATE_INVALID       0xFFFFFFFF
+
+// One flag per page of RAM and flash: set if any instruction from the
+// page may be cached, so stores to data pages skip the cache entirely
+#define TRANSLATE_REGION_PAGES  (FLASH_SIZE >> TRANSLATE_PAGE_BITS)
+#define translate_page(x) ((((x) >= RAM_START) ? TRANSLATE_REGION_PAGES : 0) + \
+                           (((x) & FLASH_ADDRESS_MASK) >> TRANSLATE_PAGE_BITS))
+
+// Instruction fetches from RAM feed the idempotence break report, so
+// those runs always fetch through the interpreter
+bool translateEnabled = !REPORT_IDEM_BREAKS;
+
+static TRANSLATED_INSN translateCache[TRANSLATE_CACHE_SIZE];
+static unsigned char codePages[2 * TRANSLATE_REGION_PAGES];
+
+// STR, STRH and STRB (register and immediate), STR SP-relative, PUSH
+// and STM
+static bool translateStores(u16 insn)
+{
+    return ((insn & 0xF800) == 0x5000 && (insn & 0x0600) != 0x0600) ||
+           (insn & 0xF800) == 0x6000 || (insn & 0xF800) == 0x7000 ||
+           (insn & 0xF800) == 0x8000 || (insn & 0xF800) == 0x9000 ||
+           (insn & 0xFE00) == 0xB400 || (insn & 0xF800) == 0xC000;
+}
+
+void translateFlush(void)
+{
+    int i;
+
+    for(i = 0; i < TRANSLATE_CACHE_SIZE; ++i)
+        translateCache[i].address = TRANSLATE_INVALID;
+
+    memset(codePages, 0, sizeof(codePages));
+}
+
+const TRANSLATED_INSN *translateFetch(u32 address)
+{
+    // The PC keeps the Thumb bit set
+    address &= ~0x1;
+
+    TRANSLATED_INSN *entry = &translateCache[(address >> 1) & (TRANSLATE_CACHE_SIZE - 1)];
+
+    if(entry->address == address)
+        return entry;
+
+    // Miss: translate using the interpreter's own fetch and decode
+    simLoadInsn(address, &entry->insn);
+    decode(entry->insn);
+
+    entry->address = address;
+    entry->stores = translateStores(entry->insn);
+    entry->execute = exwbmem_lookup(entry->insn);
+    entry->decoded = decoded;
+
+    // BL reads its second half from the next halfword, which may be
+    // on the next page
+    codePages[translate_page(address)] = 1;
+    codePages[translate_page(address + 2)] = 1;
+
+    return entry;
+}
+
+static void translateDrop(u32 address)
+{
+    TRANSLATED_INSN *entry = &translateCache[(address >> 1) & (TRANSLATE_CACHE_SIZE - 1)];
+
+    if(entry->address == address)
+        entry->address = TRANSLATE_INVALID;
+}
+
+void translateInvalidate(u32 address)
+{
+    if(!codePages[translate_page(address)])
+        return;
+
+    // Both halfwords of the word, plus a BL whose second half is the
+    // first halfword of this word
+    address &= ~0x3;
+    translateDrop(address - 2);
+    translateDrop(address);
+    translateDrop(address + 2);
+}
@@ -0,0 +1,37 @@
+#ifndef TRANSLATE_HEADER
+#define TRANSLATE_HEADER
+
+#include "sim_support.h"
+#include "decode.h"
+
+// Translation cache settings
+#define TRANSLATE_CACHE_BITS    16  // log2 of the number of cached instructions (direct mapped)
+#define TRANSLATE_PAGE_BITS     8   // log2 of the code-write tracking granularity in bytes
+
+// One translated instruction: the raw halfword, its decoding, and the
+// leaf execute function selected by the execute jump tables
+typedef struct {
+    u32 address;                // Tag: address of the instruction
+    u16 insn;
+    bool stores;                // Writes memory, so it may start the watchdog
+    u32 (* execute)(void);
+    DECODE_RESULT decoded;
+} TRANSLATED_INSN;
+
+// Set to 0 to run the plain fetch-decode-execute interpreter
+extern bool translateEnabled;
+
+// Clears every translation; must be called before the first translateFetch()
+void translateFlush(void);
+
+// Returns the translation of the instruction at the passed address,
+// translating it first if it is not cached
+// Goes through simLoadInsn() and decode() on a miss, so errors are
+// reported exactly like the interpreter does
+const TRANSLATED_INSN *translateFetch(u32 address);
+
+// Drops any translation that depends on the word at the passed address
+// Called for every program and debugger write to RAM or flash
+void translateInvalidate(u32 address);
+
+#endif